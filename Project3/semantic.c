@@ -2,20 +2,226 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "syntax.h"
 
 #define TRUE 1
 #define FALSE 0
 
+/* ------------------------------------------------------------ */
+/* -------------------- STATISTICS SECTION -------------------- */
+/* ------------------------------------------------------------ */
+
+// Only built with -DSTATS, see STATISTICS in syntax.h. Exactly one phase
+// is current at any time, switching phases charges the time since the
+// last switch to the phase that was current.
+
+#ifdef STATS
+
+#include <time.h>
+
+const char* phase_names[NUMBER_OF_PHASES] = {
+    "other", "lex", "parse", "decls", "body", "output"
+};
+const char* counter_names[NUMBER_OF_COUNTERS] = {
+    "tokens", "symbol_lookups", "symbol_probes", "find_type", "unify",
+    "arena_allocs", "arena_bytes", "arena_blocks"
+};
+
+long stat_counts[NUMBER_OF_COUNTERS];
+double stat_seconds[NUMBER_OF_PHASES];
+int stat_phase = PHASE_OTHER;
+double stat_started;   // when the current phase became current
+double stat_first;     // when the first phase became current
+const char* stat_path; // -s, where write_stats() puts the report
+
+double stat_clock()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Makes phase current and returns the phase that was current
+int stat_switch(int phase)
+{
+    double now = stat_clock();
+    int previous = stat_phase;
+
+    if (stat_first == 0)
+        stat_first = now;
+    else
+        stat_seconds[stat_phase] += now - stat_started;
+    stat_started = now;
+    stat_phase = phase;
+    return previous;
+}
+
+// Registered with atexit(), so the report is written however the run
+// ends. One "phase name seconds" or "count name value" pair per line.
+void write_stats()
+{
+    FILE* out;
+    int i;
+
+    stat_switch(PHASE_OTHER);
+    out = fopen(stat_path, "w");
+    if (out == NULL)
+        return;
+    for (i = 0; i < NUMBER_OF_PHASES; i++)
+        fprintf(out, "phase %s %.6f\n", phase_names[i], stat_seconds[i]);
+    fprintf(out, "phase total %.6f\n", stat_started - stat_first);
+    for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+        fprintf(out, "count %s %ld\n", counter_names[i], stat_counts[i]);
+    fclose(out);
+}
+
+#endif
+
+/* -------------------------------------------------------- */
+/* -------------------- MEMORY SECTION -------------------- */
+/* -------------------------------------------------------- */
+
+// All parse tree nodes, strings and symbols live as long as the program,
+// so they are carved out of large zeroed blocks instead of being
+// allocated one by one. Nothing allocated here is ever freed.
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+char* arena_next;
+char* arena_end;
+
+void* arena_alloc(size_t size)
+{
+    void* p;
+
+    // Keep every allocation 8-byte aligned
+    size = (size + 7) & ~(size_t) 7;
+    STAT_ADD(COUNT_ARENA_ALLOCS, 1);
+    STAT_ADD(COUNT_ARENA_BYTES, size);
+    if ((size_t) (arena_end - arena_next) < size)
+    {
+        size_t block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        STAT_ADD(COUNT_ARENA_BLOCKS, 1);
+        arena_next = (char*) calloc(1, block_size);
+        if (arena_next == NULL)
+        {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        arena_end = arena_next + block_size;
+    }
+    p = arena_next;
+    arena_next += size;
+    return p;
+}
+
+char* arena_strdup(const char* s)
+{
+    size_t length = strlen(s) + 1;
+    char* copy = (char*) arena_alloc(length);
+
+    memcpy(copy, s, length);
+    return copy;
+}
+
+// Every identifier of the program is stored once. Equal names are equal
+// pointers, so hash-consed expressions can compare IDs by address.
+
+char** intern_hash;
+int intern_hash_size;
+int intern_count;
+
+char* intern_id(const char* s)
+{
+    unsigned int h;
+    int i;
+
+    if (2 * (intern_count + 1) > intern_hash_size)
+    {
+        char** old = intern_hash;
+        int old_size = intern_hash_size;
+
+        intern_hash_size = (old_size == 0) ? 1024 : 2 * old_size;
+        intern_hash = (char**) calloc(intern_hash_size, sizeof(char*));
+        for (i = 0; i < old_size; i++)
+        {
+            if (old[i] == NULL)
+                continue;
+            h = hash_string(old[i]) & (intern_hash_size - 1);
+            while (intern_hash[h] != NULL)
+                h = (h + 1) & (intern_hash_size - 1);
+            intern_hash[h] = old[i];
+        }
+        free(old);
+    }
+    h = hash_string(s) & (intern_hash_size - 1);
+    while (intern_hash[h] != NULL)
+    {
+        if (strcmp(intern_hash[h], s) == 0)
+            return intern_hash[h];
+        h = (h + 1) & (intern_hash_size - 1);
+    }
+    ++intern_count;
+    intern_hash[h] = arena_strdup(s);
+    return intern_hash[h];
+}
+
+// Lists are parsed onto this stack and then copied into one contiguous
+// arena array. Nested lists are pushed above their parent's elements
+// and are popped before the parent list ends.
+
+void** scratch;
+int scratch_top;
+int scratch_capacity;
+
+void scratch_push(void* p)
+{
+    if (scratch_top == scratch_capacity)
+    {
+        scratch_capacity = (scratch_capacity == 0) ? 1024 : 2 * scratch_capacity;
+        scratch = (void**) realloc(scratch, scratch_capacity * sizeof(void*));
+    }
+    scratch[scratch_top++] = p;
+}
+
+// Moves everything pushed since scratch_top was base into an arena array
+void** scratch_pop(int base)
+{
+    int count = scratch_top - base;
+    void** array = (void**) arena_alloc(count * sizeof(void*));
+
+    memcpy(array, scratch + base, count * sizeof(void*));
+    scratch_top = base;
+    return array;
+}
+
 /* ------------------------------------------------------- */
 /* -------------------- LEXER SECTION -------------------- */
 /* ------------------------------------------------------- */
 
 #define KEYWORDS  11
 
-#define MAX_TYPES 20
-struct symbol* table[MAX_TYPES];
-int new_types;
+// Symbol table, see the TYPE CHECKING SECTION
+struct symbol** table;
+int symbol_count;
+int table_capacity;
+int* symbol_hash;
+int symbol_hash_size;
+
+// Type variables, see the TYPE CHECKING SECTION
+int* type_parent;
+int* type_rank;
+int* type_builtin;
+int* type_next;
+int type_count;
+int type_capacity;
 
 enum TokenTypes
 {
@@ -47,19 +253,50 @@ int ttype; // token type
 int activeToken = FALSE;
 int tokenLength;
 int line_no = 1;
+int brace_depth = 0; // LBRACEs returned by getToken() that are not closed yet
+FILE* source;        // characters are read from here, stdin unless -i is used
+
+// In incremental mode (-i) the input is lexed once into this array and
+// the parser reads tokens from it, see the INCREMENTAL SECTION
+struct token_record
+{
+    int type;
+    int line;
+    char* lexeme;
+};
+
+struct token_record* tokens;
+int token_count;
+int token_capacity;
+int token_cursor = -1; // next token to return, -1 to read source instead
+int last_token = -1;   // index of the token returned last
+
+// Token spans of statements and bodies in incremental mode, see the
+// INCREMENTAL SECTION. Span 0 is not used.
+int* span_first;
+int* span_last;
+struct stmtNode** span_stmt; // statement of the span, NULL for a body
+char* span_alive;            // the statement is in the current parse tree
+int span_count = 1;
+int span_capacity;
+
+// Implicit variables in order of first use in incremental mode, NULL
+// otherwise, see the INCREMENTAL SECTION
+int* implicit_order;
+int implicit_count;
 
 void skipSpace()
 {
     char c;
 
-    c = getchar();
+    c = getc(source);
     line_no += (c == '\n');
-    while (!feof(stdin) && isspace(c))
+    while (!feof(source) && isspace(c))
     {
-        c = getchar();
+        c = getc(source);
         line_no += (c == '\n');
     }
-    ungetc(c, stdin);
+    ungetc(c, source);
 }
 
 int isKeyword(char *s)
@@ -88,7 +325,7 @@ int scan_number()
 {
     char c;
 
-    c = getchar();
+    c = getc(source);
     if (isdigit(c))
     {
         // First collect leading digits before dot
@@ -105,16 +342,16 @@ int scan_number()
             {
                 token[tokenLength] = c;
                 tokenLength++;
-                c = getchar();
+                c = getc(source);
             }
-            ungetc(c, stdin);
+            ungetc(c, source);
             token[tokenLength] = '\0';
         }
         // Check if leading digits are integer part of a REALNUM
-        c = getchar();
+        c = getc(source);
         if (c == '.')
         {
-            c = getchar();
+            c = getc(source);
             if (isdigit(c))
             {
                 token[tokenLength] = '.';
@@ -123,24 +360,24 @@ int scan_number()
                 {
                     token[tokenLength] = c;
                     tokenLength++;
-                    c = getchar();
+                    c = getc(source);
                 }
                 token[tokenLength] = '\0';
-                if (!feof(stdin))
-                    ungetc(c, stdin);
+                if (!feof(source))
+                    ungetc(c, source);
                 return REALNUM;
             }
             else
             {
-                ungetc(c, stdin);
+                ungetc(c, source);
                 c = '.';
-                ungetc(c, stdin);
+                ungetc(c, source);
                 return NUM;
             }
         }
         else
         {
-            ungetc(c, stdin);
+            ungetc(c, source);
             return NUM;
         }
     }
@@ -153,17 +390,17 @@ int scan_id_or_keyword()
     int ttype;
     char c;
 
-    c = getchar();
+    c = getc(source);
     if (isalpha(c))
     {
         while (isalnum(c))
         {
             token[tokenLength] = c;
             tokenLength++;
-            c = getchar();
+            c = getc(source);
         }
-        if (!feof(stdin))
-            ungetc(c, stdin);
+        if (!feof(source))
+            ungetc(c, source);
         token[tokenLength] = '\0';
         ttype = isKeyword(token);
         if (ttype == 0)
@@ -174,18 +411,14 @@ int scan_id_or_keyword()
         return ERROR;
 }
 
-int getToken()
+// Reads the next token from source
+int lex_token()
 {
     char c;
 
-    if (activeToken)
-    {
-        activeToken = FALSE;
-        return ttype;
-    }
     skipSpace();
     tokenLength = 0;
-    c = getchar();
+    c = getc(source);
     switch (c)
     {
         case '.':
@@ -219,34 +452,34 @@ int getToken()
         case '}':
             return RBRACE;
         case '<':
-            c = getchar();
+            c = getc(source);
             if (c == '=')
                 return LTEQ;
             else if (c == '>')
                 return NOTEQUAL;
             else
             {
-                ungetc(c, stdin);
+                ungetc(c, source);
                 return LESS;
             }
         case '>':
-            c = getchar();
+            c = getc(source);
             if (c == '=')
                 return GTEQ;
             else
             {
-                ungetc(c, stdin);
+                ungetc(c, source);
                 return GREATER;
             }
         default:
             if (isdigit(c))
             {
-                ungetc(c, stdin);
+                ungetc(c, source);
                 return scan_number();
             }
             else if (isalpha(c))
             {
-                ungetc(c, stdin);
+                ungetc(c, source);
                 return scan_id_or_keyword();
             }
             else if (c == EOF)
@@ -256,14 +489,104 @@ int getToken()
     }
 }
 
+int getToken()
+{
+    int type;
+
+    if (activeToken)
+    {
+        activeToken = FALSE;
+        return ttype;
+    }
+    if (token_cursor >= 0)
+    {
+        // The EOF record at the end of the array is returned forever
+        struct token_record* t = &tokens[token_cursor];
+
+        type = t->type;
+        last_token = token_cursor;
+        if (type != EOF)
+            ++token_cursor;
+        tokenLength = strlen(t->lexeme);
+        memcpy(token, t->lexeme, tokenLength + 1);
+        line_no = t->line;
+    }
+    else
+    {
+        STAT_ENTER(PHASE_LEX);
+        type = lex_token();
+        STAT_LEAVE();
+    }
+    STAT_ADD(COUNT_TOKENS, 1);
+    if (type == LBRACE)
+        ++brace_depth;
+    else if (type == RBRACE)
+        --brace_depth;
+    return type;
+}
+
+// Index of the token the next getToken() returns
+int next_token_index()
+{
+    return activeToken ? last_token : token_cursor;
+}
+
 /* ----------------------------------------------------------------- */
 /* -------------------- SYNTAX ANALYSIS SECTION -------------------- */
 /* ----------------------------------------------------------------- */
 
+// In recovery mode (-r) a syntax error does not stop the parser. The
+// innermost of program(), type_decl_list(), var_decl_list() and body()
+// sets recovery_point, syntax_error() jumps back there, and the parser
+// skips to a token of the FOLLOW set of what it was parsing and goes on.
+// Without -r, recovery_point stays NULL and the first error exits.
+int recover_errors = FALSE;
+jmp_buf* recovery_point = NULL;
+int syntax_errors = 0;
+int eof_reported = FALSE;
+
+// In incremental mode (-i) errors are not printed right away. They are
+// kept with the position of the token that caused them, so that errors
+// of the statements that are parsed again can be replaced.
+struct logged_error
+{
+    int position; // index in tokens[]
+    const char* message;
+};
+
+int log_errors = FALSE;
+struct logged_error* error_log;
+int error_count;
+int error_capacity;
+
+void log_syntax_error(const char* msg)
+{
+    if (error_count == error_capacity)
+    {
+        error_capacity = (error_capacity == 0) ? 64 : 2 * error_capacity;
+        error_log = (struct logged_error*) realloc(error_log, error_capacity * sizeof(struct logged_error));
+    }
+    error_log[error_count].position = last_token;
+    error_log[error_count].message = msg;
+    ++error_count;
+}
+
 void syntax_error(const char* msg)
 {
-    printf("Syntax error while parsing %s line %d\n", msg, line_no);
-    exit(1);
+    // Every construct that is still open at the end of the input
+    // reports it, print only the first of these errors
+    if (ttype != EOF || !eof_reported)
+    {
+        if (log_errors)
+            log_syntax_error(msg);
+        else
+            printf("Syntax error while parsing %s line %d\n", msg, line_no);
+        ++syntax_errors;
+    }
+    if (recovery_point == NULL)
+        exit(1);
+    eof_reported = eof_reported || (ttype == EOF);
+    longjmp(*recovery_point, 1);
 }
 
 /* -------------------- PRINTING PARSE TREE -------------------- */
@@ -346,20 +669,22 @@ void print_type_name(struct type_nameNode* typeName)
 
 void print_id_list(struct id_listNode* idList)
 {
-    printf("%s ", idList->id);
-    if (idList->id_list != NULL)
+    int i;
+
+    for (i = 0; i < idList->count; i++)
     {
-        printf(", ");
-        print_id_list(idList->id_list);
+        if (i > 0)
+            printf(", ");
+        printf("%s ", idList->ids[i]);
     }
 }
 
 void print_stmt_list(struct stmt_listNode* stmt_list)
 {
-    print_stmt(stmt_list->stmt);
-    if (stmt_list->stmt_list != NULL)
-        print_stmt_list(stmt_list->stmt_list);
+    int i;
 
+    for (i = 0; i < stmt_list->count; i++)
+        print_stmt(stmt_list->stmts[i]);
 }
 
 void print_assign_stmt(struct assign_stmtNode* assign_stmt)
@@ -478,31 +803,32 @@ void print_switch_stmt(struct switch_stmtNode* switc)
 
 /* -------------------- PARSING AND BUILDING PARSE TREE -------------------- */
 
+// Statements that contain a body (WHILE, DO and SWITCH) are parsed in
+// two steps so that nesting depth is limited by the heap and not by the
+// C stack. The functions below parse a statement up to and including
+// the LBRACE that opens its body, and body() keeps the statements whose
+// body is still open on an explicit stack of parse frames.
+
 // Note that the following function is not
 // called case because case is a keyword in C/C++
 struct caseNode* cas()
 {
-    // TODO: implement this
     struct caseNode* ca;
     ca = ALLOC(struct caseNode);
-    
+
     ttype = getToken();
     if (ttype == CASE)
     {
         ttype = getToken();
         if (ttype == NUM)
         {
-            ca->num = NUM;            
+            ca->num = atoi(token);
             ttype = getToken();
             if (ttype == COLON)
             {
                 ttype = getToken();
                 if (ttype == LBRACE)
-                {
-                    ungetToken();                
-                    ca->body = body();           
-                    return ca;
-                }
+                    return ca; // body is parsed by body()
                 else
                     syntax_error("case. LBRACE expected");
             }
@@ -519,7 +845,6 @@ struct caseNode* cas()
 
 struct case_listNode* case_list()
 {
-    // TODO: implement this
     struct case_listNode* caseList;
 
     ttype = getToken();
@@ -528,20 +853,8 @@ struct case_listNode* case_list()
         ungetToken();
         caseList = ALLOC(struct case_listNode);
         caseList->cas = cas();
-        ttype = getToken();
-        if (ttype == CASE)
-        {
-            ungetToken();
-            caseList->case_list = case_list();
-            return caseList;
-        }
-        else // If the next token is not in FOLLOW(stmt_list),
-             // let the caller handle it.
-        {
-            ungetToken();
-            caseList->case_list = NULL;
-            return caseList;
-        }
+        caseList->case_list = NULL; // the next case is linked by body()
+        return caseList;
     }
     else
         syntax_error("case_list. CASE expected");
@@ -550,7 +863,6 @@ struct case_listNode* case_list()
 
 struct switch_stmtNode* switch_stmt()
 {
-    // TODO: implement this
     struct switch_stmtNode* switchStmt;
 
     ttype = getToken();
@@ -560,18 +872,12 @@ struct switch_stmtNode* switch_stmt()
         if (ttype == ID)
         {
             switchStmt = ALLOC(struct switch_stmtNode);
-            switchStmt->id = strdup(token);
+            switchStmt->id = intern_id(token);
             ttype = getToken();
             if (ttype == LBRACE)
             {
                 switchStmt->case_list = case_list();
-                ttype = getToken();
-                if (ttype == RBRACE)
-                {
-                    return switchStmt;
-                }
-                else
-                    syntax_error("switch_stmt. RBRACE expected");
+                return switchStmt;
             }
             else
                 syntax_error("switch_stmt. LBRACE expected");
@@ -586,34 +892,38 @@ struct switch_stmtNode* switch_stmt()
 
 struct while_stmtNode* do_stmt()
 {
-    // TODO: implement this
     struct while_stmtNode* doStmt;
 
     ttype = getToken();
     if (ttype == DO)
     {
         doStmt = ALLOC(struct while_stmtNode);
-	doStmt->body = body();
-	ttype = getToken();
-        if (ttype == WHILE)
-        {
-            doStmt->condition = condition();
-            ttype = getToken();
-            if (ttype == SEMICOLON)
-            {
-                return doStmt;
-            }
-            else
-                syntax_error("do_stmt. SEMICOLON expected");
-        }
+        ttype = getToken();
+        if (ttype == LBRACE)
+            return doStmt; // body is parsed by body()
         else
-            syntax_error("do_stmt. WHILE expected");
+            syntax_error("body. LBRACE expected");
     }
     else
         syntax_error("do_stmt. DO expected");
     return NULL;
 }
 
+// Parses the part of a do_stmt that follows its body
+void do_condition(struct while_stmtNode* doStmt)
+{
+    ttype = getToken();
+    if (ttype == WHILE)
+    {
+        doStmt->condition = condition();
+        ttype = getToken();
+        if (ttype != SEMICOLON)
+            syntax_error("do_stmt. SEMICOLON expected");
+    }
+    else
+        syntax_error("do_stmt. WHILE expected");
+}
+
 struct primaryNode* primary()
 {
     // TODO: implement this
@@ -627,7 +937,7 @@ struct primaryNode* primary()
 	{
 		case ID:
 			prim->tag = ID;
-			prim->id = strdup(token); 
+			prim->id = intern_id(token); 
 			break;
 
 		case NUM:
@@ -677,9 +987,9 @@ struct conditionNode* condition()
     return NULL;
 }
 
+
 struct while_stmtNode* while_stmt()
 {
-    // TODO: implement this
     struct while_stmtNode* whil;
 
     ttype = getToken();
@@ -687,137 +997,264 @@ struct while_stmtNode* while_stmt()
     {
         whil = ALLOC(struct while_stmtNode);
         whil->condition = condition();
-        whil->body = body();
-	return whil;
+        ttype = getToken();
+        if (ttype == LBRACE)
+            return whil; // body is parsed by body()
+        else
+            syntax_error("body. LBRACE expected");
     }
     else
-            syntax_error("while_stmt. WHILE expected");	
+        syntax_error("while_stmt. WHILE expected");
     return NULL;
 }
 
-struct exprNode* factor()
+// Expressions form a DAG: make_primary() and make_expr() return the
+// existing node when an equal one was already built, so a subexpression
+// that is repeated anywhere in the program is stored and checked once.
+// Primaries are keyed by their literal value or interned id, operators
+// by op and the addresses of their two operands.
+
+struct exprNode** expr_hash;
+int expr_hash_size;
+int expr_count;
+
+unsigned int hash_expr(int op, int tag, const void* first, const void* second)
 {
-    struct exprNode* facto;
+    unsigned long long h = (unsigned long long) op * 31 + tag;
 
-    ttype = getToken();
-    if (ttype == LPAREN)
-    {
-        facto = expr();
-        ttype = getToken();
-        if (ttype == RPAREN)
-            return facto;
-        else
-            syntax_error("factor. RPAREN expected");
-    }
-    else if (ttype == NUM)
-    {
-        facto = ALLOC(struct exprNode);
-        facto->primary = ALLOC(struct primaryNode);
-        facto->tag = PRIMARY;
-        facto->op = NOOP;
-        facto->leftOperand = NULL;
-        facto->rightOperand = NULL;
-        facto->primary->tag = NUM;
-        facto->primary->ival = atoi(token);
-        return facto;
-    }
-    else if (ttype == REALNUM)
-    {
-        facto = ALLOC(struct exprNode);
-        facto->primary = ALLOC(struct primaryNode);
-        facto->tag = PRIMARY;
-        facto->op = NOOP;
-        facto->leftOperand = NULL;
-        facto->rightOperand = NULL;
-        facto->primary->tag = REALNUM;
-        facto->primary->fval = atof(token);
-        return facto;
-    }
-    else if (ttype == ID)
-    {
-        facto = ALLOC(struct exprNode);
-        facto->primary = ALLOC(struct primaryNode);
-        facto->tag = PRIMARY;
-        facto->op = NOOP;
-        facto->leftOperand = NULL;
-        facto->rightOperand = NULL;
-        facto->primary->tag = ID;
-        facto->primary->id = strdup(token);
-        return facto;
-    }
+    h = h * 0x9e3779b97f4a7c15ull + (unsigned long long) (size_t) first;
+    h = h * 0x9e3779b97f4a7c15ull + (unsigned long long) (size_t) second;
+    return (unsigned int) (h ^ (h >> 29));
+}
+
+unsigned int hash_expr_node(struct exprNode* exp)
+{
+    unsigned int bits = 0;
+
+    if (exp->tag == EXPR)
+        return hash_expr(exp->op, EXPR, exp->leftOperand, exp->rightOperand);
+    if (exp->primary->tag == ID)
+        return hash_expr(NOOP, ID, exp->primary->id, NULL);
+    if (exp->primary->tag == NUM)
+        bits = (unsigned int) exp->primary->ival;
     else
-        syntax_error("factor. NUM, REALNUM, or ID, expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
+        memcpy(&bits, &exp->primary->fval, sizeof(float));
+    return hash_expr(NOOP, exp->primary->tag, (void*) (size_t) bits, NULL);
+}
+
+int same_expr(struct exprNode* a, struct exprNode* b)
+{
+    if (a->tag != b->tag || a->op != b->op)
+        return FALSE;
+    if (a->tag == EXPR)
+        return a->leftOperand == b->leftOperand && a->rightOperand == b->rightOperand;
+    if (a->primary->tag != b->primary->tag)
+        return FALSE;
+    if (a->primary->tag == ID)
+        return a->primary->id == b->primary->id;
+    if (a->primary->tag == NUM)
+        return a->primary->ival == b->primary->ival;
+    return memcmp(&a->primary->fval, &b->primary->fval, sizeof(float)) == 0;
 }
 
-struct exprNode* term()
+// Returns the node equal to key, making an arena copy of key if there
+// is none yet
+struct exprNode* intern_expr(struct exprNode* key)
 {
-    struct exprNode* ter;
-    struct exprNode* f;
+    struct exprNode* exp;
+    unsigned int h;
+    int i;
 
-    ttype = getToken();
-    if (ttype == ID || ttype == LPAREN || ttype == NUM || ttype == REALNUM)
+    if (2 * (expr_count + 1) > expr_hash_size)
     {
-        ungetToken();
-        f = factor();
-        ttype = getToken();
-        if (ttype == MULT || ttype == DIV)
-        {
-            ter = ALLOC(struct exprNode);
-            ter->op = ttype;
-            ter->leftOperand = f;
-            ter->rightOperand = term();
-            ter->tag = EXPR;
-            ter->primary = NULL;
-            return ter;
-        }
-        else if (ttype == SEMICOLON || ttype == PLUS ||
-                 ttype == MINUS || ttype == RPAREN)
+        struct exprNode** old = expr_hash;
+        int old_size = expr_hash_size;
+
+        expr_hash_size = (old_size == 0) ? 1024 : 2 * old_size;
+        expr_hash = (struct exprNode**) calloc(expr_hash_size, sizeof(struct exprNode*));
+        for (i = 0; i < old_size; i++)
         {
-            ungetToken();
-            return f;
+            if (old[i] == NULL)
+                continue;
+            h = hash_expr_node(old[i]) & (expr_hash_size - 1);
+            while (expr_hash[h] != NULL)
+                h = (h + 1) & (expr_hash_size - 1);
+            expr_hash[h] = old[i];
         }
-        else
-            syntax_error("term. MULT or DIV expected");
+        free(old);
+    }
+    h = hash_expr_node(key) & (expr_hash_size - 1);
+    while (expr_hash[h] != NULL)
+    {
+        if (same_expr(expr_hash[h], key))
+            return expr_hash[h];
+        h = (h + 1) & (expr_hash_size - 1);
+    }
+
+    exp = ALLOC(struct exprNode);
+    *exp = *key;
+    exp->type = -1;
+    if (key->tag == PRIMARY)
+    {
+        exp->primary = ALLOC(struct primaryNode);
+        *exp->primary = *key->primary;
     }
+    ++expr_count;
+    expr_hash[h] = exp;
+    return exp;
+}
+
+struct exprNode* make_primary(int tag, const char* lexeme)
+{
+    struct exprNode key;
+    struct primaryNode prim;
+
+    memset(&prim, 0, sizeof(prim));
+    prim.tag = tag;
+    if (tag == NUM)
+        prim.ival = atoi(lexeme);
+    else if (tag == REALNUM)
+        prim.fval = atof(lexeme);
     else
-        syntax_error("term. ID, LPAREN, NUM, or REALNUM expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
+        prim.id = intern_id(lexeme);
+    memset(&key, 0, sizeof(key));
+    key.tag = PRIMARY;
+    key.op = NOOP;
+    key.primary = &prim;
+    return intern_expr(&key);
+}
+
+struct exprNode* make_expr(int op, struct exprNode* left, struct exprNode* right)
+{
+    struct exprNode key;
+
+    memset(&key, 0, sizeof(key));
+    key.tag = EXPR;
+    key.op = op;
+    key.leftOperand = left;
+    key.rightOperand = right;
+    return intern_expr(&key);
+}
+
+// Operators of the expression being parsed that are still waiting
+// for their right operand, and LPARENs that are not closed yet
+int* operator_stack;
+int operator_top;
+int operator_capacity;
+
+// Operands of the expression being parsed. They are kept apart from the
+// scratch stack so that an expression abandoned by a syntax error does
+// not leave anything on top of the statements of the enclosing body.
+struct exprNode** operand_stack;
+int operand_top;
+int operand_capacity;
+
+void push_operand(struct exprNode* operand)
+{
+    if (operand_top == operand_capacity)
+    {
+        operand_capacity = (operand_capacity == 0) ? 256 : 2 * operand_capacity;
+        operand_stack = (struct exprNode**) realloc(operand_stack, operand_capacity * sizeof(struct exprNode*));
+    }
+    operand_stack[operand_top++] = operand;
+}
+
+void push_operator(int op)
+{
+    if (operator_top == operator_capacity)
+    {
+        operator_capacity = (operator_capacity == 0) ? 256 : 2 * operator_capacity;
+        operator_stack = (int*) realloc(operator_stack, operator_capacity * sizeof(int));
+    }
+    operator_stack[operator_top++] = op;
+}
+
+int precedence(int op)
+{
+    if (op == MULT || op == DIV)
+        return 2;
+    else if (op == PLUS || op == MINUS)
+        return 1;
+    else
+        return 0; // LPAREN
+}
+
+// Pops the top operator and its two operands and pushes the resulting
+// expression
+void reduce_operator()
+{
+    struct exprNode* right = operand_stack[--operand_top];
+    struct exprNode* left = operand_stack[--operand_top];
+
+    push_operand(make_expr(operator_stack[--operator_top], left, right));
 }
 
+// expr and term are parsed with operator precedence instead of recursive
+// descent so that long or deeply parenthesized expressions do not use
+// the C stack. Operators are popped only by operators of strictly lower
+// precedence, so PLUS, MINUS, MULT and DIV stay right associative and
+// the tree has the same shape as the one built from the grammar.
 struct exprNode* expr()
 {
-    struct exprNode* exp;
-    struct exprNode* t;
+    struct exprNode* facto;
+    int base = operand_top;
+    int operator_base = operator_top;
+    int open_parens = 0;
+    int op = 0; // operator before the current operand
 
     ttype = getToken();
-    if (ttype == ID || ttype == LPAREN || ttype == NUM || ttype == REALNUM)
+    if (ttype != ID && ttype != LPAREN && ttype != NUM && ttype != REALNUM)
+        syntax_error("expr. ID, LPAREN, NUM, or REALNUM expected");
+    while (TRUE)
     {
-        ungetToken();
-        t = term();
+        // factor
+        while (ttype == LPAREN)
+        {
+            push_operator(LPAREN);
+            ++open_parens;
+            op = LPAREN;
+            ttype = getToken();
+        }
+        if (ttype == NUM || ttype == REALNUM || ttype == ID)
+            push_operand(make_primary(ttype, token));
+        else if (op == MULT || op == DIV)
+            syntax_error("term. ID, LPAREN, NUM, or REALNUM expected");
+        else
+            syntax_error("expr. ID, LPAREN, NUM, or REALNUM expected");
+
+        // operator, RPAREN or the end of the expression
         ttype = getToken();
-        if (ttype == PLUS || ttype == MINUS)
+        while (ttype == RPAREN && open_parens > 0)
+        {
+            while (operator_stack[operator_top - 1] != LPAREN)
+                reduce_operator();
+            --operator_top;
+            --open_parens;
+            ttype = getToken();
+        }
+        if (ttype == PLUS || ttype == MINUS || ttype == MULT || ttype == DIV)
         {
-            exp = ALLOC(struct exprNode);
-            exp->op = ttype;
-            exp->leftOperand = t;
-            exp->rightOperand = expr();
-            exp->tag = EXPR;
-            exp->primary = NULL;
-            return exp;
+            while (operator_top > operator_base &&
+                   precedence(operator_stack[operator_top - 1]) > precedence(ttype))
+                reduce_operator();
+            push_operator(ttype);
+            op = ttype;
+            ttype = getToken();
         }
-        else if (ttype == SEMICOLON || ttype == MULT ||
-                 ttype == DIV || ttype == RPAREN)
+        else if (ttype == SEMICOLON || ttype == RPAREN)
         {
+            if (open_parens > 0)
+                syntax_error("factor. RPAREN expected");
             ungetToken();
-            return t;
+            while (operator_top > operator_base)
+                reduce_operator();
+            facto = operand_stack[base];
+            operand_top = base;
+            return facto;
         }
         else
-            syntax_error("expr. PLUS, MINUS, or SEMICOLON expected");
+            syntax_error("term. MULT or DIV expected");
     }
-    else
-        syntax_error("expr. ID, LPAREN, NUM, or REALNUM expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
 struct assign_stmtNode* assign_stmt()
@@ -828,7 +1265,7 @@ struct assign_stmtNode* assign_stmt()
     if (ttype == ID)
     {
         assignStmt = ALLOC(struct assign_stmtNode);
-        assignStmt->id = strdup(token);
+        assignStmt->id = intern_id(token);
         ttype = getToken();
         if (ttype == EQUAL)
         {
@@ -847,6 +1284,9 @@ struct assign_stmtNode* assign_stmt()
     return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
+
+// Parses an assign_stmt, or the part of any other statement that comes
+// before its body
 struct stmtNode* stmt()
 {
     struct stmtNode* stm;
@@ -882,56 +1322,201 @@ struct stmtNode* stmt()
     return stm;
 }
 
-struct stmt_listNode* stmt_list()
+// A body whose stmt_list is being parsed
+struct parse_frame
 {
-    struct stmt_listNode* stmtList;
+    struct stmtNode* stmt;              // statement that owns the body or NULL
+    struct case_listNode* current_case; // for SWITCH, the case that owns the body
+    int base;                           // scratch_top when the body was opened
+    int depth;                          // brace_depth inside the body
+    int had_error;                      // a statement of the body had a syntax error
+    int first;                          // index of the LBRACE in incremental mode
+};
 
-    ttype = getToken();
-    if (ttype == ID || ttype == WHILE ||
-        ttype == DO || ttype == SWITCH)
+struct parse_frame* parse_stack;
+int parse_top;
+int parse_capacity;
+
+void push_parse_frame(struct stmtNode* stmt, struct case_listNode* current_case)
+{
+    if (parse_top == parse_capacity)
     {
-        ungetToken();
-        stmtList = ALLOC(struct stmt_listNode);
-        stmtList->stmt = stmt();
-        ttype = getToken();
-        if (ttype == ID || ttype == WHILE ||
-            ttype == DO || ttype == SWITCH)
+        parse_capacity = (parse_capacity == 0) ? 64 : 2 * parse_capacity;
+        parse_stack = (struct parse_frame*) realloc(parse_stack, parse_capacity * sizeof(struct parse_frame));
+    }
+    parse_stack[parse_top].stmt = stmt;
+    parse_stack[parse_top].current_case = current_case;
+    parse_stack[parse_top].base = scratch_top;
+    parse_stack[parse_top].depth = brace_depth;
+    parse_stack[parse_top].had_error = FALSE;
+    parse_stack[parse_top].first = last_token;
+    ++parse_top;
+}
+
+// Panic mode recovery for a statement of the innermost open body. The
+// statement is dropped and tokens are skipped, starting with the one
+// that caused the error, until one that can follow a stmt:
+//   SEMICOLON                  ends the broken statement, it is consumed
+//   RBRACE back at the depth   ends the body of the broken statement
+//   WHILE, DO, SWITCH          start the next statement (FIRST(stmt))
+//   RBRACE of the open body    FOLLOW(stmt_list), the body is closed
+// Anything between braces opened by the broken statement is skipped as
+// a whole. ID is in FIRST(stmt) too but is not used to synchronize,
+// it is far more likely to be part of the broken statement.
+void skip_statement()
+{
+    struct parse_frame* frame = &parse_stack[parse_top - 1];
+
+    frame->had_error = TRUE;
+    operator_top = 0;
+    operand_top = 0;
+    activeToken = FALSE;
+    while (TRUE)
+    {
+        if (ttype == EOF || brace_depth < frame->depth)
         {
             ungetToken();
-            stmtList->stmt_list = stmt_list();
-            return stmtList;
+            return;
         }
-        else // If the next token is not in FOLLOW(stmt_list),
-             // let the caller handle it.
+        if (brace_depth == frame->depth)
         {
-            ungetToken();
-            stmtList->stmt_list = NULL;
-            return stmtList;
+            if (ttype == SEMICOLON || ttype == RBRACE)
+                return;
+            if (ttype == WHILE || ttype == DO || ttype == SWITCH)
+            {
+                ungetToken();
+                return;
+            }
         }
+        ttype = getToken();
     }
-    else
-        syntax_error("stmt_list. ID, WHILE, DO or SWITCH expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
 struct bodyNode* body()
+{
+    ttype = getToken();
+    if (ttype != LBRACE)
+        syntax_error("body. LBRACE expected");
+    return parse_body(NULL);
+}
+
+// Parses the stmt_list of a body whose LBRACE was just read and the
+// RBRACE that ends it. With a range, parses statements of an open body
+// starting at the current token until range_stop() accepts the position
+// of the next statement, see reparse_range().
+struct bodyNode* parse_body(struct stmt_range* range)
 {
     struct bodyNode* bod;
+    struct stmtNode* stm;
+    struct parse_frame frame;
+    int outer_top = parse_top;
+    jmp_buf here;
+    jmp_buf* outer = recovery_point;
 
-    ttype = getToken();
-    if (ttype == LBRACE)
+    push_parse_frame(NULL, NULL);
+    if (recovery_point != NULL)
     {
-        bod = ALLOC(struct bodyNode);
-        bod->stmt_list = stmt_list();
-        ttype = getToken();
-        if (ttype == RBRACE)
+        recovery_point = &here;
+        if (setjmp(here) != 0)
+            skip_statement();
+    }
+
+    while (TRUE)
+    {
+        if (range != NULL && parse_top == outer_top + 1 && range_stop(range))
+        {
+            frame = parse_stack[--parse_top];
+            bod = ALLOC(struct bodyNode);
+            bod->stmt_list = ALLOC(struct stmt_listNode);
+            bod->stmt_list->count = scratch_top - frame.base;
+            bod->stmt_list->stmts = (struct stmtNode**) scratch_pop(frame.base);
+            recovery_point = outer;
             return bod;
-        else
+        }
+
+        // stmt_list of the innermost open body
+        ttype = getToken();
+        if (ttype == ID || ttype == WHILE ||
+            ttype == DO || ttype == SWITCH)
+        {
+            int first = last_token;
+
+            ungetToken();
+            stm = stmt();
+            if (token_cursor >= 0)
+                stm->span = new_span(first, last_token, stm);
+            if (stm->stmtType == ASSIGN)
+                scratch_push(stm);
+            else if (stm->stmtType == SWITCH)
+                push_parse_frame(stm, stm->switch_stmt->case_list);
+            else
+                push_parse_frame(stm, NULL);
+            continue;
+        }
+
+        // If the next token is not in FIRST(stmt_list), the list has
+        // ended and the body has to be closed
+        frame = parse_stack[parse_top - 1];
+        if (range != NULL && parse_top == outer_top + 1)
+        {
+            // The statements run past the body being reparsed
+            range->failed = TRUE;
+            parse_top = outer_top;
+            scratch_top = frame.base;
+            recovery_point = outer;
+            return NULL;
+        }
+        if (scratch_top == frame.base && !frame.had_error)
+            syntax_error("stmt_list. ID, WHILE, DO or SWITCH expected");
+        if (ttype != RBRACE && !(ttype == EOF && eof_reported))
             syntax_error("body. RBRACE expected");
+        --parse_top;
+        bod = ALLOC(struct bodyNode);
+        bod->stmt_list = ALLOC(struct stmt_listNode);
+        bod->stmt_list->count = scratch_top - frame.base;
+        bod->stmt_list->stmts = (struct stmtNode**) scratch_pop(frame.base);
+        if (token_cursor >= 0)
+            bod->span = new_span(frame.first, last_token, NULL);
+
+        stm = frame.stmt;
+        if (stm == NULL)
+        {
+            parse_top = outer_top;
+            recovery_point = outer;
+            return bod;
+        }
+        if (stm->stmtType == WHILE)
+            stm->while_stmt->body = bod;
+        else if (stm->stmtType == DO)
+        {
+            // A DO whose condition has a syntax error is dropped
+            stm->while_stmt->body = bod;
+            do_condition(stm->while_stmt);
+        }
+        else if (stm->stmtType == SWITCH)
+        {
+            frame.current_case->cas->body = bod;
+            ttype = getToken();
+            if (ttype == CASE)
+            {
+                ungetToken();
+                frame.current_case->case_list = case_list();
+                push_parse_frame(stm, frame.current_case->case_list);
+                continue;
+            }
+            else if (ttype != RBRACE)
+            {
+                // Keep the cases parsed so far
+                if (token_cursor >= 0)
+                    span_last[stm->span] = last_token - 1;
+                scratch_push(stm);
+                syntax_error("switch_stmt. RBRACE expected");
+            }
+        }
+        if (token_cursor >= 0)
+            span_last[stm->span] = last_token;
+        scratch_push(stm);
     }
-    else
-        syntax_error("body. LBRACE expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
 struct type_nameNode* type_name()
@@ -945,7 +1530,7 @@ struct type_nameNode* type_name()
     {
         tName->type = ttype;
         if (ttype == ID)
-            tName->id = strdup(token);
+            tName->id = intern_id(token);
         else
             tName->id = NULL;
         return tName;
@@ -958,29 +1543,26 @@ struct type_nameNode* type_name()
 struct id_listNode* id_list()
 {
     struct id_listNode* idList;
+    int base = scratch_top;
 
-    idList = ALLOC(struct id_listNode);
     ttype = getToken();
-    if (ttype == ID)
+    while (ttype == ID)
     {
-        idList->id = strdup(token);
+        scratch_push(intern_id(token));
         ttype = getToken();
-        if (ttype == COMMA)
-        {
-            idList->id_list = id_list();
-            return idList;
-        }
-        else if (ttype == COLON)
+        if (ttype == COLON)
         {
             ungetToken();
-            idList->id_list = NULL;
+            idList = ALLOC(struct id_listNode);
+            idList->count = scratch_top - base;
+            idList->ids = (char**) scratch_pop(base);
             return idList;
         }
-        else
+        else if (ttype != COMMA)
             syntax_error("id_list. COMMA or COLON expected");
+        ttype = getToken();
     }
-    else
-        syntax_error("id_list. ID expected");
+    syntax_error("id_list. ID expected");
     return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
@@ -1040,62 +1622,97 @@ struct var_declNode* var_decl()
     return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
+// Panic mode recovery for a type_decl or var_decl: tokens are skipped
+// until SEMICOLON, which ends the broken declaration, or until VAR or
+// LBRACE, which follow the declaration lists
+void skip_declaration()
+{
+    activeToken = FALSE;
+    while (ttype != SEMICOLON && ttype != VAR &&
+           ttype != LBRACE && ttype != EOF)
+        ttype = getToken();
+    if (ttype != SEMICOLON)
+        ungetToken();
+}
+
 struct var_decl_listNode* var_decl_list()
 {
-    struct var_decl_listNode* varDeclList;
+    struct var_decl_listNode* volatile varDeclList = NULL;
+    struct var_decl_listNode* volatile last = NULL;
+    struct var_decl_listNode* node;
+    volatile int recovered = FALSE;
+    int base = scratch_top;
+    jmp_buf here;
+    jmp_buf* outer = recovery_point;
 
-    varDeclList = ALLOC(struct var_decl_listNode);
-    ttype = getToken();
-    if (ttype == ID)
+    if (recovery_point != NULL)
     {
-        ungetToken();
-        varDeclList->var_decl = var_decl();
-        ttype = getToken();
-        if (ttype == ID)
-        {
-            ungetToken();
-            varDeclList->var_decl_list = var_decl_list();
-            return varDeclList;
-        }
-        else
+        recovery_point = &here;
+        if (setjmp(here) != 0)
         {
-            ungetToken();
-            varDeclList->var_decl_list = NULL;
-            return varDeclList;
+            recovered = TRUE;
+            scratch_top = base;
+            skip_declaration();
         }
     }
-    else
+    ttype = getToken();
+    if (ttype != ID && !recovered)
         syntax_error("var_decl_list. ID expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
+    while (ttype == ID)
+    {
+        ungetToken();
+        node = ALLOC(struct var_decl_listNode);
+        node->var_decl = var_decl();
+        if (last == NULL)
+            varDeclList = node;
+        else
+            last->var_decl_list = node;
+        last = node;
+        ttype = getToken();
+    }
+    ungetToken();
+    recovery_point = outer;
+    return varDeclList;
 }
 
 struct type_decl_listNode* type_decl_list()
 {
-    struct type_decl_listNode* typeDeclList;
+    struct type_decl_listNode* volatile typeDeclList = NULL;
+    struct type_decl_listNode* volatile last = NULL;
+    struct type_decl_listNode* node;
+    volatile int recovered = FALSE;
+    int base = scratch_top;
+    jmp_buf here;
+    jmp_buf* outer = recovery_point;
 
-    typeDeclList = ALLOC(struct type_decl_listNode);
-    ttype = getToken();
-    if (ttype == ID)
+    if (recovery_point != NULL)
     {
-        ungetToken();
-        typeDeclList->type_decl = type_decl();
-        ttype = getToken();
-        if (ttype == ID)
-        {
-            ungetToken();
-            typeDeclList->type_decl_list = type_decl_list();
-            return typeDeclList;
-        }
-        else
+        recovery_point = &here;
+        if (setjmp(here) != 0)
         {
-            ungetToken();
-            typeDeclList->type_decl_list = NULL;
-            return typeDeclList;
+            recovered = TRUE;
+            scratch_top = base;
+            skip_declaration();
         }
     }
-    else
+    ttype = getToken();
+    if (ttype != ID && !recovered)
         syntax_error("type_decl_list. ID expected");
-    return NULL; // control never reaches here, this is just for the sake of GCC
+    while (ttype == ID)
+    {
+        ungetToken();
+        node = ALLOC(struct type_decl_listNode);
+        node->type_decl = type_decl();
+        if (last == NULL)
+            typeDeclList = node;
+        else
+            last->type_decl_list = node;
+        last = node;
+        ttype = getToken();
+    }
+    ungetToken();
+    recovery_point = outer;
+    return typeDeclList;
 }
 
 struct var_decl_sectionNode* var_decl_section()
@@ -1189,14 +1806,40 @@ struct declNode* decl()
 struct programNode* program()
 {
     struct programNode* prog;
+    jmp_buf here;
 
     prog = ALLOC(struct programNode);
+    if (recover_errors)
+    {
+        // An error outside of the declaration lists skips the rest of
+        // the declarations, the body is still parsed
+        recovery_point = &here;
+        if (setjmp(here) != 0)
+        {
+            activeToken = FALSE;
+            while (ttype != LBRACE && ttype != EOF)
+                ttype = getToken();
+            ungetToken();
+            if (prog->decl == NULL)
+                prog->decl = ALLOC(struct declNode);
+            if (ttype == EOF)
+            {
+                prog->body = ALLOC(struct bodyNode);
+                prog->body->stmt_list = ALLOC(struct stmt_listNode);
+            }
+            else
+                prog->body = body();
+            recovery_point = NULL;
+            return prog;
+        }
+    }
     ttype = getToken();
     if (ttype == TYPE || ttype == VAR || ttype == LBRACE)
     {
         ungetToken();
         prog->decl = decl();
         prog->body = body();
+        recovery_point = NULL;
         return prog;
     }
     else
@@ -1204,533 +1847,3675 @@ struct programNode* program()
     return NULL; // control never reaches here, this is just for the sake of GCC
 }
 
-static char* type_string(struct type_nameNode* type_struct)
+/* ------------------------------------------------------------------- */
+/* -------------------- BINARY PARSE TREE SECTION -------------------- */
+/* ------------------------------------------------------------------- */
+
+// write_ast() stores a parse tree in the format described in syntax.h.
+// load_ast() maps such a file and only checks its header, the records
+// are used where they are. link_ast() turns them into the parse tree
+// nodes the type checker walks, in one pass and without copying strings.
+
+struct ast_array
 {
-    switch (type_struct->type)
+    char* data;
+    int size; // bytes per record
+    int count;
+    int capacity;
+};
+
+int record_sizes[AST_SECTIONS] =
+{
+    sizeof(struct ast_expr), sizeof(struct ast_stmt),
+    sizeof(struct ast_condition), sizeof(struct ast_body),
+    sizeof(struct ast_case), sizeof(struct ast_decl),
+    sizeof(int), sizeof(char)
+};
+
+// Returns the index of the first of n new records
+int ast_reserve(struct ast_array* array, int n)
+{
+    int first = array->count;
+
+    if (array->count + n > array->capacity)
     {
-        case INT:
-            return "INT";
-        case REAL:
-            return "REAL";
-        case STRING:
-            return "STRING";
-        case BOOLEAN:
-            return "BOOLEAN";
-        case ID:
-            return type_struct->id;
-        case LONG:
-            return "LONG";
+        while (array->count + n > array->capacity)
+            array->capacity = (array->capacity == 0) ? 1024 : 2 * array->capacity;
+        array->data = (char*) realloc(array->data, (size_t) array->capacity * array->size);
     }
+    array->count += n;
+    return first;
 }
 
-int unify(int first, int second)
+#define AST_RECORD(w, section, type, i) (((type*) (w)->sections[section].data)[i])
+
+struct ast_writer
 {
-    if((first < 15) && (second < 15)) // both built-in
+    struct ast_array sections[AST_SECTIONS];
+
+    // Bodies and expressions get their index when they are first
+    // referenced and are written later, in index order
+    struct bodyNode** bodies;
+    struct exprNode** exprs;
+
+    // Index of every expression written so far, by address
+    struct exprNode** expr_keys;
+    int* expr_indices;
+    int expr_hash_size;
+
+    // Offset + 1 of every string in the pool, by contents
+    int* string_slots;
+    int string_hash_size;
+    int string_count;
+};
+
+int ast_string(struct ast_writer* w, const char* s)
+{
+    struct ast_array* pool = &w->sections[AST_STRINGS];
+    unsigned int h;
+    int offset;
+    int i;
+
+    if (2 * (w->string_count + 1) > w->string_hash_size)
     {
-        if (first == second)
+        int* old = w->string_slots;
+        int old_size = w->string_hash_size;
+
+        w->string_hash_size = (old_size == 0) ? 1024 : 2 * old_size;
+        w->string_slots = (int*) calloc(w->string_hash_size, sizeof(int));
+        for (i = 0; i < old_size; i++)
         {
-            return first;
+            if (old[i] == 0)
+                continue;
+            h = hash_string(pool->data + old[i] - 1) & (w->string_hash_size - 1);
+            while (w->string_slots[h] != 0)
+                h = (h + 1) & (w->string_hash_size - 1);
+            w->string_slots[h] = old[i];
         }
-        else
-            return -1;
-    }
-    else if((first > 14) && (second > 14)) // both user-defined
-    {
-        return first;
+        free(old);
     }
-    else
+    h = hash_string(s) & (w->string_hash_size - 1);
+    while (w->string_slots[h] != 0)
     {
-        if(first < 15)
-        {
-            return first;
-        }
-        else if(second < 15)
-        {
-            return second;
-        }
+        if (strcmp(pool->data + w->string_slots[h] - 1, s) == 0)
+            return w->string_slots[h] - 1;
+        h = (h + 1) & (w->string_hash_size - 1);
     }
+    offset = ast_reserve(pool, strlen(s) + 1);
+    memcpy(pool->data + offset, s, strlen(s) + 1);
+    w->string_slots[h] = offset + 1;
+    ++w->string_count;
+    return offset;
 }
 
-int process_prim(struct primaryNode* prim)
+int ast_expr_index(struct ast_writer* w, struct exprNode* expr)
 {
-    if (prim->tag == ID)
-        {
-            // Find what type it is
-            char* current_id = prim->id;
-                // find type in symbol table
-                int i = 0;
-                while (i < (5 + new_types))
-                {
-                    //printf("2 ids: %s %s\n", type_string(current_type_name), table[i]->id);                
-                    if (strcmp(current_id, table[i]->id) == 0)
-                    {
-                        if (table[i]->flag == 0)
-                        {
-                            printf("ERROR CODE 1\n");
-                            return -1;
-                        }
-                        else
-                        {
-                            return table[i]->type_number;
-                            
-                        }
-                    }
-                    ++i;
-                }
-                // If control reaches here, type was not found
-                    ++new_types;                
-                    table[4+new_types] = ALLOC(struct symbol);
-                    table[4+new_types]->id = (char*)malloc(strlen(current_id) * sizeof(char));
-                    strcpy(table[4+new_types]->id, current_id);
-                    table[4+new_types]->type_number = (14+new_types);
-                    table[4+new_types]->where = 2;
-                    table[4+new_types]->flag = 1;
-                    return (14+new_types); 
-                
-        }
-        else if (prim->tag == NUM)
-            return 10; // INT
-        else if (prim->tag == REALNUM)
-            return 11; // REAL
-}
+    unsigned int h;
+    int index;
+    int i;
 
-int process_expr(struct exprNode* expr)
-{
-    if (expr->tag == EXPR)
+    if (2 * (w->sections[AST_EXPRS].count + 1) > w->expr_hash_size)
     {
-        int lhs_number, rhs_number, result;
-        lhs_number = process_expr(expr->leftOperand);
-        rhs_number = process_expr(expr->rightOperand);
-        if ((lhs_number < 0) || (rhs_number < 0))
-        {
-            return -1;
-        }
-        result = unify(lhs_number, rhs_number);
-        if (result < 0)
+        struct exprNode** old_keys = w->expr_keys;
+        int* old_indices = w->expr_indices;
+        int old_size = w->expr_hash_size;
+
+        w->expr_hash_size = (old_size == 0) ? 1024 : 2 * old_size;
+        w->expr_keys = (struct exprNode**) calloc(w->expr_hash_size, sizeof(struct exprNode*));
+        w->expr_indices = (int*) malloc(w->expr_hash_size * sizeof(int));
+        for (i = 0; i < old_size; i++)
         {
-             printf("ERROR CODE 3\n");
+            if (old_keys[i] == NULL)
+                continue;
+            h = hash_expr(0, 0, old_keys[i], NULL) & (w->expr_hash_size - 1);
+            while (w->expr_keys[h] != NULL)
+                h = (h + 1) & (w->expr_hash_size - 1);
+            w->expr_keys[h] = old_keys[i];
+            w->expr_indices[h] = old_indices[i];
         }
-        return result;
+        free(old_keys);
+        free(old_indices);
     }
-    else if (expr->tag == PRIMARY)
+    h = hash_expr(0, 0, expr, NULL) & (w->expr_hash_size - 1);
+    while (w->expr_keys[h] != NULL)
     {
-        return process_prim(expr->primary);
+        if (w->expr_keys[h] == expr)
+            return w->expr_indices[h];
+        h = (h + 1) & (w->expr_hash_size - 1);
     }
+    index = ast_reserve(&w->sections[AST_EXPRS], 1);
+    w->exprs = (struct exprNode**) realloc(w->exprs, w->sections[AST_EXPRS].capacity * sizeof(struct exprNode*));
+    w->exprs[index] = expr;
+    w->expr_keys[h] = expr;
+    w->expr_indices[h] = index;
+    return index;
 }
 
-int process_assign(struct assign_stmtNode* assign_stmt)
+int ast_body_index(struct ast_writer* w, struct bodyNode* body)
 {
-    char* current_id = assign_stmt->id;
-                // find type in symbol table
-                int index = 0;
-                int i = 0;
-                int isFound = 0;
-                int lhs_number, rhs_number, result;
-                while ((i < (5 + new_types)) && (isFound == 0))
-                {
-                    //printf("2 ids: %s %s\n", type_string(current_type_name), table[i]->id);                
-                    if (strcmp(current_id, table[i]->id) == 0)
-                    {
-                        if (table[i]->flag == 0)
-                        {
-                            printf("ERROR CODE 1\n");
-                            return -1;
-                        }
-                        else
-                        {
-                            lhs_number = table[i]->type_number;
-                            isFound = 1;
-                            index = i;
-                        }
-                    }
-                    ++i;
-                }
-                if(isFound == 0)
-                {
-                    ++new_types;                
-                    table[4+new_types] = ALLOC(struct symbol);
-                    table[4+new_types]->id = (char*)malloc(strlen(current_id) * sizeof(char));
-                    strcpy(table[4+new_types]->id, current_id);
-                    table[4+new_types]->type_number = (14+new_types);
-                    table[4+new_types]->where = 2;
-                    table[4+new_types]->flag = 1;
-                    lhs_number = table[4+new_types]->type_number;
-                    index = 4+new_types;
-                }
-                
-                // Check the RHS
-                rhs_number = process_expr(assign_stmt->expr);
-     if (rhs_number > 0)
-    {
-                result = unify(lhs_number, rhs_number);
-                
-                if (result < 0)
-                {
-                    printf("ERROR CODE 3\n");
-                }
-                else
-                {
-                    table[index]->type_number = result;
-                }
-           return result; 
-    }
-     return rhs_number;
+    int index = ast_reserve(&w->sections[AST_BODIES], 1);
+
+    w->bodies = (struct bodyNode**) realloc(w->bodies, w->sections[AST_BODIES].capacity * sizeof(struct bodyNode*));
+    w->bodies[index] = body;
+    return index;
+}
+
+struct ast_primary ast_primary(struct ast_writer* w, struct primaryNode* prim)
+{
+    struct ast_primary record;
+
+    record.tag = 0;
+    record.value = 0;
+    if (prim == NULL)
+        return record;
+    record.tag = prim->tag;
+    if (prim->tag == NUM)
+        record.value = prim->ival;
+    else if (prim->tag == REALNUM)
+        memcpy(&record.value, &prim->fval, sizeof(float));
+    else
+        record.value = ast_string(w, prim->id);
+    return record;
 }
 
-int process_while(struct while_stmtNode* whil)
+void ast_decl(struct ast_writer* w, struct id_listNode* id_list, struct type_nameNode* type_name)
 {
-    int body_number;
-    body_number = process_body(whil->body);
-    if (body_number < 0)
+    int index = ast_reserve(&w->sections[AST_DECLS], 1);
+    int first = ast_reserve(&w->sections[AST_ITEMS], id_list->count);
+    int id = (type_name->type == ID) ? ast_string(w, type_name->id) : -1;
+    int i;
+
+    for (i = 0; i < id_list->count; i++)
     {
-        printf("ERROR CODE 3\n");
-        return -1;
+        int offset = ast_string(w, id_list->ids[i]);
+        AST_RECORD(w, AST_ITEMS, int, first + i) = offset;
     }
-    if (whil->condition->relop != NOOP)
+    AST_RECORD(w, AST_DECLS, struct ast_decl, index).first = first;
+    AST_RECORD(w, AST_DECLS, struct ast_decl, index).count = id_list->count;
+    AST_RECORD(w, AST_DECLS, struct ast_decl, index).type = type_name->type;
+    AST_RECORD(w, AST_DECLS, struct ast_decl, index).id = id;
+}
+
+// Writes the statements of body, the bodies they contain are queued
+void ast_body(struct ast_writer* w, int index)
+{
+    struct stmt_listNode* stmt_list = w->bodies[index]->stmt_list;
+    int first = ast_reserve(&w->sections[AST_STMTS], stmt_list->count);
+    int i;
+
+    AST_RECORD(w, AST_BODIES, struct ast_body, index).first = first;
+    AST_RECORD(w, AST_BODIES, struct ast_body, index).count = stmt_list->count;
+    for (i = 0; i < stmt_list->count; i++)
     {
-        int lhs_number, rhs_number, result;
-        lhs_number = process_prim(whil->condition->left_operand);
-        rhs_number = process_prim(whil->condition->right_operand);
-        result = unify(lhs_number, rhs_number);
-        if (result < 0)
+        struct stmtNode* stmt = stmt_list->stmts[i];
+        struct ast_stmt record;
+
+        memset(&record, 0, sizeof(record));
+        record.type = stmt->stmtType;
+        if (stmt->stmtType == ASSIGN)
+        {
+            record.a = ast_string(w, stmt->assign_stmt->id);
+            record.b = ast_expr_index(w, stmt->assign_stmt->expr);
+        }
+        else if (stmt->stmtType == WHILE || stmt->stmtType == DO)
         {
-               printf("ERROR CODE 3\n");
-               return -1;
+            struct conditionNode* condition = stmt->while_stmt->condition;
+
+            record.a = ast_reserve(&w->sections[AST_CONDITIONS], 1);
+            AST_RECORD(w, AST_CONDITIONS, struct ast_condition, record.a).relop = condition->relop;
+            AST_RECORD(w, AST_CONDITIONS, struct ast_condition, record.a).left = ast_primary(w, condition->left_operand);
+            AST_RECORD(w, AST_CONDITIONS, struct ast_condition, record.a).right = ast_primary(w, condition->right_operand);
+            record.b = ast_body_index(w, stmt->while_stmt->body);
         }
         else
         {
-            return 13; // boolean
+            struct case_listNode* case_list;
+            int j;
+
+            record.a = ast_string(w, stmt->switch_stmt->id);
+            for (case_list = stmt->switch_stmt->case_list; case_list != NULL; case_list = case_list->case_list)
+                ++record.c;
+            record.b = ast_reserve(&w->sections[AST_CASES], record.c);
+            case_list = stmt->switch_stmt->case_list;
+            for (j = 0; j < record.c; j++)
+            {
+                int body = ast_body_index(w, case_list->cas->body);
+
+                AST_RECORD(w, AST_CASES, struct ast_case, record.b + j).num = case_list->cas->num;
+                AST_RECORD(w, AST_CASES, struct ast_case, record.b + j).body = body;
+                case_list = case_list->case_list;
+            }
         }
-    }
-    else
-    {
-        return (process_prim(whil->condition->left_operand) == 13) ? 13 : -1;
+        AST_RECORD(w, AST_STMTS, struct ast_stmt, first + i) = record;
     }
 }
 
-int process_switch(struct switch_stmtNode* swi)
+void ast_expr(struct ast_writer* w, int index)
 {
-    char* current_id = swi->id;
-                //Ensure id is INT
-               int i = 0;
-               int isFound = 0;
-                
-                while ((i < (5 + new_types)) && (isFound == 0))
-                {
-                    //printf("2 ids: %s %s\n", type_string(current_type_name), table[i]->id);                
-                    if (strcmp(current_id, table[i]->id) == 0)
-                    {
-                        if (table[i]->type_number != 10)
-                        {
-                            printf("ERROR CODE 3\n");
-                            return -1;
-                        }
-                        else
-                        {
-                            isFound = 1;
-                        }
-                    }
-                    ++i;
-                }
-                if(isFound == 0)
-                {
-                    ++new_types;                
-                    table[4+new_types] = ALLOC(struct symbol);
-                    table[4+new_types]->id = (char*)malloc(strlen(current_id) * sizeof(char));
-                    strcpy(table[4+new_types]->id, current_id);
-                    table[4+new_types]->type_number = 10;
-                    table[4+new_types]->where = 2;
-                    table[4+new_types]->flag = 1;
-                }
+    struct exprNode* expr = w->exprs[index];
+    struct ast_expr record;
+    struct ast_primary prim;
 
-                //on to the case list
-       struct case_listNode* case_list = swi->case_list;
-    int case_type;
-    while(case_list != NULL)
+    record.op = expr->op;
+    record.tag = expr->tag;
+    if (expr->tag == EXPR)
     {
-        struct caseNode* current_case = case_list->cas;
-        case_type = process_body(current_case->body);
-        if (case_type < 0)
-        {
-            return case_type;
-        }   
-        case_list = case_list->case_list;
+        record.a = ast_expr_index(w, expr->leftOperand);
+        record.b = ast_expr_index(w, expr->rightOperand);
+    }
+    else
+    {
+        prim = ast_primary(w, expr->primary);
+        record.a = prim.tag;
+        record.b = prim.value;
     }
-    return case_type;
+    AST_RECORD(w, AST_EXPRS, struct ast_expr, index) = record;
 }
 
-int process_body(struct bodyNode* body)
+// Returns 0, or -1 if the file cannot be written
+int write_ast(const char* path, struct programNode* program)
 {
-    int i = 0;
-    int isFound = 0;
-    int overall_type = 0;
+    struct ast_writer w;
+    struct ast_header header;
+    struct type_decl_listNode* type_decl_list;
+    struct var_decl_listNode* var_decl_list;
+    static const char padding[8];
+    int next_body = 0;
+    int next_expr = 0;
+    long offset;
+    int result = 0;
+    FILE* file;
+    int i;
 
-    struct stmt_listNode* program_stmt = body->stmt_list;
-    while(program_stmt != NULL)
+    memset(&w, 0, sizeof(w));
+    for (i = 0; i < AST_SECTIONS; i++)
+        w.sections[i].size = record_sizes[i];
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, AST_MAGIC);
+    header.version = AST_VERSION;
+
+    header.type_decls = -1;
+    if (program->decl->type_decl_section != NULL)
     {
-        struct stmtNode* current_stmt = program_stmt->stmt;
-        switch (current_stmt->stmtType)
-        {
-            case ASSIGN:
-                overall_type = process_assign(current_stmt->assign_stmt);
-                break;
-            case WHILE:
-                overall_type = process_while(current_stmt->while_stmt);
-                break;
-            case DO:
-                overall_type = process_while(current_stmt->while_stmt);
-                break;
-            case SWITCH:
-                overall_type = process_switch(current_stmt->switch_stmt);
-                break;
-        } 
-        if (overall_type < 0)
+        header.type_decls = 0;
+        type_decl_list = program->decl->type_decl_section->type_decl_list;
+        for (; type_decl_list != NULL; type_decl_list = type_decl_list->type_decl_list)
         {
-            return overall_type;
-        }   
-        program_stmt = program_stmt->stmt_list;
+            ast_decl(&w, type_decl_list->type_decl->id_list, type_decl_list->type_decl->type_name);
+            ++header.type_decls;
+        }
     }
-    return overall_type;
-} 
-
-int main()
-{
-    struct programNode* parseTree;
-    parseTree = program();
-    // TODO: remove the next line after you complete the parser
-    // This is just for debugging purposes
-    //print_parse_tree(parseTree);
-    // TODO: do type checking & print output according to project specification
-
-    // Create built-in types
-    new_types = 0;
-    struct symbol* int_type = ALLOC(struct symbol);
-    int_type->id = "INT";
-    int_type->type_number = 10;
-    int_type->where = 0;
-    int_type->flag = 0;
-    table[0] = int_type;
-    
-    struct symbol* real_type = ALLOC(struct symbol);
-    real_type->id = "REAL";
-    real_type->type_number = 11;
-    real_type->where = 0;
-    real_type->flag = 0;
-    table[1] = real_type;
-
-    struct symbol* boolean_type = ALLOC(struct symbol);
-    boolean_type->id = "BOOLEAN";
-    boolean_type->type_number = 12;
-    boolean_type->where = 0;
-    boolean_type->flag = 0;
-    table[2] = boolean_type;
-
-    struct symbol* string_type = ALLOC(struct symbol);
-    string_type->id = "STRING";
-    string_type->type_number = 13;
-    string_type->where = 0;
-    string_type->flag = 0;
-    table[3] = string_type;
-
-    struct symbol* long_type = ALLOC(struct symbol);
-    long_type->id = "LONG";
-    long_type->type_number = 14;
-    long_type->where = 0;
-    long_type->flag = 0;
-    table[4] = long_type;
-
-    // Check if TYPE section exists
-    if (parseTree->decl->type_decl_section != NULL)
+    header.var_decls = -1;
+    if (program->decl->var_decl_section != NULL)
     {
-        // Go through each id_list in the TYPE section
-        struct type_decl_listNode* currentTypeList = parseTree->decl->type_decl_section->type_decl_list;
-        while(currentTypeList != NULL)
-        {
-            struct id_listNode* current_id_list = currentTypeList->type_decl->id_list;
-            struct type_nameNode* current_type_name = currentTypeList->type_decl->type_name;
-            // Check to see if RHS is an implicit type
-            int i = 0;
-            int isFound = 0;
-            int rhs_number = -1;
-            
-            while ((i < (5 + new_types)) && (isFound == 0))
-            {
-                if (strcmp(type_string(current_type_name), table[i]->id) == 0)
-                {
-                    rhs_number = table[i]->type_number;
-                    isFound = 1;
-                }
-                ++i;
-            }
-            if(isFound == 0)
-            {
-                ++new_types;                
-                table[4+new_types] = ALLOC(struct symbol);
-                table[4+new_types]->id = (char*)malloc(strlen(current_type_name->id) * sizeof(char));
-                strcpy(table[4+new_types]->id, current_type_name->id);
-                table[4+new_types]->type_number = (14+new_types);
-                table[4+new_types]->where = 2;
-                table[4+new_types]->flag = 0;
-                rhs_number = 14+new_types;
-            }           
-
-            while(current_id_list != NULL)
-            {
-                // Check to see if id is already in table
-                int i;
-                for (i = 0; i < (5 + new_types); i++)
-                {
-                    if (strcmp(current_id_list->id, table[i]->id) == 0)
-                    {
-                        printf("ERROR CODE 0\n");
-                        return 1;
-                    }
-                }
-                
-                ++new_types;                
-                table[4+new_types] = ALLOC(struct symbol);
-                table[4+new_types]->id = (char*)malloc(strlen(current_id_list->id) * sizeof(char));
-                strcpy(table[4+new_types]->id, current_id_list->id);
-                table[4+new_types]->type_number = rhs_number;
-                table[4+new_types]->where = 1;
-                table[4+new_types]->flag = 0;                 
-                current_id_list = current_id_list->id_list;
-            }
-            currentTypeList = currentTypeList->type_decl_list;
-        } 
+        header.var_decls = 0;
+        var_decl_list = program->decl->var_decl_section->var_decl_list;
+        for (; var_decl_list != NULL; var_decl_list = var_decl_list->var_decl_list)
+        {
+            ast_decl(&w, var_decl_list->var_decl->id_list, var_decl_list->var_decl->type_name);
+            ++header.var_decls;
+        }
     }
 
-    // Check if VAR section exists
-    if (parseTree->decl->var_decl_section != NULL)
+    // Breadth first, so that nesting does not use the C stack
+    header.body = ast_body_index(&w, program->body);
+    while (next_body < w.sections[AST_BODIES].count || next_expr < w.sections[AST_EXPRS].count)
     {
-        // Go through each id_list in the VAR section
-        struct var_decl_listNode* currentVarList = parseTree->decl->var_decl_section->var_decl_list;
-        while(currentVarList != NULL)
-        {
-            struct id_listNode* current_id_list = currentVarList->var_decl->id_list;
-            struct type_nameNode* current_type_name = currentVarList->var_decl->type_name;
-            // Check to see if RHS is an implicit type
-            int i = 0;
-            int isFound = 0;
-            int rhs_number = -1;
-            
-            while ((i < (5 + new_types)) && (isFound == 0))
-            {
-                //printf("2 ids: %s %s\n", type_string(current_type_name), table[i]->id);                
-                if (strcmp(type_string(current_type_name), table[i]->id) == 0)
-                {
-                    if (table[i]->flag == 1)
-                    {
-                        printf("ERROR CODE 4\n");
-                        return 1;
-                    }
-                    else
-                    {
-                        rhs_number = table[i]->type_number;
-                        isFound = 1;
-                    }
-                }
-                ++i;
-            }
-            if(isFound == 0)
-            {
-                ++new_types;                
-                table[4+new_types] = ALLOC(struct symbol);
-                table[4+new_types]->id = (char*)malloc(strlen(current_type_name->id) * sizeof(char));
-                strcpy(table[4+new_types]->id, current_type_name->id);
-                table[4+new_types]->type_number = (14+new_types);
-                table[4+new_types]->where = 2;
-                table[4+new_types]->flag = 0;
-                rhs_number = 14+new_types;
-            }           
-
-            while(current_id_list != NULL)
-            {
-                // Check to see if id is already in table
-                int i;
-                for (i = 0; i < (5 + new_types); i++)
-                {   
-                    if (strcmp(current_id_list->id, table[i]->id) == 0)
-                    {
-                        if (table[i]->flag == 1)
-                        {                      
-                            printf("ERROR CODE 2\n");
-                            return 1;
-                        }
-                        else if (table[i]->flag == 0)
-                        {
-                            printf("ERROR CODE 1\n");
-                            return 1;
-                        }
-                    }
-                }
-                
-                ++new_types;                
-                table[4+new_types] = ALLOC(struct symbol);
-                table[4+new_types]->id = (char*)malloc(strlen(current_id_list->id) * sizeof(char));
-                strcpy(table[4+new_types]->id, current_id_list->id);
-                table[4+new_types]->type_number = rhs_number;
-                table[4+new_types]->where = 1;
-                table[4+new_types]->flag = 1;                 
-                current_id_list = current_id_list->id_list;
-            }
-            currentVarList = currentVarList->var_decl_list;
-        } 
+        if (next_body < w.sections[AST_BODIES].count)
+            ast_body(&w, next_body++);
+        else
+            ast_expr(&w, next_expr++);
     }
 
-    // Parse the statements inside the body
-    int result = process_body(parseTree->body);
-    if (result < 0)
+    offset = (sizeof(header) + 7) & ~7L;
+    for (i = 0; i < AST_SECTIONS; i++)
     {
-        return 1;
+        header.counts[i] = w.sections[i].count;
+        header.offsets[i] = (int) offset;
+        offset += ((long) w.sections[i].count * w.sections[i].size + 7) & ~7L;
     }
 
-    // If there are no semantic errors, print out the types
-    int type_array[5 + new_types];
-    int i, j, k;
-    for (i = 0; i < (5 + new_types); i++)
+    file = fopen(path, "wb");
+    if (file == NULL)
+        result = -1;
+    else
     {
-        type_array[i] = 0;
-    }
-    for (i = 0; i < (5 + new_types); i++)
-    { 
-        int count = 0;        
-        for (k = i; k < (5 + new_types); k++)
-        {
-            if (table[k]->type_number == table[i]->type_number)
-            {
-                ++count;
-            }
-        }
-        if (count < 2)
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(padding, ((sizeof(header) + 7) & ~7L) - sizeof(header), 1, file);
+        for (i = 0; i < AST_SECTIONS; i++)
         {
-            type_array[i] = 1;
+            long bytes = (long) w.sections[i].count * w.sections[i].size;
+
+            fwrite(w.sections[i].data, 1, bytes, file);
+            fwrite(padding, 1, ((bytes + 7) & ~7L) - bytes, file);
         }
-        if(type_array[i] == 0)
-        {
-            printf("%s :", table[i]->id);
-            type_array[i] = 1;
-            // Print out types first            
-            for (j = i; j < (5 + new_types); j++)
-            {
-                 if((type_array[j] == 0) && (table[j]->flag == 0) && (table[j]->type_number == table[i]->type_number))
-                 {
-                    printf(" %s", table[j]->id);
-                    type_array[j] = 1;
-                 }
+        if (ferror(file))
+            result = -1;
+        if (fclose(file) != 0)
+            result = -1;
+    }
+
+    for (i = 0; i < AST_SECTIONS; i++)
+        free(w.sections[i].data);
+    free(w.bodies);
+    free(w.exprs);
+    free(w.expr_keys);
+    free(w.expr_indices);
+    free(w.string_slots);
+    return result;
+}
+
+// Maps the file at path. Only the header is read, so the time does not
+// depend on the size of the tree. Returns 0, or -1 if the file cannot
+// be mapped or is not a parse tree file.
+int load_ast(const char* path, struct ast_file* file)
+{
+    const struct ast_header* header;
+    struct stat st;
+    void* base;
+    int fd;
+    int i;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct ast_header))
+    {
+        close(fd);
+        return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    header = (const struct ast_header*) base;
+    if (memcmp(header->magic, AST_MAGIC, sizeof(AST_MAGIC)) != 0 || header->version != AST_VERSION)
+    {
+        munmap(base, st.st_size);
+        return -1;
+    }
+    for (i = 0; i < AST_SECTIONS; i++)
+    {
+        if (header->counts[i] < 0 || header->offsets[i] < (int) sizeof(struct ast_header) ||
+            header->offsets[i] % 8 != 0 ||
+            (size_t) header->offsets[i] + (size_t) header->counts[i] * record_sizes[i] > (size_t) st.st_size)
+        {
+            munmap(base, st.st_size);
+            return -1;
+        }
+    }
+    if (header->body < 0 || header->body >= header->counts[AST_BODIES] ||
+        (long) (header->type_decls > 0 ? header->type_decls : 0) +
+        (header->var_decls > 0 ? header->var_decls : 0) > header->counts[AST_DECLS])
+    {
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    file->header = header;
+    file->exprs = (const struct ast_expr*) ((const char*) base + header->offsets[AST_EXPRS]);
+    file->stmts = (const struct ast_stmt*) ((const char*) base + header->offsets[AST_STMTS]);
+    file->conditions = (const struct ast_condition*) ((const char*) base + header->offsets[AST_CONDITIONS]);
+    file->bodies = (const struct ast_body*) ((const char*) base + header->offsets[AST_BODIES]);
+    file->cases = (const struct ast_case*) ((const char*) base + header->offsets[AST_CASES]);
+    file->decls = (const struct ast_decl*) ((const char*) base + header->offsets[AST_DECLS]);
+    file->items = (const int*) ((const char*) base + header->offsets[AST_ITEMS]);
+    file->strings = (const char*) base + header->offsets[AST_STRINGS];
+    file->size = st.st_size;
+    return 0;
+}
+
+struct primaryNode* link_primary(const struct ast_file* file, struct ast_primary record)
+{
+    struct primaryNode* prim;
+
+    if (record.tag == 0)
+        return NULL;
+    prim = ALLOC(struct primaryNode);
+    prim->tag = record.tag;
+    if (record.tag == NUM)
+        prim->ival = record.value;
+    else if (record.tag == REALNUM)
+        memcpy(&prim->fval, &record.value, sizeof(float));
+    else
+        prim->id = (char*) file->strings + record.value;
+    return prim;
+}
+
+struct id_listNode* link_id_list(const struct ast_file* file, const struct ast_decl* decl)
+{
+    struct id_listNode* id_list = ALLOC(struct id_listNode);
+    int i;
+
+    id_list->count = decl->count;
+    id_list->ids = (char**) arena_alloc(decl->count * sizeof(char*));
+    for (i = 0; i < decl->count; i++)
+        id_list->ids[i] = (char*) file->strings + file->items[decl->first + i];
+    return id_list;
+}
+
+struct type_nameNode* link_type_name(const struct ast_file* file, const struct ast_decl* decl)
+{
+    struct type_nameNode* type_name = ALLOC(struct type_nameNode);
+
+    type_name->type = decl->type;
+    type_name->id = (decl->id < 0) ? NULL : (char*) file->strings + decl->id;
+    return type_name;
+}
+
+// Builds the parse tree of a mapped file. Records of one kind become one
+// arena array, strings stay in the mapping.
+struct programNode* link_ast(const struct ast_file* file)
+{
+    const struct ast_header* header = file->header;
+    struct programNode* program = ALLOC(struct programNode);
+    struct exprNode* exprs = (struct exprNode*) arena_alloc(header->counts[AST_EXPRS] * sizeof(struct exprNode));
+    struct stmtNode* stmts = (struct stmtNode*) arena_alloc(header->counts[AST_STMTS] * sizeof(struct stmtNode));
+    struct stmtNode** stmt_pointers = (struct stmtNode**) arena_alloc(header->counts[AST_STMTS] * sizeof(struct stmtNode*));
+    struct bodyNode* bodies = (struct bodyNode*) arena_alloc(header->counts[AST_BODIES] * sizeof(struct bodyNode));
+    struct stmt_listNode* stmt_lists = (struct stmt_listNode*) arena_alloc(header->counts[AST_BODIES] * sizeof(struct stmt_listNode));
+    struct type_decl_listNode* type_last = NULL;
+    struct var_decl_listNode* var_last = NULL;
+    int i, j;
+
+    for (i = 0; i < header->counts[AST_EXPRS]; i++)
+    {
+        const struct ast_expr* record = &file->exprs[i];
+        struct ast_primary prim;
+
+        exprs[i].op = record->op;
+        exprs[i].tag = record->tag;
+        exprs[i].type = -1;
+        if (record->tag == EXPR)
+        {
+            exprs[i].leftOperand = &exprs[record->a];
+            exprs[i].rightOperand = &exprs[record->b];
+        }
+        else
+        {
+            prim.tag = record->a;
+            prim.value = record->b;
+            exprs[i].primary = link_primary(file, prim);
+        }
+    }
+
+    for (i = 0; i < header->counts[AST_BODIES]; i++)
+    {
+        bodies[i].stmt_list = &stmt_lists[i];
+        stmt_lists[i].count = file->bodies[i].count;
+        stmt_lists[i].stmts = &stmt_pointers[file->bodies[i].first];
+    }
+
+    for (i = 0; i < header->counts[AST_STMTS]; i++)
+    {
+        const struct ast_stmt* record = &file->stmts[i];
+
+        stmt_pointers[i] = &stmts[i];
+        stmts[i].stmtType = record->type;
+        if (record->type == ASSIGN)
+        {
+            stmts[i].assign_stmt = ALLOC(struct assign_stmtNode);
+            stmts[i].assign_stmt->id = (char*) file->strings + record->a;
+            stmts[i].assign_stmt->expr = &exprs[record->b];
+        }
+        else if (record->type == WHILE || record->type == DO)
+        {
+            const struct ast_condition* condition = &file->conditions[record->a];
+
+            stmts[i].while_stmt = ALLOC(struct while_stmtNode);
+            stmts[i].while_stmt->condition = ALLOC(struct conditionNode);
+            stmts[i].while_stmt->condition->relop = condition->relop;
+            stmts[i].while_stmt->condition->left_operand = link_primary(file, condition->left);
+            stmts[i].while_stmt->condition->right_operand = link_primary(file, condition->right);
+            stmts[i].while_stmt->body = &bodies[record->b];
+        }
+        else
+        {
+            struct case_listNode* case_list = NULL;
+
+            stmts[i].switch_stmt = ALLOC(struct switch_stmtNode);
+            stmts[i].switch_stmt->id = (char*) file->strings + record->a;
+            for (j = record->c - 1; j >= 0; j--)
+            {
+                struct case_listNode* node = ALLOC(struct case_listNode);
+
+                node->cas = ALLOC(struct caseNode);
+                node->cas->num = file->cases[record->b + j].num;
+                node->cas->body = &bodies[file->cases[record->b + j].body];
+                node->case_list = case_list;
+                case_list = node;
+            }
+            stmts[i].switch_stmt->case_list = case_list;
+        }
+    }
+
+    program->decl = ALLOC(struct declNode);
+    if (header->type_decls >= 0)
+    {
+        program->decl->type_decl_section = ALLOC(struct type_decl_sectionNode);
+        for (i = 0; i < header->type_decls; i++)
+        {
+            struct type_decl_listNode* node = ALLOC(struct type_decl_listNode);
+
+            node->type_decl = ALLOC(struct type_declNode);
+            node->type_decl->id_list = link_id_list(file, &file->decls[i]);
+            node->type_decl->type_name = link_type_name(file, &file->decls[i]);
+            if (type_last == NULL)
+                program->decl->type_decl_section->type_decl_list = node;
+            else
+                type_last->type_decl_list = node;
+            type_last = node;
+        }
+    }
+    if (header->var_decls >= 0)
+    {
+        program->decl->var_decl_section = ALLOC(struct var_decl_sectionNode);
+        for (i = 0; i < header->var_decls; i++)
+        {
+            const struct ast_decl* decl = &file->decls[(header->type_decls > 0 ? header->type_decls : 0) + i];
+            struct var_decl_listNode* node = ALLOC(struct var_decl_listNode);
+
+            node->var_decl = ALLOC(struct var_declNode);
+            node->var_decl->id_list = link_id_list(file, decl);
+            node->var_decl->type_name = link_type_name(file, decl);
+            if (var_last == NULL)
+                program->decl->var_decl_section->var_decl_list = node;
+            else
+                var_last->var_decl_list = node;
+            var_last = node;
+        }
+    }
+    program->body = &bodies[header->body];
+    return program;
+}
+
+/* ------------------------------------------------------------- */
+/* -------------------- TYPE CHECKING SECTION -------------------- */
+/* ------------------------------------------------------------- */
+
+static char* type_string(struct type_nameNode* type_struct)
+{
+    switch (type_struct->type)
+    {
+        case INT:
+            return "INT";
+        case REAL:
+            return "REAL";
+        case STRING:
+            return "STRING";
+        case BOOLEAN:
+            return "BOOLEAN";
+        case ID:
+            return type_struct->id;
+        case LONG:
+            return "LONG";
+    }
+    return NULL;
+}
+
+/* -------------------- SYMBOL TABLE -------------------- */
+
+// table[] holds the symbols in the order they were declared or first
+// used. symbol_hash[] is an open addressing index into table[] so that
+// a lookup does not have to scan every symbol.
+
+unsigned int hash_string(const char* s)
+{
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void hash_insert(int index)
+{
+    unsigned int mask = symbol_hash_size - 1;
+    unsigned int h = hash_string(table[index]->id) & mask;
+
+    while (symbol_hash[h] >= 0)
+        h = (h + 1) & mask;
+    symbol_hash[h] = index;
+}
+
+void grow_symbol_table()
+{
+    int i;
+
+    table_capacity = (table_capacity == 0) ? 64 : 2 * table_capacity;
+    table = (struct symbol**) realloc(table, table_capacity * sizeof(struct symbol*));
+
+    // Keep the hash index at most half full
+    free(symbol_hash);
+    symbol_hash_size = 2 * table_capacity;
+    symbol_hash = (int*) malloc(symbol_hash_size * sizeof(int));
+    for (i = 0; i < symbol_hash_size; i++)
+        symbol_hash[i] = -1;
+    for (i = 0; i < symbol_count; i++)
+        hash_insert(i);
+}
+
+// Returns the index of id in table[] or -1 if it is not there
+int lookup_symbol(const char* id)
+{
+    unsigned int mask = symbol_hash_size - 1;
+    unsigned int h;
+
+    STAT_ADD(COUNT_SYMBOL_LOOKUPS, 1);
+    if (symbol_hash_size == 0)
+        return -1;
+    h = hash_string(id) & mask;
+    while (symbol_hash[h] >= 0)
+    {
+        STAT_ADD(COUNT_SYMBOL_PROBES, 1);
+        if (strcmp(id, table[symbol_hash[h]]->id) == 0)
+            return symbol_hash[h];
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+// Appends a new symbol to table[] and returns its index
+int add_symbol(const char* id, int type_number, int where, int flag)
+{
+    int index = symbol_count;
+
+    if (index == table_capacity)
+        grow_symbol_table();
+    table[index] = ALLOC(struct symbol);
+    table[index]->id = arena_strdup(id);
+    table[index]->type_number = type_number;
+    table[index]->where = where;
+    table[index]->flag = flag;
+    ++symbol_count;
+    hash_insert(index);
+    return index;
+}
+
+// Removes every symbol added after the first count symbols
+void truncate_symbols(int count)
+{
+    int i;
+
+    symbol_count = count;
+    for (i = 0; i < symbol_hash_size; i++)
+        symbol_hash[i] = -1;
+    for (i = 0; i < symbol_count; i++)
+        hash_insert(i);
+}
+
+/* -------------------- TYPE VARIABLES -------------------- */
+
+// Every type_number is a type variable. Type variables that must be
+// equal are merged into one equivalence class with union-find (union by
+// rank and path compression). type_builtin[] records, for the root of a
+// class, the built-in type the class is bound to or 0 if it is unbound.
+// The members of a class are also linked in a circular list by
+// type_next[].
+//
+// A built-in type is alone in its class, classes that are unified with
+// it are bound to it instead. Two classes bound to the same built-in
+// type are not merged either: nothing could tell them apart, and this
+// keeps classes small when they have to be taken apart again (see the
+// INCREMENTAL SECTION).
+
+int new_type_var()
+{
+    int t = type_count;
+
+    if (t == type_capacity)
+    {
+        type_capacity = (type_capacity == 0) ? 64 : 2 * type_capacity;
+        type_parent = (int*) realloc(type_parent, type_capacity * sizeof(int));
+        type_rank = (int*) realloc(type_rank, type_capacity * sizeof(int));
+        type_builtin = (int*) realloc(type_builtin, type_capacity * sizeof(int));
+        type_next = (int*) realloc(type_next, type_capacity * sizeof(int));
+    }
+    type_parent[t] = t;
+    type_rank[t] = 0;
+    type_builtin[t] = 0;
+    type_next[t] = t;
+    ++type_count;
+    return t;
+}
+
+int find_type(int t)
+{
+    int root = t;
+    int next;
+
+    STAT_ADD(COUNT_FIND_TYPE, 1);
+    while (type_parent[root] != root)
+        root = type_parent[root];
+    while (type_parent[t] != root)
+    {
+        next = type_parent[t];
+        type_parent[t] = root;
+        t = next;
+    }
+    return root;
+}
+
+// Makes first and second the same type and returns the root of a class
+// that holds first or second, or -1 if they are bound to different
+// built-in types
+int unify(int first, int second)
+{
+    int a = find_type(first);
+    int b = find_type(second);
+    int builtin, next;
+
+    STAT_ADD(COUNT_UNIFY, 1);
+    if (a == b)
+        return a;
+    if (type_builtin[a] != 0 && type_builtin[b] != 0)
+        return (type_builtin[a] == type_builtin[b]) ? a : -1;
+    if (type_builtin[a] == a)
+    {
+        type_builtin[b] = a;
+        return b;
+    }
+    if (type_builtin[b] == b)
+    {
+        type_builtin[a] = b;
+        return a;
+    }
+
+    builtin = (type_builtin[a] != 0) ? type_builtin[a] : type_builtin[b];
+    if (type_rank[a] < type_rank[b])
+    {
+        int tmp = a;
+        a = b;
+        b = tmp;
+    }
+    type_parent[b] = a;
+    if (type_rank[a] == type_rank[b])
+        ++type_rank[a];
+    type_builtin[a] = builtin;
+    next = type_next[a];
+    type_next[a] = type_next[b];
+    type_next[b] = next;
+    return a;
+}
+
+/* -------------------- CHECKING THE BODY -------------------- */
+
+// The body is checked through a check_context. The sequential checker
+// works on the global symbol table and type variables directly. When
+// regions are checked in parallel (see the PARALLEL CHECKING section)
+// each thread has its own context whose partition holds thread-local
+// type variables, so nothing global is written while threads run.
+
+struct check_context sequential_context;
+
+// Maps a global type number to the context's type numbering
+int context_type(struct check_context* ctx, int t)
+{
+    if (ctx->partition == NULL)
+        return t;
+    return partition_type(ctx->partition, t);
+}
+
+int context_unify(struct check_context* ctx, int first, int second)
+{
+    if (ctx->partition == NULL)
+        return unify(first, second);
+    return partition_unify(ctx->partition, first, second);
+}
+
+// Prints the error, or only records it when checking a region
+void check_error(struct check_context* ctx, int code)
+{
+    if (ctx->partition == NULL)
+    {
+        if (!ctx->silent)
+            printf("ERROR CODE %d\n", code);
+    }
+    else if (ctx->partition->error == 0)
+        ctx->partition->error = code;
+}
+
+// Returns the type of a variable that is used in the body, declaring it
+// implicitly if needed, or -1 if id names a type
+int process_id(struct check_context* ctx, char* current_id)
+{
+    int i = lookup_symbol(current_id);
+
+    if (i < 0)
+    {
+        if (ctx->partition != NULL)
+            return partition_new_id(ctx->partition, current_id);
+        i = add_symbol(current_id, new_type_var(), 2, 1);
+        return table[i]->type_number;
+    }
+    if (table[i]->flag == 0)
+    {
+        check_error(ctx, 1);
+        return -1;
+    }
+    return context_type(ctx, table[i]->type_number);
+}
+
+int process_prim(struct check_context* ctx, struct primaryNode* prim)
+{
+    if (prim->tag == ID)
+        return process_id(ctx, prim->id);
+    else if (prim->tag == NUM)
+        return context_type(ctx, INT_TYPE);
+    else
+        return context_type(ctx, REAL_TYPE);
+}
+
+// Checks expr with an explicit-stack post-order walk so that deep
+// expression trees do not use the C stack. Operands are checked left to
+// right before their operator, as a recursive walk would do.
+//
+// The sequential checker remembers the type of every node it checks.
+// Expressions are shared between statements, and checking a node again
+// could only unify classes that are already unified, so a node whose
+// type is known is not walked again. This does not hold when classes
+// are taken apart again, so the incremental checker does not do it.
+int process_expr(struct check_context* ctx, struct exprNode* expr)
+{
+    int expr_top = 0;
+    int operand_top = 0;
+    int memoize = ctx->memoize;
+    int result;
+
+    while (TRUE)
+    {
+        if (memoize && expr->type >= 0)
+            result = find_type(expr->type);
+        else if (expr->tag == PRIMARY)
+        {
+            result = process_prim(ctx, expr->primary);
+            if (result < 0)
+                return -1;
+            if (memoize)
+                expr->type = result;
+        }
+        else
+        {
+            if (expr_top == ctx->expr_capacity)
+            {
+                ctx->expr_capacity = (ctx->expr_capacity == 0) ? 256 : 2 * ctx->expr_capacity;
+                ctx->expr_stack = (struct expr_frame*) realloc(ctx->expr_stack, ctx->expr_capacity * sizeof(struct expr_frame));
+            }
+            ctx->expr_stack[expr_top].expr = expr;
+            ctx->expr_stack[expr_top].state = 0;
+            ++expr_top;
+            expr = expr->leftOperand;
+            continue;
+        }
+
+        // result is the type of a finished operand. Pop every operator
+        // whose two operands are both finished.
+        while (TRUE)
+        {
+            if (expr_top == 0)
+                return result;
+            if (operand_top == ctx->operand_capacity)
+            {
+                ctx->operand_capacity = (ctx->operand_capacity == 0) ? 256 : 2 * ctx->operand_capacity;
+                ctx->operand_types = (int*) realloc(ctx->operand_types, ctx->operand_capacity * sizeof(int));
+            }
+            if (ctx->expr_stack[expr_top - 1].state == 0)
+            {
+                // left operand done, check the right operand next
+                ctx->operand_types[operand_top++] = result;
+                ctx->expr_stack[expr_top - 1].state = 1;
+                expr = ctx->expr_stack[expr_top - 1].expr->rightOperand;
+                break;
+            }
+            --expr_top;
+            result = context_unify(ctx, ctx->operand_types[--operand_top], result);
+            if (result < 0)
+            {
+                check_error(ctx, 3);
+                return -1;
+            }
+            if (memoize)
+                ctx->expr_stack[expr_top].expr->type = result;
+        }
+    }
+}
+
+int process_assign(struct check_context* ctx, struct assign_stmtNode* assign_stmt)
+{
+    int lhs_number, rhs_number, result;
+
+    lhs_number = process_id(ctx, assign_stmt->id);
+    if (lhs_number < 0)
+        return -1;
+    rhs_number = process_expr(ctx, assign_stmt->expr);
+    if (rhs_number < 0)
+        return -1;
+    result = context_unify(ctx, lhs_number, rhs_number);
+    if (result < 0)
+        check_error(ctx, 3);
+    return result;
+}
+
+int process_condition(struct check_context* ctx, struct conditionNode* condition)
+{
+    int lhs_number, rhs_number, result;
+
+    lhs_number = process_prim(ctx, condition->left_operand);
+    if (lhs_number < 0)
+        return -1;
+    if (condition->relop != NOOP)
+    {
+        rhs_number = process_prim(ctx, condition->right_operand);
+        if (rhs_number < 0)
+            return -1;
+        result = context_unify(ctx, lhs_number, rhs_number);
+    }
+    else
+        result = context_unify(ctx, lhs_number, context_type(ctx, BOOLEAN_TYPE));
+    if (result < 0)
+    {
+        check_error(ctx, 3);
+        return -1;
+    }
+    return result;
+}
+
+int process_switch(struct check_context* ctx, struct switch_stmtNode* swi)
+{
+    int id_number, result;
+
+    // The switch variable must be an INT
+    id_number = process_id(ctx, swi->id);
+    if (id_number < 0)
+        return -1;
+    result = context_unify(ctx, id_number, context_type(ctx, INT_TYPE));
+    if (result < 0)
+    {
+        check_error(ctx, 3);
+        return -1;
+    }
+    return result;
+}
+
+void push_check_frame(struct check_context* ctx, int* top, struct bodyNode* body,
+                      struct stmtNode* stmt, struct case_listNode* next_case)
+{
+    if (*top == ctx->check_capacity)
+    {
+        ctx->check_capacity = (ctx->check_capacity == 0) ? 64 : 2 * ctx->check_capacity;
+        ctx->check_stack = (struct check_frame*) realloc(ctx->check_stack, ctx->check_capacity * sizeof(struct check_frame));
+    }
+    ctx->check_stack[*top].body = body;
+    ctx->check_stack[*top].next = 0;
+    ctx->check_stack[*top].end = body->stmt_list->count;
+    ctx->check_stack[*top].stmt = stmt;
+    ctx->check_stack[*top].next_case = next_case;
+    ++*top;
+}
+
+// Checks statements first to end - 1 of body in program order. Nested
+// bodies are kept on an explicit stack so that nesting depth does not
+// use the C stack. Returns -1 after the first error, 0 otherwise.
+int process_stmts(struct check_context* ctx, struct bodyNode* body, int first, int end)
+{
+    int top = 0;
+    struct check_frame frame;
+    struct check_frame* current;
+    struct stmtNode* current_stmt;
+
+    push_check_frame(ctx, &top, body, NULL, NULL);
+    ctx->check_stack[0].next = first;
+    ctx->check_stack[0].end = end;
+    while (top > 0)
+    {
+        current = &ctx->check_stack[top - 1];
+        if (current->next < current->end)
+        {
+            current_stmt = current->body->stmt_list->stmts[current->next++];
+            switch (current_stmt->stmtType)
+            {
+                case ASSIGN:
+                    if (process_assign(ctx, current_stmt->assign_stmt) < 0)
+                        return -1;
+                    break;
+                case WHILE:
+                    if (process_condition(ctx, current_stmt->while_stmt->condition) < 0)
+                        return -1;
+                    push_check_frame(ctx, &top, current_stmt->while_stmt->body, current_stmt, NULL);
+                    break;
+                case DO:
+                    // the condition is checked after the body
+                    push_check_frame(ctx, &top, current_stmt->while_stmt->body, current_stmt, NULL);
+                    break;
+                case SWITCH:
+                    if (process_switch(ctx, current_stmt->switch_stmt) < 0)
+                        return -1;
+                    push_check_frame(ctx, &top, current_stmt->switch_stmt->case_list->cas->body, current_stmt,
+                                     current_stmt->switch_stmt->case_list->case_list);
+                    break;
+            }
+            continue;
+        }
+
+        // The body is finished
+        frame = ctx->check_stack[--top];
+        if (frame.stmt == NULL)
+            continue;
+        if (frame.stmt->stmtType == DO)
+        {
+            if (process_condition(ctx, frame.stmt->while_stmt->condition) < 0)
+                return -1;
+        }
+        else if (frame.stmt->stmtType == SWITCH && frame.next_case != NULL)
+            push_check_frame(ctx, &top, frame.next_case->cas->body, frame.stmt, frame.next_case->case_list);
+    }
+    return 0;
+}
+
+// Checks the program body sequentially, printing the first error
+int process_body(struct bodyNode* body)
+{
+    return process_stmts(&sequential_context, body, 0, body->stmt_list->count);
+}
+
+/* -------------------- CHECKING THE DECLARATIONS -------------------- */
+
+// Returns the type named on the right hand side of a declaration,
+// declaring it implicitly if needed, or -1 if it names a variable
+int process_type_name(struct type_nameNode* type_name)
+{
+    char* name = type_string(type_name);
+    int i = lookup_symbol(name);
+
+    if (i < 0)
+    {
+        i = add_symbol(name, new_type_var(), 2, 0);
+        return table[i]->type_number;
+    }
+    if (table[i]->flag == 1)
+    {
+        printf("ERROR CODE 4\n");
+        return -1;
+    }
+    return table[i]->type_number;
+}
+
+int process_type_decl_section(struct type_decl_sectionNode* typeDeclSection)
+{
+    struct type_decl_listNode* currentTypeList = typeDeclSection->type_decl_list;
+    while (currentTypeList != NULL)
+    {
+        struct id_listNode* current_id_list = currentTypeList->type_decl->id_list;
+        int rhs_number = process_type_name(currentTypeList->type_decl->type_name);
+        int j;
+        if (rhs_number < 0)
+            return -1;
+
+        for (j = 0; j < current_id_list->count; j++)
+        {
+            // A type may only be declared once
+            if (lookup_symbol(current_id_list->ids[j]) >= 0)
+            {
+                printf("ERROR CODE 0\n");
+                return -1;
+            }
+            add_symbol(current_id_list->ids[j], rhs_number, 1, 0);
+        }
+        currentTypeList = currentTypeList->type_decl_list;
+    }
+    return 0;
+}
+
+int process_var_decl_section(struct var_decl_sectionNode* varDeclSection)
+{
+    struct var_decl_listNode* currentVarList = varDeclSection->var_decl_list;
+    while (currentVarList != NULL)
+    {
+        struct id_listNode* current_id_list = currentVarList->var_decl->id_list;
+        int rhs_number = process_type_name(currentVarList->var_decl->type_name);
+        int j;
+        if (rhs_number < 0)
+            return -1;
+
+        for (j = 0; j < current_id_list->count; j++)
+        {
+            int i = lookup_symbol(current_id_list->ids[j]);
+            if (i >= 0)
+            {
+                if (table[i]->flag == 1)
+                    printf("ERROR CODE 2\n");
+                else
+                    printf("ERROR CODE 1\n");
+                return -1;
+            }
+            add_symbol(current_id_list->ids[j], rhs_number, 1, 1);
+        }
+        currentVarList = currentVarList->var_decl_list;
+    }
+    return 0;
+}
+
+// Starts over with a symbol table that only has the built-in types,
+// their type numbers are 10 to 14
+void create_builtin_types()
+{
+    int i;
+
+    truncate_symbols(0);
+    type_count = 0;
+    while (type_count < INT_TYPE)
+        new_type_var();
+    add_symbol("INT", new_type_var(), 0, 0);
+    add_symbol("REAL", new_type_var(), 0, 0);
+    add_symbol("STRING", new_type_var(), 0, 0);
+    add_symbol("BOOLEAN", new_type_var(), 0, 0);
+    add_symbol("LONG", new_type_var(), 0, 0);
+    for (i = INT_TYPE; i <= LONG_TYPE; i++)
+        type_builtin[i] = i;
+}
+
+/* -------------------- PRINTING THE TYPES -------------------- */
+
+// The classes are written through one fixed buffer that goes to stdout
+// with a single fwrite() whenever it fills up, instead of one printf()
+// per symbol.
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+char output_buffer[OUTPUT_BUFFER_SIZE];
+int output_length;
+
+void flush_output()
+{
+    fwrite(output_buffer, 1, output_length, stdout);
+    output_length = 0;
+}
+
+void output_string(const char* s)
+{
+    size_t length = strlen(s);
+
+    if (output_length + length > OUTPUT_BUFFER_SIZE)
+    {
+        flush_output();
+        // Too long for the buffer, it goes out on its own
+        if (length > OUTPUT_BUFFER_SIZE)
+        {
+            fwrite(s, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(output_buffer + output_length, s, length);
+    output_length += length;
+}
+
+// Prints every equivalence class that has at least two members. Within a
+// class the built-in type comes first, then explicit types, implicit
+// types, explicit variables and implicit variables, each in the order
+// they were added to table[]. Classes are printed in the order of their
+// first member. Each symbol is visited once per bucket, so this is linear
+// in the number of symbols.
+//
+// Classes bound to the same built-in type are printed as one class. In
+// incremental mode implicit variables are printed in implicit_order[]
+// instead, which leaves out those the program no longer uses.
+void print_types()
+{
+    int* class_head = (int*) malloc(type_count * sizeof(int));
+    int* class_tail = (int*) malloc(type_count * sizeof(int));
+    int* class_size = (int*) malloc(type_count * sizeof(int));
+    int* class_order = (int*) malloc(type_count * sizeof(int));
+    int* next_member = (int*) malloc((symbol_count + 1) * sizeof(int));
+    int number_of_classes = 0;
+    int bucket, i, k, c, count;
+
+    for (i = 0; i < type_count; i++)
+        class_head[i] = -1;
+
+    // bucket = 2 * flag + (where == 2), built-in types go first
+    for (bucket = -1; bucket < 4; bucket++)
+    {
+        count = (bucket == 3 && implicit_order != NULL) ? implicit_count : symbol_count;
+        for (k = 0; k < count; k++)
+        {
+            struct symbol* sym;
+            int root;
+
+            i = (bucket == 3 && implicit_order != NULL) ? implicit_order[k] : k;
+            sym = table[i];
+
+            if (sym->where == 0)
+            {
+                if (bucket != -1)
+                    continue;
+            }
+            else if (bucket != 2 * sym->flag + (sym->where == 2))
+                continue;
+
+            root = find_type(sym->type_number);
+            if (type_builtin[root] != 0)
+                root = type_builtin[root];
+            next_member[i] = -1;
+            if (class_head[root] < 0)
+            {
+                class_head[root] = i;
+                class_size[root] = 1;
+                class_order[number_of_classes++] = root;
+            }
+            else
+            {
+                next_member[class_tail[root]] = i;
+                ++class_size[root];
+            }
+            class_tail[root] = i;
+        }
+    }
+
+    for (c = 0; c < number_of_classes; c++)
+    {
+        int root = class_order[c];
+
+        if (class_size[root] < 2)
+            continue;
+        i = class_head[root];
+        output_string(table[i]->id);
+        output_string(" :");
+        for (i = next_member[i]; i >= 0; i = next_member[i])
+        {
+            output_string(" ");
+            output_string(table[i]->id);
+        }
+        output_string(" #\n");
+    }
+    flush_output();
+
+    free(class_head);
+    free(class_tail);
+    free(class_size);
+    free(class_order);
+    free(next_member);
+}
+
+/* -------------------- PARALLEL CHECKING -------------------- */
+
+// With -j N the statements of the program body are split into N regions
+// of consecutive statements that are checked by N threads. Each thread
+// reads the symbol table but never writes it: declared symbols are
+// mapped to thread-local type variables, and variables that are not
+// declared get a local type variable and are remembered in order of
+// first use. Because unification only merges classes, the regions do
+// not have to use disjoint variables. After the threads finish, the
+// regions are merged in program order: new variables are added to the
+// symbol table in the same order the sequential checker would add them,
+// and every local union is replayed on the global type variables.
+//
+// If any region or the merge finds an error, the global state is put
+// back and the sequential checker is run so that exactly the same
+// first error is printed.
+
+int partition_new_local(struct partition* p, int global, int builtin)
+{
+    int t = p->count;
+
+    if (t == p->capacity)
+    {
+        p->capacity = (p->capacity == 0) ? 64 : 2 * p->capacity;
+        p->parent = (int*) realloc(p->parent, p->capacity * sizeof(int));
+        p->rank = (int*) realloc(p->rank, p->capacity * sizeof(int));
+        p->builtin = (int*) realloc(p->builtin, p->capacity * sizeof(int));
+        p->global = (int*) realloc(p->global, p->capacity * sizeof(int));
+    }
+    p->parent[t] = t;
+    p->rank[t] = 0;
+    p->builtin[t] = builtin;
+    p->global[t] = global;
+    ++p->count;
+    return t;
+}
+
+// Maps a global type number to a local one
+int partition_type(struct partition* p, int t)
+{
+    int root = t;
+
+    if (p->local_of[t] == 0)
+    {
+        // find_type() compresses paths, so it must not be used here
+        while (type_parent[root] != root)
+            root = type_parent[root];
+        p->local_of[t] = partition_new_local(p, t, type_builtin[root]) + 1;
+    }
+    return p->local_of[t] - 1;
+}
+
+// Returns the local type of a variable that is not in the symbol table
+int partition_new_id(struct partition* p, char* id)
+{
+    unsigned int mask, h;
+    int i;
+
+    if (2 * (p->new_count + 1) > p->new_hash_size)
+    {
+        free(p->new_hash);
+        p->new_hash_size = (p->new_hash_size == 0) ? 64 : 2 * p->new_hash_size;
+        p->new_hash = (int*) malloc(p->new_hash_size * sizeof(int));
+        p->new_ids = (char**) realloc(p->new_ids, (p->new_hash_size / 2) * sizeof(char*));
+        p->new_types = (int*) realloc(p->new_types, (p->new_hash_size / 2) * sizeof(int));
+        mask = p->new_hash_size - 1;
+        for (i = 0; i < p->new_hash_size; i++)
+            p->new_hash[i] = -1;
+        for (i = 0; i < p->new_count; i++)
+        {
+            h = hash_string(p->new_ids[i]) & mask;
+            while (p->new_hash[h] >= 0)
+                h = (h + 1) & mask;
+            p->new_hash[h] = i;
+        }
+    }
+
+    mask = p->new_hash_size - 1;
+    h = hash_string(id) & mask;
+    while (p->new_hash[h] >= 0)
+    {
+        if (strcmp(id, p->new_ids[p->new_hash[h]]) == 0)
+            return p->new_types[p->new_hash[h]];
+        h = (h + 1) & mask;
+    }
+    p->new_hash[h] = p->new_count;
+    p->new_ids[p->new_count] = id;
+    p->new_types[p->new_count] = partition_new_local(p, -1, 0);
+    return p->new_types[p->new_count++];
+}
+
+int partition_find(struct partition* p, int t)
+{
+    int root = t;
+    int next;
+
+    while (p->parent[root] != root)
+        root = p->parent[root];
+    while (p->parent[t] != root)
+    {
+        next = p->parent[t];
+        p->parent[t] = root;
+        t = next;
+    }
+    return root;
+}
+
+// Same as unify() on the local type variables of p
+int partition_unify(struct partition* p, int first, int second)
+{
+    int a = partition_find(p, first);
+    int b = partition_find(p, second);
+    int builtin;
+
+    STAT_ADD(COUNT_UNIFY, 1);
+    if (a == b)
+        return a;
+    if (p->builtin[a] != 0 && p->builtin[b] != 0)
+        return (p->builtin[a] == p->builtin[b]) ? a : -1;
+
+    builtin = (p->builtin[a] != 0) ? p->builtin[a] : p->builtin[b];
+    if (p->rank[a] < p->rank[b])
+    {
+        int tmp = a;
+        a = b;
+        b = tmp;
+    }
+    p->parent[b] = a;
+    if (p->rank[a] == p->rank[b])
+        ++p->rank[a];
+    p->builtin[a] = builtin;
+    return a;
+}
+
+struct region
+{
+    pthread_t thread;
+    int started;  // TRUE if thread has to be joined
+    struct bodyNode* body;
+    int first;
+    int end;
+    int result;
+    struct check_context ctx;
+    struct partition partition;
+};
+
+void* check_region(void* arg)
+{
+    struct region* r = (struct region*) arg;
+
+    r->result = process_stmts(&r->ctx, r->body, r->first, r->end);
+    return NULL;
+}
+
+// Replays the unions of r on the global type variables. Returns -1 if
+// they conflict.
+int merge_region(struct region* r)
+{
+    struct partition* p = &r->partition;
+    int i, root;
+
+    for (i = 0; i < p->new_count; i++)
+    {
+        int index = lookup_symbol(p->new_ids[i]);
+        if (index < 0)
+            index = add_symbol(p->new_ids[i], new_type_var(), 2, 1);
+        p->global[p->new_types[i]] = table[index]->type_number;
+    }
+    for (i = 0; i < p->count; i++)
+    {
+        root = partition_find(p, i);
+        if (root != i && unify(p->global[i], p->global[root]) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+void free_region(struct region* r)
+{
+    free(r->ctx.expr_stack);
+    free(r->ctx.operand_types);
+    free(r->ctx.check_stack);
+    free(r->partition.parent);
+    free(r->partition.rank);
+    free(r->partition.builtin);
+    free(r->partition.global);
+    free(r->partition.local_of);
+    free(r->partition.new_ids);
+    free(r->partition.new_types);
+    free(r->partition.new_hash);
+}
+
+int process_body_parallel(struct bodyNode* body, int number_of_threads)
+{
+    int count = body->stmt_list->count;
+    int saved_types = type_count;
+    int saved_symbols = symbol_count;
+    int* saved_parent;
+    int* saved_rank;
+    int* saved_builtin;
+    int* saved_next;
+    struct region* regions;
+    int i, result = 0;
+
+    if (number_of_threads > count)
+        number_of_threads = count;
+    if (number_of_threads <= 1)
+        return process_body(body);
+
+    saved_parent = (int*) malloc(saved_types * sizeof(int));
+    saved_rank = (int*) malloc(saved_types * sizeof(int));
+    saved_builtin = (int*) malloc(saved_types * sizeof(int));
+    saved_next = (int*) malloc(saved_types * sizeof(int));
+    memcpy(saved_parent, type_parent, saved_types * sizeof(int));
+    memcpy(saved_rank, type_rank, saved_types * sizeof(int));
+    memcpy(saved_builtin, type_builtin, saved_types * sizeof(int));
+    memcpy(saved_next, type_next, saved_types * sizeof(int));
+
+    regions = (struct region*) calloc(number_of_threads, sizeof(struct region));
+    for (i = 0; i < number_of_threads; i++)
+    {
+        regions[i].body = body;
+        regions[i].first = (int) ((long long) count * i / number_of_threads);
+        regions[i].end = (int) ((long long) count * (i + 1) / number_of_threads);
+        regions[i].ctx.partition = &regions[i].partition;
+        regions[i].partition.local_of = (int*) calloc(type_count, sizeof(int));
+        regions[i].partition.global_count = type_count;
+        regions[i].started = (pthread_create(&regions[i].thread, NULL, check_region, &regions[i]) == 0);
+        if (!regions[i].started)
+            check_region(&regions[i]);
+    }
+    for (i = 0; i < number_of_threads; i++)
+    {
+        if (regions[i].started)
+            pthread_join(regions[i].thread, NULL);
+        if (regions[i].result < 0)
+            result = -1;
+    }
+    for (i = 0; i < number_of_threads && result == 0; i++)
+        result = merge_region(&regions[i]);
+    for (i = 0; i < number_of_threads; i++)
+        free_region(&regions[i]);
+    free(regions);
+
+    if (result < 0)
+    {
+        // Undo the merge and let the sequential checker report the error
+        truncate_symbols(saved_symbols);
+        type_count = saved_types;
+        memcpy(type_parent, saved_parent, saved_types * sizeof(int));
+        memcpy(type_rank, saved_rank, saved_types * sizeof(int));
+        memcpy(type_builtin, saved_builtin, saved_types * sizeof(int));
+        memcpy(type_next, saved_next, saved_types * sizeof(int));
+        result = process_body(body);
+    }
+    free(saved_parent);
+    free(saved_rank);
+    free(saved_builtin);
+    free(saved_next);
+    return result;
+}
+
+/* ------------------------------------------------------------- */
+/* -------------------- INCREMENTAL SECTION -------------------- */
+/* ------------------------------------------------------------- */
+
+// With -i FILE the program is read from FILE and kept in memory while
+// edits are read from stdin. An edit is the line
+//     EDIT first last count
+// followed by count lines that replace lines first to last of the
+// program, last = first - 1 inserts them before line first. After the
+// program is read and after every edit, the output that -r gives for
+// the current text is printed, followed by a line with END.
+//
+// Lexing: the program is lexed once into tokens[], an edit only lexes
+// the new lines and splices their tokens in.
+//
+// Parsing: every statement and body knows its span, the positions of
+// its first and last token. Only statements of the innermost body that
+// contains the edit are parsed again, from the statement the edit may
+// have changed up to the first old statement after the edit at which
+// the parser is back in that body. If that does not work out, the whole
+// body is parsed again, and if that does not either, the whole program.
+//
+// Checking: every statement is a unit of checking, its assignment,
+// condition or switch variable. The units that use each type variable
+// are remembered. After an edit the classes of the variables used by
+// the removed and the new units are taken apart, and every unit that
+// uses one of their variables is checked again. Any error falls back to
+// checking the whole program, which prints the error the batch checker
+// prints.
+
+struct programNode* program_tree;
+int check_ok;                        // the last check found no error
+struct check_context replay_context; // checks units again, silently
+
+struct int_list
+{
+    int* items;
+    int count;
+    int capacity;
+};
+
+void int_list_push(struct int_list* list, int value)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = (list->capacity == 0) ? 64 : 2 * list->capacity;
+        list->items = (int*) realloc(list->items, list->capacity * sizeof(int));
+    }
+    list->items[list->count++] = value;
+}
+
+// Returns ints that grow from old_size to new_size entries, the new
+// entries set to fill
+int* grow_ints(int* array, int old_size, int new_size, int fill)
+{
+    int i;
+
+    array = (int*) realloc(array, new_size * sizeof(int));
+    for (i = old_size; i < new_size; i++)
+        array[i] = fill;
+    return array;
+}
+
+/* -------------------- TOKENS AND SPANS -------------------- */
+
+// Lexes in, whose first line is first_line, into a new array that ends
+// with the EOF token
+struct token_record* lex_tokens(FILE* in, int first_line, int* count)
+{
+    struct token_record* records = NULL;
+    int capacity = 0;
+    int n = 0;
+    int type;
+    STAT_ENTER(PHASE_LEX);
+
+    source = in;
+    line_no = first_line;
+    do
+    {
+        type = lex_token();
+        STAT_ADD(COUNT_TOKENS, 1);
+        if (n == capacity)
+        {
+            capacity = (capacity == 0) ? 256 : 2 * capacity;
+            records = (struct token_record*) realloc(records, capacity * sizeof(struct token_record));
+        }
+        records[n].type = type;
+        records[n].line = line_no;
+        if (type == ID || type == NUM || type == REALNUM)
+            records[n].lexeme = intern_id(token);
+        else
+            records[n].lexeme = "";
+        ++n;
+    } while (type != EOF);
+    *count = n;
+    STAT_LEAVE();
+    return records;
+}
+
+// Index of the first token on line or after it
+int first_token_on_line(int line)
+{
+    int low = 0;
+    int high = token_count - 1; // the EOF token comes after every line
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (tokens[middle].line < line)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+int new_span(int first, int last, struct stmtNode* stmt)
+{
+    if (span_count >= span_capacity)
+    {
+        span_capacity = (span_capacity == 0) ? 1024 : 2 * span_capacity;
+        span_first = (int*) realloc(span_first, span_capacity * sizeof(int));
+        span_last = (int*) realloc(span_last, span_capacity * sizeof(int));
+        span_stmt = (struct stmtNode**) realloc(span_stmt, span_capacity * sizeof(struct stmtNode*));
+        span_alive = (char*) realloc(span_alive, span_capacity);
+    }
+    span_first[span_count] = first;
+    span_last[span_count] = last;
+    span_stmt[span_count] = stmt;
+    span_alive[span_count] = FALSE;
+    return span_count++;
+}
+
+// Token positions from end on move by delta after an edit
+void shift_positions(int end, int delta)
+{
+    int i;
+
+    for (i = 1; i < span_count; i++)
+    {
+        if (span_first[i] >= end)
+            span_first[i] += delta;
+        if (span_last[i] >= end)
+            span_last[i] += delta;
+    }
+    for (i = 0; i < error_count; i++)
+    {
+        if (error_log[i].position >= end)
+            error_log[i].position += delta;
+    }
+}
+
+// Removes the errors before error number limit at positions first to
+// end - 1
+void remove_errors(int first, int end, int limit)
+{
+    int i, kept = 0;
+
+    for (i = 0; i < error_count; i++)
+    {
+        if (i < limit && error_log[i].position >= first && error_log[i].position < end)
+            continue;
+        error_log[kept++] = error_log[i];
+    }
+    error_count = kept;
+}
+
+int compare_errors(const void* a, const void* b)
+{
+    const struct logged_error* x = (const struct logged_error*) a;
+    const struct logged_error* y = (const struct logged_error*) b;
+
+    return x->position - y->position;
+}
+
+void print_syntax_errors()
+{
+    int i;
+
+    if (error_count > 1)
+        qsort(error_log, error_count, sizeof(struct logged_error), compare_errors);
+    for (i = 0; i < error_count; i++)
+        printf("Syntax error while parsing %s line %d\n", error_log[i].message,
+               tokens[error_log[i].position].line);
+}
+
+/* -------------------- PARSING AGAIN -------------------- */
+
+// Called by parse_body() before each statement of the range's body.
+// Returns TRUE when the parse has to stop there: at an old statement
+// after the edit, at the end of the body, or past the body (failed).
+int range_stop(struct stmt_range* range)
+{
+    int position = next_token_index();
+    int start;
+
+    if (position > range->body_end)
+    {
+        range->failed = TRUE;
+        return TRUE;
+    }
+    if (position == range->body_end)
+    {
+        range->reached = range->old_count;
+        return TRUE;
+    }
+    if (position < range->min_stop)
+        return FALSE;
+    while (range->next_old < range->old_count)
+    {
+        start = span_first[range->old[range->next_old]->span];
+        if (start > position)
+            return FALSE;
+        if (start == position)
+        {
+            range->reached = range->next_old;
+            return TRUE;
+        }
+        ++range->next_old;
+    }
+    return FALSE;
+}
+
+// Starts the parser at position, a point at which the batch parser is
+// between statements
+void start_parser(int position)
+{
+    token_cursor = position;
+    activeToken = FALSE;
+    brace_depth = 1;
+    parse_top = 0;
+    operator_top = 0;
+    operand_top = 0;
+}
+
+struct bodyNode** walk_bodies;
+int walk_capacity;
+
+void push_walk_body(int* top, struct bodyNode* bod)
+{
+    if (*top == walk_capacity)
+    {
+        walk_capacity = (walk_capacity == 0) ? 64 : 2 * walk_capacity;
+        walk_bodies = (struct bodyNode**) realloc(walk_bodies, walk_capacity * sizeof(struct bodyNode*));
+    }
+    walk_bodies[(*top)++] = bod;
+}
+
+// Adds the units of count statements and of the bodies in them
+void collect_units(struct stmtNode** stmts, int count, struct int_list* units)
+{
+    struct case_listNode* c;
+    int top = 0;
+    int i;
+
+    while (TRUE)
+    {
+        for (i = 0; i < count; i++)
+        {
+            int_list_push(units, stmts[i]->span);
+            if (stmts[i]->stmtType == WHILE || stmts[i]->stmtType == DO)
+                push_walk_body(&top, stmts[i]->while_stmt->body);
+            else if (stmts[i]->stmtType == SWITCH)
+            {
+                for (c = stmts[i]->switch_stmt->case_list; c != NULL; c = c->case_list)
+                    push_walk_body(&top, c->cas->body);
+            }
+        }
+        if (top == 0)
+            return;
+        --top;
+        stmts = walk_bodies[top]->stmt_list->stmts;
+        count = walk_bodies[top]->stmt_list->count;
+    }
+}
+
+// Index of the last statement of bod that starts at position or before
+// it, -1 if there is none
+int last_stmt_before(struct bodyNode* bod, int position)
+{
+    struct stmtNode** stmts = bod->stmt_list->stmts;
+    int low = 0;
+    int high = bod->stmt_list->count;
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (span_first[stmts[middle]->span] <= position)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low - 1;
+}
+
+// Finds the innermost body that contains tokens first to end - 1 and
+// does not start or end in them, NULL if there is none
+struct bodyNode* enclosing_body(int first, int end)
+{
+    struct bodyNode* bod = program_tree->body;
+    struct bodyNode* inner;
+    struct stmtNode* stm;
+    struct case_listNode* c;
+    int i;
+
+    if (bod->span == 0 || span_first[bod->span] >= first || span_last[bod->span] < end)
+        return NULL;
+    while (TRUE)
+    {
+        i = last_stmt_before(bod, first);
+        if (i < 0)
+            return bod;
+        stm = bod->stmt_list->stmts[i];
+        inner = NULL;
+        if (stm->stmtType == WHILE || stm->stmtType == DO)
+            inner = stm->while_stmt->body;
+        else if (stm->stmtType == SWITCH)
+        {
+            for (c = stm->switch_stmt->case_list; c != NULL; c = c->case_list)
+            {
+                if (span_first[c->cas->body->span] < first)
+                    inner = c->cas->body;
+            }
+        }
+        if (inner == NULL || span_first[inner->span] >= first || span_last[inner->span] < end)
+            return bod;
+        bod = inner;
+    }
+}
+
+// Units that an edit took out of the parse tree and put into it
+struct int_list removed_units;
+struct int_list added_units;
+
+// Parses statements of bod again, starting at position start where
+// statement first starts (or the first statement would start). The
+// parse ends at an old statement from next_old on that starts at
+// min_stop or after it, or at the end of bod, and its statements
+// replace the old ones before that point.
+int reparse_statements(struct bodyNode* bod, int first, int next_old, int start, int min_stop)
+{
+    struct stmt_listNode* list = bod->stmt_list;
+    struct stmt_listNode* part;
+    struct stmt_range range;
+    struct bodyNode* result;
+    int errors = error_count;
+    int saved_eof = eof_reported;
+    int end, count, capacity;
+    jmp_buf here;
+
+    range.old = list->stmts;
+    range.old_count = list->count;
+    range.next_old = next_old;
+    range.min_stop = min_stop;
+    range.body_end = span_last[bod->span];
+    range.reached = list->count;
+    range.failed = FALSE;
+    start_parser(start);
+    recovery_point = &here;
+    if (setjmp(here) != 0)
+        result = NULL; // parse_body() recovers from every error itself
+    else
+        result = parse_body(&range);
+    recovery_point = NULL;
+
+    // An empty body is reported by body(), let it do that
+    if (result == NULL || range.failed ||
+        first + result->stmt_list->count + list->count - range.reached == 0)
+    {
+        error_count = errors;
+        eof_reported = saved_eof;
+        return FALSE;
+    }
+
+    // A statement cannot fail at its first token, so an error at end was
+    // found by the statements of the range
+    part = result->stmt_list;
+    end = (range.reached < list->count) ? span_first[list->stmts[range.reached]->span] : range.body_end;
+    remove_errors(start, end + 1, errors);
+    collect_units(list->stmts + first, range.reached - first, &removed_units);
+    collect_units(part->stmts, part->count, &added_units);
+
+    // Splice the new statements in, in place if they fit
+    count = first + part->count + list->count - range.reached;
+    capacity = (list->capacity > list->count) ? list->capacity : list->count;
+    if (count > capacity)
+    {
+        struct stmtNode** stmts;
+
+        capacity = 2 * count;
+        stmts = (struct stmtNode**) arena_alloc(capacity * sizeof(struct stmtNode*));
+        memcpy(stmts, list->stmts, first * sizeof(struct stmtNode*));
+        memcpy(stmts + first + part->count, list->stmts + range.reached,
+               (list->count - range.reached) * sizeof(struct stmtNode*));
+        list->stmts = stmts;
+        list->capacity = capacity;
+    }
+    else
+        memmove(list->stmts + first + part->count, list->stmts + range.reached,
+                (list->count - range.reached) * sizeof(struct stmtNode*));
+    memcpy(list->stmts + first, part->stmts, part->count * sizeof(struct stmtNode*));
+    list->count = count;
+    return TRUE;
+}
+
+// Parses all of bod again, it has to end where it ended before
+int reparse_body(struct bodyNode* bod)
+{
+    int first = span_first[bod->span];
+    int last = span_last[bod->span];
+    int errors = error_count;
+    int saved_eof = eof_reported;
+    struct bodyNode* result;
+    jmp_buf here;
+
+    start_parser(first);
+    brace_depth = 0;
+    recovery_point = &here;
+    if (setjmp(here) != 0)
+        result = NULL;
+    else
+        result = body();
+    recovery_point = NULL;
+    if (result == NULL || last_token != last)
+    {
+        error_count = errors;
+        eof_reported = saved_eof;
+        return FALSE;
+    }
+
+    // An error at the LBRACE was found by what came before the body
+    remove_errors(first + 1, last + 1, errors);
+    collect_units(bod->stmt_list->stmts, bod->stmt_list->count, &removed_units);
+    collect_units(result->stmt_list->stmts, result->stmt_list->count, &added_units);
+    bod->stmt_list = result->stmt_list;
+    return TRUE;
+}
+
+// Tells if the batch parser starts statement i of bod with nothing
+// before it that could depend on the tokens from there on: right after
+// the LBRACE or a statement that ended well. Recovery from an error may
+// have skipped tokens before the statement or failed at its first token.
+int clean_start(struct bodyNode* bod, int i)
+{
+    struct stmtNode** stmts = bod->stmt_list->stmts;
+    int start = span_first[stmts[i]->span];
+    int low = 0;
+    int high = error_count;
+
+    if (start != ((i == 0) ? span_first[bod->span] : span_last[stmts[i - 1]->span]) + 1)
+        return FALSE;
+
+    // error_log[] is sorted when it is printed
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (error_log[middle].position < start)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low == error_count || error_log[low].position != start;
+}
+
+void parse_program()
+{
+    error_count = 0;
+    span_count = 1;
+    eof_reported = FALSE;
+    scratch_top = 0;
+    start_parser(0);
+    brace_depth = 0;
+    program_tree = program();
+}
+
+// Replaces lines first to last with the count lines in text. Returns
+// TRUE if only the statements in removed_units and added_units changed,
+// FALSE if the whole program was parsed again.
+int apply_edit(int first, int last, char* text, size_t length, int count)
+{
+    struct token_record* fresh = NULL;
+    struct bodyNode* bod;
+    int fresh_count = 0;
+    int d0, d1, delta, line_delta, i, k;
+    int first_stmt = 0, next_old = 0, start = 0;
+    FILE* in;
+
+    // The tokens of lines first to last are d0 to d1 - 1
+    d0 = first_token_on_line(first);
+    d1 = first_token_on_line(last + 1);
+    if (count > 0)
+    {
+        in = fmemopen(text, length, "r");
+        fresh = lex_tokens(in, first, &fresh_count);
+        fclose(in);
+        --fresh_count; // drop the EOF token
+    }
+    delta = fresh_count - (d1 - d0);
+    line_delta = count - (last - first + 1);
+
+    // Find what to parse again while positions are still the old ones
+    bod = enclosing_body(d0, d1);
+    if (bod != NULL)
+    {
+        i = last_stmt_before(bod, d0);
+        while (i >= 0 && !clean_start(bod, i))
+            --i;
+        start = (i >= 0) ? span_first[bod->stmt_list->stmts[i]->span] : span_first[bod->span] + 1;
+        first_stmt = (i >= 0) ? i : 0;
+        next_old = last_stmt_before(bod, d1 - 1) + 1;
+    }
+    remove_errors(d0, d1, error_count);
+
+    if (token_count + delta > token_capacity)
+    {
+        token_capacity = 2 * (token_count + delta);
+        tokens = (struct token_record*) realloc(tokens, token_capacity * sizeof(struct token_record));
+    }
+    memmove(tokens + d0 + fresh_count, tokens + d1, (token_count - d1) * sizeof(struct token_record));
+    if (fresh_count > 0)
+        memcpy(tokens + d0, fresh, fresh_count * sizeof(struct token_record));
+    token_count += delta;
+    if (line_delta != 0)
+    {
+        for (k = d0 + fresh_count; k < token_count; k++)
+            tokens[k].line += line_delta;
+    }
+    shift_positions(d1, delta);
+    free(fresh);
+
+    removed_units.count = 0;
+    added_units.count = 0;
+    if (bod != NULL && tokens[span_last[bod->span]].type == RBRACE)
+    {
+        // The error of an empty body is only found by body()
+        if (bod->stmt_list->count > 0 &&
+            reparse_statements(bod, first_stmt, next_old, start, d1 + delta))
+            return TRUE;
+        if (reparse_body(bod))
+            return TRUE;
+    }
+    parse_program();
+    return FALSE;
+}
+
+/* -------------------- CHECKING AGAIN -------------------- */
+
+// Each unit unifies all of its variables with each other, and with a
+// built-in type if it has a literal, a NOOP condition, a switch or a
+// variable of a built-in type. Such a unit ties its variables to that
+// type directly. Taking out a unit cannot change the class of a variable
+// that is still tied directly by another unit, nor of anything that was
+// unified with it, so only the classes of the variables of removed units
+// that lost their last tie are taken apart. New units only add unions.
+
+int* occ_head;    // per type variable, its first occurrence or -1
+int* occ_unit;    // per occurrence, a unit that uses the variable
+int* occ_rank;    // where the variable is first used among the ids of the unit
+int* occ_next;
+int occ_count;
+int occ_capacity;
+int* ties;        // per type variable, units that tie it to a built-in type
+int* first_unit;  // per implicit variable, the unit that uses it first or -1
+int* first_rank;
+int* var_mark;    // per type variable and unit: mark_epoch if the
+int* unit_mark;   // current pass has seen it
+int mark_epoch;
+int* var_seen;    // per type variable, seen_epoch if the unit has it
+int seen_epoch;
+int symbol_slots;
+int var_slots;
+int unit_slots;
+
+void reserve_marks()
+{
+    int size;
+
+    if (symbol_slots < symbol_count)
+    {
+        size = (2 * symbol_slots > symbol_count) ? 2 * symbol_slots : symbol_count;
+        first_unit = grow_ints(first_unit, symbol_slots, size, -1);
+        first_rank = grow_ints(first_rank, symbol_slots, size, 0);
+        implicit_order = (int*) realloc(implicit_order, size * sizeof(int));
+        symbol_slots = size;
+    }
+    if (var_slots < type_count)
+    {
+        size = (2 * var_slots > type_count) ? 2 * var_slots : type_count;
+        occ_head = grow_ints(occ_head, var_slots, size, -1);
+        ties = grow_ints(ties, var_slots, size, 0);
+        var_mark = grow_ints(var_mark, var_slots, size, 0);
+        var_seen = grow_ints(var_seen, var_slots, size, 0);
+        var_slots = size;
+    }
+    if (unit_slots < span_count)
+    {
+        size = (2 * unit_slots > span_count) ? 2 * unit_slots : span_count;
+        unit_mark = grow_ints(unit_mark, unit_slots, size, 0);
+        unit_slots = size;
+    }
+}
+
+char** unit_ids;
+int unit_id_count;
+int unit_id_capacity;
+int unit_literal; // built-in type the unit's literals or condition bind, 0 if none
+struct exprNode** id_walk;
+int id_walk_capacity;
+
+void push_unit_id(char* id)
+{
+    if (unit_id_count == unit_id_capacity)
+    {
+        unit_id_capacity = (unit_id_capacity == 0) ? 64 : 2 * unit_id_capacity;
+        unit_ids = (char**) realloc(unit_ids, unit_id_capacity * sizeof(char*));
+    }
+    unit_ids[unit_id_count++] = id;
+}
+
+void push_unit_primary(struct primaryNode* prim)
+{
+    if (prim->tag == ID)
+        push_unit_id(prim->id);
+    else
+        unit_literal = (prim->tag == NUM) ? INT_TYPE : REAL_TYPE;
+}
+
+// Lists the ids that a unit uses in the order the checker meets them
+void list_unit_ids(int unit)
+{
+    struct stmtNode* stm = span_stmt[unit];
+    struct conditionNode* condition;
+    struct exprNode* expr;
+    int top = 0;
+
+    unit_id_count = 0;
+    unit_literal = 0;
+    if (stm->stmtType == SWITCH)
+    {
+        push_unit_id(stm->switch_stmt->id);
+        unit_literal = INT_TYPE;
+    }
+    else if (stm->stmtType == WHILE || stm->stmtType == DO)
+    {
+        condition = stm->while_stmt->condition;
+        push_unit_primary(condition->left_operand);
+        if (condition->relop != NOOP)
+            push_unit_primary(condition->right_operand);
+        else
+            unit_literal = BOOLEAN_TYPE;
+    }
+    else
+    {
+        push_unit_id(stm->assign_stmt->id);
+        expr = stm->assign_stmt->expr;
+        while (TRUE)
+        {
+            if (expr->tag == PRIMARY)
+            {
+                push_unit_primary(expr->primary);
+                if (top == 0)
+                    return;
+                expr = id_walk[--top];
+                continue;
+            }
+            if (top == id_walk_capacity)
+            {
+                id_walk_capacity = (id_walk_capacity == 0) ? 64 : 2 * id_walk_capacity;
+                id_walk = (struct exprNode**) realloc(id_walk, id_walk_capacity * sizeof(struct exprNode*));
+            }
+            id_walk[top++] = expr->rightOperand;
+            expr = expr->leftOperand;
+        }
+    }
+}
+
+// Type variables of a unit, each once, other than built-in types
+int* unit_vars;
+int* unit_var_ranks;   // where the variable is first used among the ids
+int* unit_var_symbols; // symbol of that first use
+int unit_var_count;
+int unit_var_capacity;
+
+// Lists the type variables of a unit and returns the built-in type the
+// unit ties them to, 0 if it does not
+int list_unit_vars(int unit)
+{
+    int tie, rank, s, v;
+
+    list_unit_ids(unit);
+    tie = unit_literal;
+    unit_var_count = 0;
+    ++seen_epoch;
+    for (rank = 0; rank < unit_id_count; rank++)
+    {
+        s = lookup_symbol(unit_ids[rank]);
+        if (s < 0)
+            continue;
+        v = table[s]->type_number;
+        if (type_builtin[v] == v)
+        {
+            tie = v;
+            continue;
+        }
+        if (var_seen[v] == seen_epoch)
+            continue;
+        var_seen[v] = seen_epoch;
+        if (unit_var_count == unit_var_capacity)
+        {
+            unit_var_capacity = (unit_var_capacity == 0) ? 64 : 2 * unit_var_capacity;
+            unit_vars = (int*) realloc(unit_vars, unit_var_capacity * sizeof(int));
+            unit_var_ranks = (int*) realloc(unit_var_ranks, unit_var_capacity * sizeof(int));
+            unit_var_symbols = (int*) realloc(unit_var_symbols, unit_var_capacity * sizeof(int));
+        }
+        unit_vars[unit_var_count] = v;
+        unit_var_ranks[unit_var_count] = rank;
+        unit_var_symbols[unit_var_count] = s;
+        ++unit_var_count;
+    }
+    return tie;
+}
+
+int is_implicit_var(int s)
+{
+    return table[s]->where == 2 && table[s]->flag == 1;
+}
+
+// Position of a unit in checking order: a DO checks its condition after
+// its body
+int unit_position(int unit)
+{
+    return (span_stmt[unit]->stmtType == DO) ? span_last[unit] : span_first[unit];
+}
+
+int unit_before(int unit, int rank, int other_unit, int other_rank)
+{
+    int position = unit_position(unit);
+    int other = unit_position(other_unit);
+
+    if (position != other)
+        return position < other;
+    return rank < other_rank;
+}
+
+// Adds an occurrence of each variable that unit uses. Implicit variables
+// are added to touched, or with touched NULL their first use is updated.
+// An implicit variable has a type variable of its own.
+void index_unit(int unit, struct int_list* touched)
+{
+    int tie = list_unit_vars(unit);
+    int k, s, v;
+
+    for (k = 0; k < unit_var_count; k++)
+    {
+        v = unit_vars[k];
+        if (occ_count == occ_capacity)
+        {
+            occ_capacity = (occ_capacity == 0) ? 1024 : 2 * occ_capacity;
+            occ_unit = (int*) realloc(occ_unit, occ_capacity * sizeof(int));
+            occ_rank = (int*) realloc(occ_rank, occ_capacity * sizeof(int));
+            occ_next = (int*) realloc(occ_next, occ_capacity * sizeof(int));
+        }
+        occ_unit[occ_count] = unit;
+        occ_rank[occ_count] = unit_var_ranks[k];
+        occ_next[occ_count] = occ_head[v];
+        occ_head[v] = occ_count++;
+        if (tie != 0)
+            ++ties[v];
+
+        s = unit_var_symbols[k];
+        if (!is_implicit_var(s))
+            continue;
+        if (touched != NULL)
+            int_list_push(touched, s);
+        else if (first_unit[s] < 0 || unit_before(unit, unit_var_ranks[k], first_unit[s], first_rank[s]))
+        {
+            first_unit[s] = unit;
+            first_rank[s] = unit_var_ranks[k];
+        }
+    }
+}
+
+// Finds the units of every variable of the program
+void index_all()
+{
+    static struct int_list units;
+    struct stmt_listNode* list = program_tree->body->stmt_list;
+    int i;
+
+    // Slots past the counts may be left from before, they are reused
+    reserve_marks();
+    occ_count = 0;
+    for (i = 0; i < var_slots; i++)
+    {
+        occ_head[i] = -1;
+        ties[i] = 0;
+    }
+    for (i = 0; i < symbol_slots; i++)
+        first_unit[i] = -1;
+    if (span_count > 1)
+        memset(span_alive, FALSE, span_count);
+    units.count = 0;
+    collect_units(list->stmts, list->count, &units);
+    for (i = 0; i < units.count; i++)
+    {
+        span_alive[units.items[i]] = TRUE;
+        index_unit(units.items[i], NULL);
+    }
+
+    // The checker added implicit variables in order of first use
+    implicit_count = 0;
+    for (i = 0; i < symbol_count; i++)
+    {
+        if (is_implicit_var(i) && first_unit[i] >= 0)
+            implicit_order[implicit_count++] = i;
+    }
+}
+
+int compare_ints(const void* a, const void* b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+// Finds the first use of each touched implicit variable again and puts
+// it back in implicit_order[]
+void update_first_uses(struct int_list* touched)
+{
+    int i, k, kept, o, s, low, high;
+    int* link;
+
+    if (touched->count == 0)
+        return;
+    qsort(touched->items, touched->count, sizeof(int), compare_ints);
+    kept = 0;
+    for (k = 0; k < implicit_count; k++)
+    {
+        s = implicit_order[k];
+        if (bsearch(&s, touched->items, touched->count, sizeof(int), compare_ints) == NULL)
+            implicit_order[kept++] = s;
+    }
+    implicit_count = kept;
+
+    for (i = 0; i < touched->count; i++)
+    {
+        s = touched->items[i];
+        if (i > 0 && s == touched->items[i - 1])
+            continue;
+
+        // Occurrences of units that are gone are dropped on the way
+        first_unit[s] = -1;
+        link = &occ_head[table[s]->type_number];
+        for (o = *link; o >= 0; o = *link)
+        {
+            if (!span_alive[occ_unit[o]])
+            {
+                *link = occ_next[o];
+                continue;
+            }
+            if (first_unit[s] < 0 || unit_before(occ_unit[o], occ_rank[o], first_unit[s], first_rank[s]))
+            {
+                first_unit[s] = occ_unit[o];
+                first_rank[s] = occ_rank[o];
+            }
+            link = &occ_next[o];
+        }
+        if (first_unit[s] < 0)
+            continue;
+
+        low = 0;
+        high = implicit_count;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            int m = implicit_order[middle];
+            if (unit_before(first_unit[m], first_rank[m], first_unit[s], first_rank[s]))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        memmove(implicit_order + low + 1, implicit_order + low, (implicit_count - low) * sizeof(int));
+        implicit_order[low] = s;
+        ++implicit_count;
+    }
+}
+
+int replay_unit(int unit)
+{
+    struct stmtNode* stm = span_stmt[unit];
+
+    if (stm->stmtType == ASSIGN)
+        return process_assign(&replay_context, stm->assign_stmt);
+    if (stm->stmtType == SWITCH)
+        return process_switch(&replay_context, stm->switch_stmt);
+    return process_condition(&replay_context, stm->while_stmt->condition);
+}
+
+// Checks the units of the last edit again. Returns -1 if there is an
+// error, the whole program then has to be checked again to report it.
+int recheck_units()
+{
+    static struct int_list vars, units, touched;
+    int k, i, o, u, v, w;
+
+    vars.count = 0;
+    units.count = 0;
+    touched.count = 0;
+    reserve_marks();
+
+    for (k = 0; k < removed_units.count; k++)
+    {
+        u = removed_units.items[k];
+        span_alive[u] = FALSE;
+        if (list_unit_vars(u) != 0)
+        {
+            for (i = 0; i < unit_var_count; i++)
+                --ties[unit_vars[i]];
+        }
+    }
+
+    // The classes of variables that lost their last tie
+    ++mark_epoch;
+    for (k = 0; k < removed_units.count; k++)
+    {
+        list_unit_vars(removed_units.items[k]);
+        for (i = 0; i < unit_var_count; i++)
+        {
+            v = unit_vars[i];
+            if (is_implicit_var(unit_var_symbols[i]))
+                int_list_push(&touched, unit_var_symbols[i]);
+            if (ties[v] > 0 || var_mark[v] == mark_epoch)
+                continue;
+            w = v;
+            do
+            {
+                var_mark[w] = mark_epoch;
+                int_list_push(&vars, w);
+                w = type_next[w];
+            } while (w != v);
+        }
+    }
+
+    // The new units and every unit that uses one of those classes
+    for (k = 0; k < added_units.count; k++)
+    {
+        unit_mark[added_units.items[k]] = mark_epoch;
+        int_list_push(&units, added_units.items[k]);
+    }
+    for (k = 0; k < vars.count; k++)
+    {
+        for (o = occ_head[vars.items[k]]; o >= 0; o = occ_next[o])
+        {
+            u = occ_unit[o];
+            if (span_alive[u] && unit_mark[u] != mark_epoch)
+            {
+                unit_mark[u] = mark_epoch;
+                int_list_push(&units, u);
+            }
+        }
+    }
+
+    // Take the classes apart and check the units again
+    for (k = 0; k < vars.count; k++)
+    {
+        v = vars.items[k];
+        type_parent[v] = v;
+        type_rank[v] = 0;
+        type_builtin[v] = 0;
+        type_next[v] = v;
+    }
+    for (k = 0; k < units.count; k++)
+    {
+        if (replay_unit(units.items[k]) < 0)
+            return -1;
+    }
+
+    reserve_marks();
+    for (k = 0; k < added_units.count; k++)
+    {
+        span_alive[added_units.items[k]] = TRUE;
+        index_unit(added_units.items[k], &touched);
+    }
+    update_first_uses(&touched);
+    return 0;
+}
+
+// Checks the whole program as main() does and finds the units of every
+// variable again. Returns -1 after an error.
+int check_all()
+{
+    STAT_SWITCH(PHASE_DECLS);
+    create_builtin_types();
+    if (program_tree->decl->type_decl_section != NULL)
+    {
+        if (process_type_decl_section(program_tree->decl->type_decl_section) < 0)
+            return -1;
+    }
+    if (program_tree->decl->var_decl_section != NULL)
+    {
+        if (process_var_decl_section(program_tree->decl->var_decl_section) < 0)
+            return -1;
+    }
+    STAT_SWITCH(PHASE_BODY);
+    if (process_body(program_tree->body) < 0)
+        return -1;
+    index_all();
+    return 0;
+}
+
+// Prints what -r prints for the current text. If incremental is TRUE,
+// only the units of the last edit have to be checked again.
+void print_version(int incremental)
+{
+    STAT_SWITCH(PHASE_OUTPUT);
+    print_syntax_errors();
+    STAT_SWITCH(PHASE_BODY);
+    if (!incremental || !check_ok || recheck_units() < 0)
+        check_ok = (check_all() == 0);
+    STAT_SWITCH(PHASE_OUTPUT);
+    if (check_ok)
+        print_types();
+    printf("END\n");
+    fflush(stdout);
+}
+
+int incremental_session(const char* path)
+{
+    FILE* in = fopen(path, "r");
+    char* line = NULL;
+    size_t line_size = 0;
+    char* text = NULL;
+    size_t text_length, text_capacity = 0, length;
+    int first, last, count, i, incremental;
+
+    if (in == NULL)
+    {
+        printf("Cannot read %s\n", path);
+        return 1;
+    }
+    tokens = lex_tokens(in, 1, &token_count);
+    token_capacity = token_count;
+    fclose(in);
+
+    recover_errors = TRUE;
+    log_errors = TRUE;
+    sequential_context.memoize = FALSE;
+    replay_context.silent = TRUE;
+    STAT_SWITCH(PHASE_PARSE);
+    parse_program();
+    print_version(FALSE);
+
+    while (getline(&line, &line_size, stdin) >= 0)
+    {
+        if (sscanf(line, "EDIT %d %d %d", &first, &last, &count) != 3 ||
+            first < 1 || last < first - 1 || count < 0)
+        {
+            printf("Bad edit: %s", line);
+            return 1;
+        }
+
+        // Every line of text ends with a newline
+        text_length = 0;
+        for (i = 0; i < count && getline(&line, &line_size, stdin) >= 0; i++)
+        {
+            length = strlen(line);
+            if (length > 0 && line[length - 1] == '\n')
+                --length;
+            if (text_length + length + 1 > text_capacity)
+            {
+                text_capacity = 2 * (text_length + length + 1);
+                text = (char*) realloc(text, text_capacity);
+            }
+            memcpy(text + text_length, line, length);
+            text_length += length;
+            text[text_length++] = '\n';
+        }
+        STAT_SWITCH(PHASE_PARSE);
+        incremental = apply_edit(first, last, text, text_length, count);
+        print_version(incremental);
+    }
+    free(line);
+    free(text);
+    return 0;
+}
+
+/* ------------------------------------------------------ */
+/* -------------------- SSA SECTION -------------------- */
+/* ------------------------------------------------------ */
+
+// -S prints the body as a control flow graph in SSA form instead of the
+// types. The graph lives in flat arrays so later passes can walk it by
+// index: ssa_insts[] by value, ssa_blocks[] by block number, and the
+// edges in ssa_succ[] and ssa_pred[], where the successors of block b are
+// ssa_succ[ssa_succ_start[b]] to ssa_succ[ssa_succ_start[b + 1] - 1].
+// Block 0 is the entry block.
+//
+// The body is lowered first with operands that still name variables.
+// Then dominators are found with the Cooper-Harvey-Kennedy algorithm, phis
+// are placed on the iterated dominance frontiers of the blocks that assign
+// a variable, and a walk of the dominator tree replaces every variable
+// operand with the value that reaches it. Phis are only placed for
+// variables that some block reads before assigning them (semi-pruned
+// SSA). None of this recurses, so nesting depth does not use the C stack.
+
+struct ssa_inst* ssa_insts;
+int ssa_inst_count;
+int ssa_inst_capacity;
+
+struct ssa_block* ssa_blocks;
+int ssa_block_count;
+int ssa_block_capacity;
+
+int* ssa_succ_start;
+int* ssa_succ;
+int* ssa_succ_slot; // position of each edge in its target's predecessors
+int* ssa_pred_start;
+int* ssa_pred;
+
+int* ssa_phi_args; // for a phi of block b, one value per predecessor of b
+int ssa_phi_arg_count;
+int ssa_phi_arg_capacity;
+
+struct primaryNode** ssa_constants;
+int ssa_constant_count;
+int ssa_constant_capacity;
+
+// Variables are numbered by name in the order they are first seen
+char** ssa_var_names;
+int ssa_var_count;
+int ssa_var_capacity;
+int* ssa_var_hash;
+int ssa_var_hash_size;
+
+// Before renaming, operand -2 - v stands for variable v
+#define SSA_VAR_REF(v) (-2 - (v))
+
+struct int_list ssa_edge_from;
+struct int_list ssa_edge_to;
+
+/* -------------------- LOWERING -------------------- */
+
+int ssa_var(char* id)
+{
+    unsigned int h;
+    int i;
+
+    if (2 * (ssa_var_count + 1) > ssa_var_hash_size)
+    {
+        ssa_var_hash_size = (ssa_var_hash_size == 0) ? 1024 : 2 * ssa_var_hash_size;
+        free(ssa_var_hash);
+        ssa_var_hash = (int*) malloc(ssa_var_hash_size * sizeof(int));
+        for (i = 0; i < ssa_var_hash_size; i++)
+            ssa_var_hash[i] = -1;
+        for (i = 0; i < ssa_var_count; i++)
+        {
+            h = hash_string(ssa_var_names[i]) & (ssa_var_hash_size - 1);
+            while (ssa_var_hash[h] >= 0)
+                h = (h + 1) & (ssa_var_hash_size - 1);
+            ssa_var_hash[h] = i;
+        }
+    }
+    h = hash_string(id) & (ssa_var_hash_size - 1);
+    while (ssa_var_hash[h] >= 0)
+    {
+        i = ssa_var_hash[h];
+        if (ssa_var_names[i] == id || strcmp(ssa_var_names[i], id) == 0)
+            return i;
+        h = (h + 1) & (ssa_var_hash_size - 1);
+    }
+    if (ssa_var_count == ssa_var_capacity)
+    {
+        ssa_var_capacity = (ssa_var_capacity == 0) ? 64 : 2 * ssa_var_capacity;
+        ssa_var_names = (char**) realloc(ssa_var_names, ssa_var_capacity * sizeof(char*));
+    }
+    ssa_var_names[ssa_var_count] = id;
+    ssa_var_hash[h] = ssa_var_count;
+    return ssa_var_count++;
+}
+
+int new_ssa_block()
+{
+    struct ssa_block* block;
+
+    if (ssa_block_count == ssa_block_capacity)
+    {
+        ssa_block_capacity = (ssa_block_capacity == 0) ? 64 : 2 * ssa_block_capacity;
+        ssa_blocks = (struct ssa_block*) realloc(ssa_blocks, ssa_block_capacity * sizeof(struct ssa_block));
+    }
+    block = &ssa_blocks[ssa_block_count];
+    block->first = -1;
+    block->last = -1;
+    block->term = SSA_JUMP;
+    block->cond = -1;
+    block->switch_stmt = NULL;
+    block->idom = -1;
+    return ssa_block_count++;
+}
+
+void add_ssa_edge(int from, int to)
+{
+    int_list_push(&ssa_edge_from, from);
+    int_list_push(&ssa_edge_to, to);
+}
+
+// Adds an instruction that is in no block yet
+int new_ssa_inst(int op, int var, int a, int b)
+{
+    struct ssa_inst* inst;
+
+    if (ssa_inst_count == ssa_inst_capacity)
+    {
+        ssa_inst_capacity = (ssa_inst_capacity == 0) ? 1024 : 2 * ssa_inst_capacity;
+        ssa_insts = (struct ssa_inst*) realloc(ssa_insts, ssa_inst_capacity * sizeof(struct ssa_inst));
+    }
+    inst = &ssa_insts[ssa_inst_count];
+    inst->op = op;
+    inst->var = var;
+    inst->version = 0;
+    inst->a = a;
+    inst->b = b;
+    inst->block = -1;
+    inst->next = -1;
+    return ssa_inst_count++;
+}
+
+// Adds an instruction at the end of block
+int emit_ssa_inst(int block, int op, int var, int a, int b)
+{
+    int i = new_ssa_inst(op, var, a, b);
+
+    ssa_insts[i].block = block;
+    if (ssa_blocks[block].last < 0)
+        ssa_blocks[block].first = i;
+    else
+        ssa_insts[ssa_blocks[block].last].next = i;
+    ssa_blocks[block].last = i;
+    return i;
+}
+
+// Returns the operand that stands for prim
+int lower_primary(struct primaryNode* prim)
+{
+    if (prim->tag == ID)
+        return SSA_VAR_REF(ssa_var(prim->id));
+    if (ssa_constant_count == ssa_constant_capacity)
+    {
+        ssa_constant_capacity = (ssa_constant_capacity == 0) ? 64 : 2 * ssa_constant_capacity;
+        ssa_constants = (struct primaryNode**) realloc(ssa_constants, ssa_constant_capacity * sizeof(struct primaryNode*));
+    }
+    ssa_constants[ssa_constant_count] = prim;
+    return new_ssa_inst(SSA_CONST, -1, ssa_constant_count++, -1);
+}
+
+// Operands of the operators of an expression being lowered, and the
+// subexpressions still to lower with how many of their operands are done
+struct int_list ssa_operands;
+struct lower_frame
+{
+    struct exprNode* expr;
+    int done;
+};
+struct lower_frame* lower_stack;
+int lower_capacity;
+
+// Lowers expr into block in postorder and returns the operand that holds
+// its value. The top instruction is assigned to var.
+int lower_expr(int block, struct exprNode* expr, int var)
+{
+    int top = 0;
+    int base = ssa_operands.count;
+    struct lower_frame* current;
+    int a, b;
+
+    if (expr->tag == PRIMARY)
+        return lower_primary(expr->primary);
+    if (lower_capacity == 0)
+    {
+        lower_capacity = 64;
+        lower_stack = (struct lower_frame*) malloc(lower_capacity * sizeof(struct lower_frame));
+    }
+    lower_stack[top].expr = expr;
+    lower_stack[top++].done = 0;
+    while (top > 0)
+    {
+        current = &lower_stack[top - 1];
+        if (current->expr->tag == PRIMARY)
+        {
+            int_list_push(&ssa_operands, lower_primary(current->expr->primary));
+            --top;
+            continue;
+        }
+        if (current->done == 2)
+        {
+            b = ssa_operands.items[--ssa_operands.count];
+            a = ssa_operands.items[--ssa_operands.count];
+            --top;
+            int_list_push(&ssa_operands,
+                          emit_ssa_inst(block, current->expr->op, (top == 0) ? var : -1, a, b));
+            continue;
+        }
+        if (top == lower_capacity)
+        {
+            lower_capacity *= 2;
+            lower_stack = (struct lower_frame*) realloc(lower_stack, lower_capacity * sizeof(struct lower_frame));
+            current = &lower_stack[top - 1];
+        }
+        lower_stack[top].expr = (current->done++ == 0) ? current->expr->leftOperand : current->expr->rightOperand;
+        lower_stack[top++].done = 0;
+    }
+    ssa_operands.count = base;
+    return ssa_operands.items[base];
+}
+
+// Returns the operand that holds the value of condition
+int lower_condition(int block, struct conditionNode* condition)
+{
+    int a = lower_primary(condition->left_operand);
+
+    if (condition->relop == NOOP)
+        return a;
+    return emit_ssa_inst(block, condition->relop, -1, a, lower_primary(condition->right_operand));
+}
+
+// The blocks that assign each variable, as lists linked through
+// ssa_def_next[]. A block is listed once per variable.
+struct int_list ssa_def_block;
+struct int_list ssa_def_next;
+int* ssa_def_head;
+int* ssa_def_last; // last block added to the list of each variable
+int ssa_def_capacity;
+
+void add_ssa_def(int var, int block)
+{
+    if (var >= ssa_def_capacity)
+    {
+        int size = (2 * var > 64) ? 2 * var : 64;
+
+        ssa_def_head = grow_ints(ssa_def_head, ssa_def_capacity, size, -1);
+        ssa_def_last = grow_ints(ssa_def_last, ssa_def_capacity, size, -1);
+        ssa_def_capacity = size;
+    }
+    if (ssa_def_last[var] == block)
+        return;
+    ssa_def_last[var] = block;
+    int_list_push(&ssa_def_block, block);
+    int_list_push(&ssa_def_next, ssa_def_head[var]);
+    ssa_def_head[var] = ssa_def_block.count - 1;
+}
+
+// A body whose statements are being lowered, see process_stmts()
+struct ssa_frame
+{
+    struct bodyNode* body;
+    int next;
+    struct stmtNode* stmt;           // statement that owns the body or NULL
+    struct case_listNode* next_case; // for SWITCH, the case to lower after this body
+    int head;       // WHILE: block of the condition, DO: first block of the body, SWITCH: block of the switch
+    int ends;       // SWITCH: where the last blocks of the cases start in ssa_case_ends
+};
+struct ssa_frame* ssa_stack;
+int ssa_stack_capacity;
+struct int_list ssa_case_ends;
+
+void push_ssa_frame(int* top, struct bodyNode* body, struct stmtNode* stmt,
+                    struct case_listNode* next_case, int head, int ends)
+{
+    if (*top == ssa_stack_capacity)
+    {
+        ssa_stack_capacity = (ssa_stack_capacity == 0) ? 64 : 2 * ssa_stack_capacity;
+        ssa_stack = (struct ssa_frame*) realloc(ssa_stack, ssa_stack_capacity * sizeof(struct ssa_frame));
+    }
+    ssa_stack[*top].body = body;
+    ssa_stack[*top].next = 0;
+    ssa_stack[*top].stmt = stmt;
+    ssa_stack[*top].next_case = next_case;
+    ssa_stack[*top].head = head;
+    ssa_stack[*top].ends = ends;
+    ++*top;
+}
+
+// Starts a case of the switch in block head, lowering goes on in the
+// returned block
+int start_ssa_case(int* top, struct stmtNode* stmt, struct case_listNode* cases, int head, int ends)
+{
+    int block = new_ssa_block();
+
+    add_ssa_edge(head, block);
+    push_ssa_frame(top, cases->cas->body, stmt, cases->case_list, head, ends);
+    return block;
+}
+
+// Lowers body into blocks and edges, block 0 is the entry
+void lower_body(struct bodyNode* body)
+{
+    int top = 0;
+    int current = new_ssa_block();
+    struct ssa_frame frame;
+    struct ssa_frame* f;
+    struct stmtNode* stmt;
+    int var, value, block, i;
+
+    push_ssa_frame(&top, body, NULL, NULL, -1, -1);
+    while (top > 0)
+    {
+        f = &ssa_stack[top - 1];
+        if (f->next < f->body->stmt_list->count)
+        {
+            stmt = f->body->stmt_list->stmts[f->next++];
+            switch (stmt->stmtType)
+            {
+                case ASSIGN:
+                    var = ssa_var(stmt->assign_stmt->id);
+                    value = lower_expr(current, stmt->assign_stmt->expr, var);
+                    if (stmt->assign_stmt->expr->tag == PRIMARY)
+                        emit_ssa_inst(current, SSA_COPY, var, value, -1);
+                    add_ssa_def(var, current);
+                    break;
+                case WHILE:
+                    block = new_ssa_block();
+                    add_ssa_edge(current, block);
+                    ssa_blocks[block].term = SSA_BRANCH;
+                    ssa_blocks[block].cond = lower_condition(block, stmt->while_stmt->condition);
+                    current = new_ssa_block();
+                    add_ssa_edge(block, current);
+                    push_ssa_frame(&top, stmt->while_stmt->body, stmt, NULL, block, -1);
+                    break;
+                case DO:
+                    block = new_ssa_block();
+                    add_ssa_edge(current, block);
+                    current = block;
+                    push_ssa_frame(&top, stmt->while_stmt->body, stmt, NULL, block, -1);
+                    break;
+                case SWITCH:
+                    ssa_blocks[current].term = SSA_SWITCH;
+                    ssa_blocks[current].cond = SSA_VAR_REF(ssa_var(stmt->switch_stmt->id));
+                    ssa_blocks[current].switch_stmt = stmt->switch_stmt;
+                    current = start_ssa_case(&top, stmt, stmt->switch_stmt->case_list, current, ssa_case_ends.count);
+                    break;
+            }
+            continue;
+        }
+
+        // The body is finished
+        frame = ssa_stack[--top];
+        if (frame.stmt == NULL)
+            continue;
+        switch (frame.stmt->stmtType)
+        {
+            case WHILE:
+                add_ssa_edge(current, frame.head);
+                current = new_ssa_block();
+                add_ssa_edge(frame.head, current);
+                break;
+            case DO:
+                ssa_blocks[current].term = SSA_BRANCH;
+                ssa_blocks[current].cond = lower_condition(current, frame.stmt->while_stmt->condition);
+                add_ssa_edge(current, frame.head);
+                block = new_ssa_block();
+                add_ssa_edge(current, block);
+                current = block;
+                break;
+            case SWITCH:
+                int_list_push(&ssa_case_ends, current);
+                if (frame.next_case != NULL)
+                {
+                    current = start_ssa_case(&top, frame.stmt, frame.next_case, frame.head, frame.ends);
+                    break;
+                }
+                // No case matches: the last successor of the switch
+                current = new_ssa_block();
+                add_ssa_edge(frame.head, current);
+                for (i = frame.ends; i < ssa_case_ends.count; i++)
+                    add_ssa_edge(ssa_case_ends.items[i], current);
+                ssa_case_ends.count = frame.ends;
+                break;
+        }
+    }
+    ssa_blocks[current].term = SSA_EXIT;
+}
+
+/* -------------------- DOMINATORS -------------------- */
+
+// Sorts the edges into ssa_succ[] and ssa_pred[], keeping the order in
+// which each block's edges were added
+void build_ssa_edges()
+{
+    int n = ssa_block_count;
+    int m = ssa_edge_from.count;
+    int* next = (int*) malloc((n + 1) * sizeof(int));
+    int* pred_next = (int*) malloc((n + 1) * sizeof(int));
+    int b, e;
+
+    ssa_succ_start = grow_ints(ssa_succ_start, 0, n + 1, 0);
+    ssa_pred_start = grow_ints(ssa_pred_start, 0, n + 1, 0);
+    ssa_succ = (int*) realloc(ssa_succ, (m + 1) * sizeof(int));
+    ssa_succ_slot = (int*) realloc(ssa_succ_slot, (m + 1) * sizeof(int));
+    ssa_pred = (int*) realloc(ssa_pred, (m + 1) * sizeof(int));
+    for (e = 0; e < m; e++)
+    {
+        ++ssa_succ_start[ssa_edge_from.items[e] + 1];
+        ++ssa_pred_start[ssa_edge_to.items[e] + 1];
+    }
+    for (b = 0; b < n; b++)
+    {
+        ssa_succ_start[b + 1] += ssa_succ_start[b];
+        ssa_pred_start[b + 1] += ssa_pred_start[b];
+    }
+    memcpy(next, ssa_succ_start, (n + 1) * sizeof(int));
+    memcpy(pred_next, ssa_pred_start, (n + 1) * sizeof(int));
+    for (e = 0; e < m; e++)
+    {
+        int from = ssa_edge_from.items[e];
+        int to = ssa_edge_to.items[e];
+
+        ssa_succ_slot[next[from]] = pred_next[to] - ssa_pred_start[to];
+        ssa_succ[next[from]++] = to;
+        ssa_pred[pred_next[to]++] = from;
+    }
+    free(next);
+    free(pred_next);
+}
+
+int* ssa_postorder; // postorder number of each block, -1 if unreachable
+int* ssa_rpo;       // reachable blocks in reverse postorder
+int ssa_rpo_count;
+
+// Numbers the blocks reachable from the entry in postorder
+void number_ssa_blocks()
+{
+    int n = ssa_block_count;
+    int* stack = (int*) malloc(n * sizeof(int));
+    int* next_edge = (int*) malloc(n * sizeof(int));
+    int top = 0;
+    int count = 0;
+    int b, s;
+
+    ssa_postorder = grow_ints(ssa_postorder, 0, n, -1);
+    ssa_rpo = (int*) realloc(ssa_rpo, n * sizeof(int));
+    for (b = 0; b < n; b++)
+        next_edge[b] = -1;
+    stack[top++] = 0;
+    next_edge[0] = ssa_succ_start[0];
+    while (top > 0)
+    {
+        b = stack[top - 1];
+        if (next_edge[b] < ssa_succ_start[b + 1])
+        {
+            s = ssa_succ[next_edge[b]++];
+            if (next_edge[s] < 0)
+            {
+                next_edge[s] = ssa_succ_start[s];
+                stack[top++] = s;
+            }
+            continue;
+        }
+        --top;
+        ssa_postorder[b] = count++;
+    }
+    ssa_rpo_count = count;
+    for (b = 0; b < n; b++)
+    {
+        if (ssa_postorder[b] >= 0)
+            ssa_rpo[count - 1 - ssa_postorder[b]] = b;
+    }
+    free(stack);
+    free(next_edge);
+}
+
+int intersect_doms(int a, int b)
+{
+    while (a != b)
+    {
+        while (ssa_postorder[a] < ssa_postorder[b])
+            a = ssa_blocks[a].idom;
+        while (ssa_postorder[b] < ssa_postorder[a])
+            b = ssa_blocks[b].idom;
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm". The
+// entry is its own idom while this runs. Structured programs like these
+// need two passes over the blocks.
+void find_dominators()
+{
+    int changed = TRUE;
+    int i, k, b, p, idom;
+
+    ssa_blocks[0].idom = 0;
+    while (changed)
+    {
+        changed = FALSE;
+        for (i = 1; i < ssa_rpo_count; i++)
+        {
+            b = ssa_rpo[i];
+            idom = -1;
+            for (k = ssa_pred_start[b]; k < ssa_pred_start[b + 1]; k++)
+            {
+                p = ssa_pred[k];
+                if (ssa_blocks[p].idom < 0)
+                    continue;
+                idom = (idom < 0) ? p : intersect_doms(p, idom);
+            }
+            if (ssa_blocks[b].idom != idom)
+            {
+                ssa_blocks[b].idom = idom;
+                changed = TRUE;
             }
+        }
+    }
+}
+
+// The dominance frontier of each block, as lists linked through
+// ssa_frontier_next[]
+struct int_list ssa_frontier_block;
+struct int_list ssa_frontier_next;
+int* ssa_frontier_head;
+
+void find_frontiers()
+{
+    int n = ssa_block_count;
+    int* last = (int*) malloc(n * sizeof(int));
+    int b, k, runner;
 
-            // Print out vars after          
-            for (j = i; j < (5 + new_types); j++)
+    ssa_frontier_head = grow_ints(ssa_frontier_head, 0, n, -1);
+    for (b = 0; b < n; b++)
+        last[b] = -1;
+    for (b = 0; b < n; b++)
+    {
+        if (ssa_pred_start[b + 1] - ssa_pred_start[b] < 2 || ssa_blocks[b].idom < 0)
+            continue;
+        for (k = ssa_pred_start[b]; k < ssa_pred_start[b + 1]; k++)
+        {
+            runner = ssa_pred[k];
+            if (ssa_postorder[runner] < 0)
+                continue;
+            while (runner != ssa_blocks[b].idom && last[runner] != b)
             {
-                 if((type_array[j] == 0) && (table[j]->flag == 1) && (table[j]->type_number == table[i]->type_number))
-                 {
-                    printf(" %s", table[j]->id);
-                    type_array[j] = 1;
-                 }
+                last[runner] = b;
+                int_list_push(&ssa_frontier_block, b);
+                int_list_push(&ssa_frontier_next, ssa_frontier_head[runner]);
+                ssa_frontier_head[runner] = ssa_frontier_block.count - 1;
+                runner = ssa_blocks[runner].idom;
             }
-            printf(" #\n");
         }
     }
-    return 0;
+    free(last);
+}
+
+/* -------------------- PLACING PHIS -------------------- */
+
+// Marks the variables that some block reads before it assigns them.
+// Only these need phis, the others never live from one block into another.
+int* find_live_in_vars()
+{
+    int* live_in = grow_ints(NULL, 0, ssa_var_count + 1, FALSE);
+    int* assigned = grow_ints(NULL, 0, ssa_var_count + 1, -1);
+    struct ssa_inst* inst;
+    int b, i, operand, k;
+
+    for (b = 0; b < ssa_block_count; b++)
+    {
+        for (i = ssa_blocks[b].first; i >= 0; i = inst->next)
+        {
+            inst = &ssa_insts[i];
+            for (k = 0; k < 2; k++)
+            {
+                operand = (k == 0) ? inst->a : inst->b;
+                if (inst->op == SSA_CONST || operand > -2)
+                    continue;
+                if (assigned[-2 - operand] != b)
+                    live_in[-2 - operand] = TRUE;
+            }
+            if (inst->var >= 0)
+                assigned[inst->var] = b;
+        }
+        operand = ssa_blocks[b].cond;
+        if (operand <= -2 && assigned[-2 - operand] != b)
+            live_in[-2 - operand] = TRUE;
+    }
+    free(assigned);
+    return live_in;
+}
+
+// Adds a phi for var at the start of block
+void add_phi(int block, int var)
+{
+    int count = ssa_pred_start[block + 1] - ssa_pred_start[block];
+    int i = new_ssa_inst(SSA_PHI, var, ssa_phi_arg_count, count);
+    int k;
+
+    if (ssa_phi_arg_count + count > ssa_phi_arg_capacity)
+    {
+        ssa_phi_arg_capacity = 2 * (ssa_phi_arg_count + count);
+        ssa_phi_args = (int*) realloc(ssa_phi_args, ssa_phi_arg_capacity * sizeof(int));
+    }
+    for (k = 0; k < count; k++)
+        ssa_phi_args[ssa_phi_arg_count + k] = -1;
+    ssa_phi_arg_count += count;
+    ssa_insts[i].block = block;
+    ssa_insts[i].next = ssa_blocks[block].first;
+    ssa_blocks[block].first = i;
+    if (ssa_blocks[block].last < 0)
+        ssa_blocks[block].last = i;
+}
+
+// Places the phis of every variable on the iterated dominance frontier
+// of the blocks that assign it
+void place_phis()
+{
+    int n = ssa_block_count;
+    int* live_in = find_live_in_vars();
+    int* has_phi = grow_ints(NULL, 0, n, -1);
+    int* queued = grow_ints(NULL, 0, n, -1);
+    struct int_list work = { NULL, 0, 0 };
+    int var, d, f, b, y;
+
+    for (var = 0; var < ssa_var_count; var++)
+    {
+        if (!live_in[var] || var >= ssa_def_capacity)
+            continue;
+        for (d = ssa_def_head[var]; d >= 0; d = ssa_def_next.items[d])
+        {
+            queued[ssa_def_block.items[d]] = var;
+            int_list_push(&work, ssa_def_block.items[d]);
+        }
+        while (work.count > 0)
+        {
+            b = work.items[--work.count];
+            for (f = ssa_frontier_head[b]; f >= 0; f = ssa_frontier_next.items[f])
+            {
+                y = ssa_frontier_block.items[f];
+                if (has_phi[y] == var)
+                    continue;
+                has_phi[y] = var;
+                add_phi(y, var);
+                if (queued[y] != var)
+                {
+                    queued[y] = var;
+                    int_list_push(&work, y);
+                }
+            }
+        }
+    }
+    free(live_in);
+    free(has_phi);
+    free(queued);
+    free(work.items);
+}
+
+/* -------------------- RENAMING -------------------- */
+
+int* ssa_current;   // value of each variable at the point being renamed, -1 if unassigned
+int* ssa_param;     // SSA_PARAM of each variable, -1 until it is needed
+int* ssa_versions;  // versions given out for each variable
+
+// Returns the value that operand stands for
+int resolve_operand(int operand)
+{
+    int var;
+
+    if (operand > -2)
+        return operand;
+    var = -2 - operand;
+    if (ssa_current[var] >= 0)
+        return ssa_current[var];
+    if (ssa_param[var] < 0)
+        ssa_param[var] = new_ssa_inst(SSA_PARAM, var, -1, -1);
+    return ssa_param[var];
+}
+
+// Renames the variables of the blocks in a preorder walk of the dominator
+// tree. Assignments are undone when the walk leaves the block that made
+// them, from the (variable, previous value) pairs in undo.
+void rename_ssa_vars()
+{
+    int n = ssa_block_count;
+    int* child_start = grow_ints(NULL, 0, n + 1, 0);
+    int* child_end = (int*) malloc((n + 1) * sizeof(int));
+    int* children = (int*) malloc((n + 1) * sizeof(int));
+    int* stack = (int*) malloc(2 * (n + 1) * sizeof(int));
+    struct int_list undo = { NULL, 0, 0 };
+    struct ssa_inst* inst;
+    int top = 0;
+    int b, i, k, s, slot, p;
+
+    ssa_current = grow_ints(ssa_current, 0, ssa_var_count + 1, -1);
+    ssa_param = grow_ints(ssa_param, 0, ssa_var_count + 1, -1);
+    ssa_versions = grow_ints(ssa_versions, 0, ssa_var_count + 1, 0);
+
+    // Children of each block in the dominator tree
+    for (b = 1; b < n; b++)
+    {
+        if (ssa_blocks[b].idom >= 0)
+            ++child_start[ssa_blocks[b].idom + 1];
+    }
+    for (b = 0; b < n; b++)
+        child_start[b + 1] += child_start[b];
+    memcpy(child_end, child_start, (n + 1) * sizeof(int));
+    for (b = 1; b < n; b++)
+    {
+        if (ssa_blocks[b].idom >= 0)
+            children[child_end[ssa_blocks[b].idom]++] = b;
+    }
+
+    // An entry ~m leaves a block, m is where its undo records start
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        b = stack[--top];
+        if (b < 0)
+        {
+            for (k = undo.count - 2; k >= ~b; k -= 2)
+                ssa_current[undo.items[k]] = undo.items[k + 1];
+            undo.count = ~b;
+            continue;
+        }
+        stack[top++] = ~undo.count;
+        for (i = ssa_blocks[b].first; i >= 0; i = inst->next)
+        {
+            inst = &ssa_insts[i];
+            if (inst->op != SSA_PHI)
+            {
+                inst->a = resolve_operand(inst->a);
+                inst->b = resolve_operand(inst->b);
+                inst = &ssa_insts[i]; // resolve_operand() may add a SSA_PARAM
+            }
+            if (inst->var >= 0)
+            {
+                int_list_push(&undo, inst->var);
+                int_list_push(&undo, ssa_current[inst->var]);
+                ssa_current[inst->var] = i;
+                inst->version = ++ssa_versions[inst->var];
+            }
+        }
+        ssa_blocks[b].cond = resolve_operand(ssa_blocks[b].cond);
+
+        // Fill in this block's argument of the phis of its successors
+        for (k = ssa_succ_start[b]; k < ssa_succ_start[b + 1]; k++)
+        {
+            s = ssa_succ[k];
+            slot = ssa_succ_slot[k];
+            for (p = ssa_blocks[s].first; p >= 0 && ssa_insts[p].op == SSA_PHI; p = ssa_insts[p].next)
+                ssa_phi_args[ssa_insts[p].a + slot] = resolve_operand(SSA_VAR_REF(ssa_insts[p].var));
+        }
+        for (k = child_start[b + 1] - 1; k >= child_start[b]; k--)
+            stack[top++] = children[k];
+    }
+    free(child_start);
+    free(child_end);
+    free(children);
+    free(stack);
+    free(undo.items);
+}
+
+/* -------------------- BUILDING AND PRINTING -------------------- */
+
+// Lowers body to SSA form in the arrays of this section, replacing what
+// an earlier call built
+void build_ssa(struct bodyNode* body)
+{
+    int b;
+
+    ssa_inst_count = 0;
+    ssa_block_count = 0;
+    ssa_phi_arg_count = 0;
+    ssa_constant_count = 0;
+    ssa_edge_from.count = 0;
+    ssa_edge_to.count = 0;
+    ssa_def_block.count = 0;
+    ssa_def_next.count = 0;
+    ssa_frontier_block.count = 0;
+    ssa_frontier_next.count = 0;
+    for (b = 0; b < ssa_def_capacity; b++)
+    {
+        ssa_def_head[b] = -1;
+        ssa_def_last[b] = -1;
+    }
+
+    lower_body(body);
+    build_ssa_edges();
+    number_ssa_blocks();
+    find_dominators();
+    find_frontiers();
+    place_phis();
+    rename_ssa_vars();
+    ssa_blocks[0].idom = -1;
+}
+
+// Writes the name of value through the output buffer, see PRINTING THE TYPES
+void output_value(int value)
+{
+    char text[64];
+    struct ssa_inst* inst;
+
+    if (value < 0)
+    {
+        output_string("?");
+        return;
+    }
+    inst = &ssa_insts[value];
+    if (inst->var >= 0)
+    {
+        output_string(ssa_var_names[inst->var]);
+        snprintf(text, sizeof(text), ".%d", inst->version);
+    }
+    else if (inst->op != SSA_CONST)
+        snprintf(text, sizeof(text), "%%%d", value);
+    else if (ssa_constants[inst->a]->tag == NUM)
+        snprintf(text, sizeof(text), "%d", ssa_constants[inst->a]->ival);
+    else
+        snprintf(text, sizeof(text), "%.4f", ssa_constants[inst->a]->fval);
+    output_string(text);
+}
+
+void output_block(const char* before, int block)
+{
+    char text[32];
+
+    snprintf(text, sizeof(text), "%sB%d", before, block);
+    output_string(text);
+}
+
+// Prints every block with its predecessors and immediate dominator, its
+// instructions and its terminator, for example
+//
+//   B1: preds B0 B2; idom B0
+//       i.2 = phi(i.1 B0, i.3 B2)
+//       %5 = i.2 < n.0
+//       if %5 goto B2 else B3
+void print_ssa()
+{
+    struct ssa_inst* inst;
+    struct case_listNode* cases;
+    char text[32];
+    int b, i, k;
+
+    for (b = 0; b < ssa_block_count; b++)
+    {
+        output_block("", b);
+        output_string(":");
+        if (ssa_pred_start[b] < ssa_pred_start[b + 1])
+        {
+            output_string(" preds");
+            for (k = ssa_pred_start[b]; k < ssa_pred_start[b + 1]; k++)
+                output_block(" ", ssa_pred[k]);
+            output_string(";");
+        }
+        if (ssa_blocks[b].idom >= 0)
+            output_block(" idom ", ssa_blocks[b].idom);
+        output_string("\n");
+
+        for (i = ssa_blocks[b].first; i >= 0; i = inst->next)
+        {
+            inst = &ssa_insts[i];
+            output_string("    ");
+            output_value(i);
+            output_string(" = ");
+            if (inst->op == SSA_PHI)
+            {
+                output_string("phi(");
+                for (k = 0; k < inst->b; k++)
+                {
+                    if (k > 0)
+                        output_string(", ");
+                    output_value(ssa_phi_args[inst->a + k]);
+                    output_block(" ", ssa_pred[ssa_pred_start[b] + k]);
+                }
+                output_string(")");
+            }
+            else if (inst->op == SSA_COPY)
+                output_value(inst->a);
+            else
+            {
+                output_value(inst->a);
+                output_string(" ");
+                output_string(reserved[inst->op]);
+                output_string(" ");
+                output_value(inst->b);
+            }
+            output_string("\n");
+        }
+
+        k = ssa_succ_start[b];
+        switch (ssa_blocks[b].term)
+        {
+            case SSA_JUMP:
+                output_block("    goto ", ssa_succ[k]);
+                break;
+            case SSA_BRANCH:
+                output_string("    if ");
+                output_value(ssa_blocks[b].cond);
+                output_block(" goto ", ssa_succ[k]);
+                output_block(" else ", ssa_succ[k + 1]);
+                break;
+            case SSA_SWITCH:
+                output_string("    switch ");
+                output_value(ssa_blocks[b].cond);
+                for (cases = ssa_blocks[b].switch_stmt->case_list; cases != NULL; cases = cases->case_list)
+                {
+                    snprintf(text, sizeof(text), ", %d:", cases->cas->num);
+                    output_string(text);
+                    output_block(" ", ssa_succ[k++]);
+                }
+                output_block(", else ", ssa_succ[k]);
+                break;
+            case SSA_EXIT:
+                output_string("    exit");
+                break;
+        }
+        output_string("\n");
+    }
+    flush_output();
+}
+
+// Usage: a.out [-r] [-S] [-j number_of_threads] [-w tree_file] [-l tree_file] < program
+//        a.out -i program < edits
+// A build with -DSTATS also takes -s stats_file, see STATISTICS SECTION
+int main(int argc, char* argv[])
+{
+    struct programNode* parseTree;
+    int number_of_threads = 1;
+    char* write_path = NULL; // -w, save the parse tree
+    char* load_path = NULL;  // -l, check a saved parse tree instead of stdin
+    int ssa_form = FALSE;    // -S, print the SSA form instead of the types
+    struct ast_file loaded;
+    int i;
+
+    STAT_SWITCH(PHASE_OTHER);
+    source = stdin;
+    sequential_context.memoize = TRUE;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            number_of_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0)
+            recover_errors = TRUE;
+        else if (strcmp(argv[i], "-S") == 0)
+            ssa_form = TRUE;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            write_path = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            load_path = argv[++i];
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            return incremental_session(argv[++i]);
+#ifdef STATS
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            stat_path = argv[++i];
+            atexit(write_stats);
+        }
+#endif
+        else
+        {
+            printf("Usage: %s [-r] [-S] [-j number_of_threads] [-w tree_file] [-l tree_file] < program\n"
+                   "       %s -i program < edits\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    // With -r every syntax error is printed and the statements and
+    // declarations that do parse are checked
+    STAT_SWITCH(PHASE_PARSE);
+    if (load_path != NULL)
+    {
+        if (load_ast(load_path, &loaded) < 0)
+        {
+            printf("Cannot load parse tree from %s\n", load_path);
+            return 1;
+        }
+        parseTree = link_ast(&loaded);
+    }
+    else
+        parseTree = program();
+    STAT_SWITCH(PHASE_OUTPUT);
+    if (write_path != NULL && write_ast(write_path, parseTree) < 0)
+    {
+        printf("Cannot write parse tree to %s\n", write_path);
+        return 1;
+    }
+    if (ssa_form)
+    {
+        build_ssa(parseTree->body);
+        print_ssa();
+        return (syntax_errors > 0) ? 1 : 0;
+    }
+
+    // TODO: remove the next line after you complete the parser
+    // This is just for debugging purposes
+    //print_parse_tree(parseTree);
+
+    STAT_SWITCH(PHASE_DECLS);
+    create_builtin_types();
+
+    // Check the TYPE and VAR sections if they exist
+    if (parseTree->decl->type_decl_section != NULL)
+    {
+        if (process_type_decl_section(parseTree->decl->type_decl_section) < 0)
+            return 1;
+    }
+    if (parseTree->decl->var_decl_section != NULL)
+    {
+        if (process_var_decl_section(parseTree->decl->var_decl_section) < 0)
+            return 1;
+    }
+
+    // Check the statements inside the body
+    STAT_SWITCH(PHASE_BODY);
+    if (process_body_parallel(parseTree->body, number_of_threads) < 0)
+        return 1;
+
+    // If there are no semantic errors, print out the types. With -r the
+    // tree may be partial, the types are printed but the run still fails
+    STAT_SWITCH(PHASE_OUTPUT);
+    print_types();
+    return (syntax_errors > 0) ? 1 : 0;
 }
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Runs ./a.out on generated programs that nest statements or expressions
+# 1M levels deep. None of them may overflow the C stack.
+
+N=${1:-1000000}
+
+gen_while() { awk -v n=$N 'BEGIN { printf "{\n"; for (i = 0; i < n; i++) printf "WHILE x < y {\n"; printf "x = 1;\n"; for (i = 0; i < n; i++) printf "}\n"; printf "}\n" }'; }
+gen_do() { awk -v n=$N 'BEGIN { printf "{\n"; for (i = 0; i < n; i++) printf "DO {\n"; printf "x = 1;\n"; for (i = 0; i < n; i++) printf "} WHILE x < y;\n"; printf "}\n" }'; }
+gen_switch() { awk -v n=$N 'BEGIN { printf "{\n"; for (i = 0; i < n; i++) printf "SWITCH s { CASE %d: {\n", i; printf "x = 2.5;\n"; for (i = 0; i < n; i++) printf "} }\n"; printf "}\n" }'; }
+gen_operands() { awk -v n=$N 'BEGIN { printf "{\nx = a"; for (i = 0; i < n; i++) printf " + a"; printf " * 1;\n}\n" }'; }
+gen_parens() { awk -v n=$N 'BEGIN { printf "{\nx = "; for (i = 0; i < n; i++) printf "(a + "; printf "1.0"; for (i = 0; i < n; i++) printf ")"; printf ";\n}\n" }'; }
+
+expected_while="INT : x y #"
+expected_do="INT : x y #"
+expected_switch="INT : s #
+REAL : x #"
+expected_operands="INT : x a #"
+expected_parens="REAL : x a #"
+
+let count=0;
+for t in while do switch operands parens; do
+	echo "========================================================";
+	echo "STRESS:" $t "($N levels)";
+	echo "========================================================";
+	output=$(gen_$t | ./a.out)
+	expected=expected_$t
+	if [ "$output" == "${!expected}" ]; then
+		count=$((count+1));
+		echo "NO ERRORS HERE!";
+	else
+		echo "expected:"; echo "${!expected}";
+		echo "--------------------------------------------------------";
+		echo "got:"; echo "$output";
+	fi
+done
+
+echo $count;
@@ -60,24 +60,27 @@ struct type_nameNode
 
 struct id_listNode
 {
-    char * id;
-    struct id_listNode* id_list;
+    int count;
+    char** ids; // count ids in one contiguous array
 };
 
 struct bodyNode
 {
     struct stmt_listNode* stmt_list;
+    int span; // tokens of the body in incremental mode, 0 otherwise
 };
 
 struct stmt_listNode
 {
-    struct stmtNode* stmt;
-    struct stmt_listNode * stmt_list;
+    int count;
+    struct stmtNode** stmts; // count statements in one contiguous array
+    int capacity;            // room in stmts after an edit in incremental mode, 0 otherwise
 };
 
 struct stmtNode
 {
     int stmtType; // WHILE, ASSIGN, DO, or SWITCH
+    int span; // tokens of the statement in incremental mode, 0 otherwise
 
     // Note that while_stmt should be used for both
     // DO and WHILE statement types
@@ -113,17 +116,32 @@ struct exprNode
 {
     int op; // PLUS , MINUS, MULT, ... or NOOP
     int tag; // PRIMARY or EXPR
-    struct primaryNode* primary;
-    struct exprNode * leftOperand;
-    struct exprNode * rightOperand;
+    int type; // type number found by the sequential checker or -1
+
+    // Only primary is used when tag is PRIMARY and only
+    // the two operands are used when tag is EXPR
+    union
+    {
+        struct primaryNode* primary;
+        struct
+        {
+            struct exprNode * leftOperand;
+            struct exprNode * rightOperand;
+        };
+    };
 };
 
 struct primaryNode
 {
     int tag; // NUM, REALNUM or ID
-    int ival;
-    float fval;
-    char *id;
+
+    // Only the field that matches tag is meaningful
+    union
+    {
+        int ival;
+        float fval;
+        char *id;
+    };
 };
 
 struct caseNode
@@ -144,6 +162,14 @@ struct switch_stmtNode
     struct case_listNode* case_list;
 };
 
+// Type numbers of the built-in types, every other type
+// number is a type variable created by new_type_var()
+#define INT_TYPE     10
+#define REAL_TYPE    11
+#define STRING_TYPE  12
+#define BOOLEAN_TYPE 13
+#define LONG_TYPE    14
+
 struct symbol
 {
     char* id;
@@ -154,7 +180,16 @@ struct symbol
 
 /* -------------------- PARSE TREE FUNCTIONS -------------------- */
 
-#define ALLOC(t) (t*) calloc(1, sizeof(t))
+// Parse tree nodes are allocated from an arena and are never freed
+#define ALLOC(t) (t*) arena_alloc(sizeof(t))
+
+void* arena_alloc(size_t size);
+char* arena_strdup(const char* s);
+char* intern_id(const char* s);
+
+// Expressions are hash-consed, equal subexpressions are the same node
+struct exprNode* make_primary(int tag, const char* lexeme);
+struct exprNode* make_expr(int op, struct exprNode* left, struct exprNode* right);
 
 void print_decl(struct declNode* dec);
 void print_body(struct bodyNode* body);
@@ -183,6 +218,8 @@ void print_switch_stmt(struct switch_stmtNode* switc);
 
 /* -------------------- PARSING FUNCTIONS -------------------- */
 
+struct stmt_range; // see INCREMENTAL CHECKING
+
 struct programNode*           program();
 struct declNode*              decl();
 struct type_decl_sectionNode* type_decl_section();
@@ -194,17 +231,320 @@ struct type_declNode*         type_decl();
 struct id_listNode*           id_list();
 struct type_nameNode*         type_name();
 struct bodyNode*              body();
-struct stmt_listNode*         stmt_list();
+struct bodyNode*              parse_body(struct stmt_range* range);
 struct stmtNode*              stmt();
 struct while_stmtNode*        while_stmt();
 struct assign_stmtNode*       assign_stmt();
 struct exprNode*              expr();
-struct exprNode*              term();
-struct exprNode*              factor();
 struct conditionNode*         condition();
 struct primaryNode*           primary();
 struct caseNode*              cas();
 struct case_listNode*         case_list();
 struct switch_stmtNode*       switch_stmt();
 struct while_stmtNode*        do_stmt();
+void                          do_condition(struct while_stmtNode* doStmt);
+void                          skip_statement();
+void                          skip_declaration();
+
+/* -------------------- BINARY PARSE TREE -------------------- */
+
+// A parse tree file is an ast_header followed by one array per record
+// type and a pool of NUL terminated strings. Records refer to each other
+// by index and to strings by byte offset into the pool, never by address,
+// so a file can be mapped anywhere and read in place. All fields are
+// native-endian ints.
+
+#define AST_MAGIC   "P3AST"
+#define AST_VERSION 1
+
+#define AST_EXPRS      0
+#define AST_STMTS      1
+#define AST_CONDITIONS 2
+#define AST_BODIES     3
+#define AST_CASES      4
+#define AST_DECLS      5
+#define AST_ITEMS      6
+#define AST_STRINGS    7
+#define AST_SECTIONS   8
+
+struct ast_header
+{
+    char magic[8];
+    int version;
+    int body;       // index of the body of the program
+    int type_decls; // type_decls at the start of the decl array, -1 without a TYPE section
+    int var_decls;  // var_decls that follow them, -1 without a VAR section
+    int counts[AST_SECTIONS];  // records in each array, bytes for AST_STRINGS
+    int offsets[AST_SECTIONS]; // from the start of the file
+};
+
+// PRIMARY: a is NUM, REALNUM or ID and b is the int, the float bits or
+// the string. EXPR: a and b are the operands. Shared subexpressions
+// are stored once.
+struct ast_expr
+{
+    int op;
+    int tag;
+    int a;
+    int b;
+};
+
+struct ast_primary
+{
+    int tag; // NUM, REALNUM or ID, 0 for the missing right operand
+    int value;
+};
+
+struct ast_condition
+{
+    int relop;
+    struct ast_primary left;
+    struct ast_primary right;
+};
+
+// ASSIGN: a is the id and b the expr. WHILE and DO: a is the condition
+// and b the body. SWITCH: a is the id, b the first case and c the
+// number of cases.
+struct ast_stmt
+{
+    int type;
+    int a;
+    int b;
+    int c;
+};
+
+struct ast_body
+{
+    int first; // statements are stmts first to first + count - 1
+    int count;
+};
+
+struct ast_case
+{
+    int num;
+    int body;
+};
+
+struct ast_decl
+{
+    int first; // ids are items first to first + count - 1
+    int count;
+    int type;  // type_name, as in type_nameNode
+    int id;    // string for an ID type_name, -1 otherwise
+};
+
+// A mapped parse tree file
+struct ast_file
+{
+    const struct ast_header* header;
+    const struct ast_expr* exprs;
+    const struct ast_stmt* stmts;
+    const struct ast_condition* conditions;
+    const struct ast_body* bodies;
+    const struct ast_case* cases;
+    const struct ast_decl* decls;
+    const int* items;
+    const char* strings;
+    size_t size;
+};
+
+int  write_ast(const char* path, struct programNode* program);
+int  load_ast(const char* path, struct ast_file* file);
+struct programNode* link_ast(const struct ast_file* file);
+
+/* -------------------- INCREMENTAL CHECKING -------------------- */
+
+// Statements of an open body that are parsed again after an edit. Token
+// positions are indexes into tokens[] after the edit.
+struct stmt_range
+{
+    struct stmtNode** old; // statements of the body before the edit
+    int old_count;
+    int next_old;          // old statements before this one cannot be reached
+    int min_stop;          // the statements must cover the edit, up to here
+    int body_end;          // RBRACE of the body
+    int reached;           // old statement the parse stopped at, or old_count
+    int failed;            // the statements do not end inside the body
+};
+
+int  new_span(int first, int last, struct stmtNode* stmt);
+int  range_stop(struct stmt_range* range);
+void log_syntax_error(const char* msg);
+int  incremental_session(const char* path);
+
+/* -------------------- TYPE CHECKING TYPES -------------------- */
+
+// An operator whose operands are still being checked
+struct expr_frame
+{
+    struct exprNode* expr;
+    int state; // 0 while checking the left operand, 1 for the right one
+};
+
+// A body whose statements are being checked
+struct check_frame
+{
+    struct bodyNode* body;
+    int next;                        // index of the next statement to check
+    int end;                         // index after the last statement to check
+    struct stmtNode* stmt;           // statement that owns the body or NULL
+    struct case_listNode* next_case; // for SWITCH, the case to check after this body
+};
+
+// Thread-local type variables of a region that is checked in parallel
+struct partition
+{
+    // union-find over local type variables
+    int* parent;
+    int* rank;
+    int* builtin;
+    int* global;   // global type number of each local one, -1 for new ids
+    int count;
+    int capacity;
+
+    int* local_of; // global type number -> local type number + 1, 0 if unused
+    int global_count;
+
+    // Variables that are not in the symbol table, in order of first use
+    char** new_ids;
+    int* new_types;
+    int new_count;
+    int* new_hash;
+    int new_hash_size;
+
+    int error;     // first error code, 0 if there is none
+};
+
+struct check_context
+{
+    struct expr_frame* expr_stack;
+    int expr_capacity;
+    int* operand_types;
+    int operand_capacity;
+    struct check_frame* check_stack;
+    int check_capacity;
+
+    struct partition* partition; // NULL when checking sequentially
+    int memoize; // expression types may be remembered, see process_expr()
+    int silent;  // errors are not printed, see the INCREMENTAL SECTION
+};
+
+/* -------------------- TYPE CHECKING FUNCTIONS -------------------- */
+
+unsigned int hash_string(const char* s);
+int  lookup_symbol(const char* id);
+int  add_symbol(const char* id, int type_number, int where, int flag);
+void truncate_symbols(int count);
+
+int  new_type_var();
+int  find_type(int t);
+int  unify(int first, int second);
+
+int  partition_type(struct partition* p, int t);
+int  partition_new_id(struct partition* p, char* id);
+int  partition_unify(struct partition* p, int first, int second);
+
+int  process_id(struct check_context* ctx, char* current_id);
+int  process_prim(struct check_context* ctx, struct primaryNode* prim);
+int  process_expr(struct check_context* ctx, struct exprNode* expr);
+int  process_assign(struct check_context* ctx, struct assign_stmtNode* assign_stmt);
+int  process_condition(struct check_context* ctx, struct conditionNode* condition);
+int  process_switch(struct check_context* ctx, struct switch_stmtNode* swi);
+int  process_stmts(struct check_context* ctx, struct bodyNode* body, int first, int end);
+int  process_body(struct bodyNode* body);
+int  process_body_parallel(struct bodyNode* body, int number_of_threads);
+int  process_type_name(struct type_nameNode* type_name);
+int  process_type_decl_section(struct type_decl_sectionNode* typeDeclSection);
+int  process_var_decl_section(struct var_decl_sectionNode* varDeclSection);
+void create_builtin_types();
+void print_types();
+
+/* -------------------- SSA FORM -------------------- */
+
+// Operations of SSA instructions besides PLUS, MINUS, MULT, DIV and the
+// relational operators
+#define SSA_PARAM 200 // value of a variable when the program starts
+#define SSA_CONST 201 // a NUM or REALNUM
+#define SSA_COPY  202 // the value of operand a
+#define SSA_PHI   203
+
+// Terminators of basic blocks
+#define SSA_JUMP   210 // to the only successor
+#define SSA_BRANCH 211 // to the first successor if cond holds, else to the second
+#define SSA_SWITCH 212 // to the successor of the case equal to cond, the last one if none is
+#define SSA_EXIT   213
+
+// The index of an instruction in ssa_insts[] is the value it defines
+struct ssa_inst
+{
+    int op;
+    int var;     // variable this value is assigned to, or -1 for a temporary
+    int version; // of var, the SSA_PARAM of a variable is version 0
+    int a, b;    // operand values; for SSA_CONST a indexes ssa_constants[],
+                 // for SSA_PHI a indexes ssa_phi_args[] and b is the count
+    int block;   // -1 for SSA_PARAM and SSA_CONST, which are in no block
+    int next;    // next instruction of the block or -1
+};
+
+struct ssa_block
+{
+    int first, last; // instructions, phis first, -1 if there are none
+    int term;        // SSA_JUMP, SSA_BRANCH, SSA_SWITCH or SSA_EXIT
+    int cond;        // value tested by SSA_BRANCH and SSA_SWITCH
+    struct switch_stmtNode* switch_stmt; // case numbers of SSA_SWITCH
+    int idom;        // immediate dominator, -1 for the entry block and unreachable blocks
+};
+
+void build_ssa(struct bodyNode* body);
+void print_ssa();
+
+/* -------------------- STATISTICS -------------------- */
+
+// Built with -DSTATS (make stats) the checker times its phases and counts
+// the work done on its hot paths. Without it the STAT_ macros expand to
+// nothing and cost nothing.
+
+enum stat_phase
+{
+    PHASE_OTHER,  // startup and anything not listed below
+    PHASE_LEX,    // reading tokens
+    PHASE_PARSE,  // building the parse tree, without the time spent lexing
+    PHASE_DECLS,  // the TYPE and VAR sections
+    PHASE_BODY,   // checking the statements
+    PHASE_OUTPUT, // printing the types and writing parse trees
+    NUMBER_OF_PHASES
+};
+
+enum stat_counter
+{
+    COUNT_TOKENS,
+    COUNT_SYMBOL_LOOKUPS,
+    COUNT_SYMBOL_PROBES, // occupied slots of symbol_hash[] compared
+    COUNT_FIND_TYPE,
+    COUNT_UNIFY,         // unify() and partition_unify()
+    COUNT_ARENA_ALLOCS,
+    COUNT_ARENA_BYTES,
+    COUNT_ARENA_BLOCKS,
+    NUMBER_OF_COUNTERS
+};
+
+#ifdef STATS
+
+int  stat_switch(int phase);
+void write_stats();
+
+// Counters are bumped from the checking threads too
+#define STAT_ADD(counter, n) __atomic_fetch_add(&stat_counts[counter], (n), __ATOMIC_RELAXED)
+// Charges the time from here on to phase until STAT_SWITCH or STAT_LEAVE
+#define STAT_SWITCH(phase) stat_switch(phase)
+#define STAT_ENTER(phase)  int stat_saved_phase = stat_switch(phase)
+#define STAT_LEAVE()       stat_switch(stat_saved_phase)
+
+#else
+
+#define STAT_ADD(counter, n)
+#define STAT_SWITCH(phase)
+#define STAT_ENTER(phase)
+#define STAT_LEAVE()
 
+#endif
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements the batch runner declared in
+//  batch.h. The lexer, the parser, the optimizer and the output
+//  buffer keep their state in thread local variables, so each
+//  worker parses, optimizes and runs a whole program on its own.
+//  Workers take the next program from a shared counter.
+//--------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "batch.h"
+#include "code_graph.h"
+#include "output.h"
+
+struct Result
+{
+    char* output;   // what the program printed
+    size_t length;
+    int error;      // errno when the file could not be opened
+};
+
+static char** files = NULL;
+static int number_of_files = 0;
+static struct Result* results = NULL;
+
+// The next program for a worker to take
+static int next_file = 0;
+
+static long long now()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void run_file(int i)
+{
+    FILE* file = fopen(files[i], "r");
+
+    if (file == NULL)
+    {
+        results[i].error = errno;
+        return;
+    }
+    start_input(file);
+    run_program(parse_generate_intermediate_representation());
+    fclose(file);
+    results[i].output = take_output(&results[i].length);
+    reset_slots();
+}
+
+static void* worker(void* unused)
+{
+    int i;
+
+    capture_output();
+    while ((i = __atomic_fetch_add(&next_file, 1, __ATOMIC_RELAXED)) < number_of_files)
+        run_file(i);
+    return NULL;
+}
+
+void run_batch(char** names, int count, int threads)
+{
+    pthread_t* pool = malloc(threads * sizeof(pthread_t));
+    long long start = now();
+    double seconds;
+    int i;
+
+    files = names;
+    number_of_files = count;
+    results = calloc(count, sizeof(struct Result));
+    next_file = 0;
+
+    for (i = 0; i < threads; i++)
+    {
+        if (pthread_create(&pool[i], NULL, worker, NULL) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < threads; i++)
+        pthread_join(pool[i], NULL);
+    seconds = (now() - start) / 1e9;
+
+    for (i = 0; i < count; i++)
+    {
+        if (results[i].error != 0)
+        {
+            fflush(stdout);
+            fprintf(stderr, "%s: %s\n", files[i], strerror(results[i].error));
+        }
+        else if (results[i].length > 0)
+            fwrite(results[i].output, 1, results[i].length, stdout);
+        free(results[i].output);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%d programs in %.3f s on %d threads, %.0f programs/s\n",
+            count, seconds, threads, (seconds > 0) ? count / seconds : 0.0);
+
+    free(results);
+    free(pool);
+}
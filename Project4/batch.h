@@ -0,0 +1,16 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the batch runner that parses
+//  and runs many programs at once on a pool of threads.
+//--------------------------------------------------------------
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+// Parses and runs the programs in files on threads threads. What each
+// program prints is kept until it is done and then written out in the
+// order of files, so the output is the same as running them one after
+// another. How many programs a second were run goes to stderr.
+void run_batch(char** files, int number_of_files, int threads);
+
+#endif /* _BATCH_H_ */
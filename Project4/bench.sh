@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Runs every program in bench/ by walking the statement graph (-g), on
+# the bytecode VM (-v) and as native code, checks that they all print
+# the same output and shows the time each took.
+
+run() {
+	local start=$(date +%s%N)
+	./a.out $1 < $2 > $3
+	echo $(( ($(date +%s%N) - start) / 1000000 ))
+}
+
+speedup() {
+	awk -v g=$1 -v t=$2 'BEGIN { print (t > 0) ? g / t : 0 }'
+}
+
+printf "%-24s %10s %10s %10s %8s %8s\n" "PROGRAM" "GRAPH ms" "VM ms" "JIT ms" "VM" "JIT"
+for f in $(ls ./bench/*.txt); do
+	graph=$(run -g $f bench/graph.output)
+	vm=$(run -v $f bench/vm.output)
+	jit=$(run "" $f bench/jit.output)
+	for engine in vm jit; do
+		if ! cmp -s bench/graph.output bench/$engine.output; then
+			echo "$(basename $f .txt): $engine output differs";
+			diff bench/graph.output bench/$engine.output | head;
+		fi
+	done
+	printf "%-24s %10d %10d %10d %7.2fx %7.2fx\n" $(basename $f .txt) $graph $vm $jit \
+		$(speedup $graph $vm) $(speedup $graph $jit)
+done
+
+rm bench/*.output
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Runs the programs in tests/ COPIES times over, once as a separate
+# process each and then as one batch on 1, 2, 4, ... threads up to
+# twice the number of processors, and shows how many programs a second
+# each way ran. Every batch has to print the same as the processes did.
+
+COPIES=${1:-50}
+
+files=$(for ((i = 0; i < COPIES; i++)); do ls ./tests/*.txt; done)
+count=$(echo $files | wc -w)
+
+start=$(date +%s%N)
+for f in $files; do
+	./a.out < $f
+done > bench/processes.output
+ms=$(( ($(date +%s%N) - start) / 1000000 ))
+printf "%-12s %8d programs in %6d ms, %8.0f programs/s\n" processes $count $ms \
+	$(awk -v n=$count -v ms=$ms 'BEGIN { print (ms > 0) ? 1000 * n / ms : 0 }')
+
+max=$((2 * $(nproc)))
+for ((t = 1; t <= max; t *= 2)); do
+	start=$(date +%s%N)
+	./a.out -t $t $files > bench/batch.output 2> /dev/null
+	ms=$(( ($(date +%s%N) - start) / 1000000 ))
+	printf "%-12s %8d programs in %6d ms, %8.0f programs/s\n" "$t threads" $count $ms \
+		$(awk -v n=$count -v ms=$ms 'BEGIN { print (ms > 0) ? 1000 * n / ms : 0 }')
+	if ! cmp -s bench/processes.output bench/batch.output; then
+		echo "$t threads: output differs";
+	fi
+done
+
+rm -f bench/processes.output bench/batch.output
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Runs every program in bench/ by walking the statement graph with
+# wrapping 32-bit arithmetic (-g), with checked 64-bit arithmetic (-w)
+# and with bignums (-x), and shows the time each took and how much
+# longer than -g the checked runs were. Each time is the best of REPEAT
+# runs. Outputs are compared with -g, they differ when a program
+# overflows 32 bits.
+
+REPEAT=${REPEAT:-5}
+
+run() {
+	local best=0 start ms i
+	for ((i = 0; i < REPEAT; i++)); do
+		start=$(date +%s%N)
+		./a.out $1 < $2 > $3 2> /dev/null
+		ms=$(( ($(date +%s%N) - start) / 1000000 ))
+		if [ $i == 0 ] || [ $ms -lt $best ]; then
+			best=$ms
+		fi
+	done
+	echo $best
+}
+
+overhead() {
+	awk -v g=$1 -v t=$2 'BEGIN { print (g > 0) ? 100 * (t - g) / g : 0 }'
+}
+
+printf "%-24s %10s %10s %10s %8s %8s\n" "PROGRAM" "INT ms" "-w ms" "-x ms" "-w" "-x"
+for f in $(ls ./bench/*.txt); do
+	plain=$(run -g $f bench/plain.output)
+	checked=$(run -w $f bench/checked.output)
+	exact=$(run -x $f bench/exact.output)
+	for mode in checked exact; do
+		if ! cmp -s bench/plain.output bench/$mode.output; then
+			echo "$(basename $f .txt): $mode output differs, it overflows 32 bits";
+		fi
+	done
+	printf "%-24s %10d %10d %10d %+7.1f%% %+7.1f%%\n" $(basename $f .txt) $plain $checked $exact \
+		$(overhead $plain $checked) $(overhead $plain $exact)
+done
+
+rm -f bench/plain.output bench/checked.output bench/exact.output
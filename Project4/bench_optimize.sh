@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Counts the statements executed when walking the statement graph of
+# every program in tests/ and bench/, without (-n) and with the
+# optimizer, and checks that both print the same output.
+
+count() {
+	./a.out -c $1 < $2 2>&1 > $3 | awk '{ print $1 }'
+}
+
+printf "%-44s %12s %12s %7s\n" "PROGRAM" "PLAIN" "OPTIMIZED" "SAVED"
+for f in $(ls ./tests/*.txt ./bench/*.txt); do
+	plain=$(count -n $f /tmp/plain.output.$$)
+	optimized=$(count "" $f /tmp/optimized.output.$$)
+	if ! cmp -s /tmp/plain.output.$$ /tmp/optimized.output.$$; then
+		echo "$(basename $f .txt): outputs differ";
+	fi
+	printf "%-44s %12d %12d %6.1f%%\n" $(basename $f .txt) $plain $optimized \
+		$(awk -v p=$plain -v o=$optimized 'BEGIN { print (p > 0) ? 100 * (p - o) / p : 0 }')
+done
+
+rm -f /tmp/plain.output.$$ /tmp/optimized.output.$$
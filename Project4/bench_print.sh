@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Times a program that prints N numbers on each engine, with the output
+# thrown away, and shows the lines printed per second.
+
+N=${1:-20000000}
+
+gen_print() { awk -v n=$N 'BEGIN { printf "i, n;\n{\nn = %d;\ni = 0 - %d;\nWHILE i < n\n{\nprint i;\ni = i + 1;\n}\n}\n", n - n / 2, n / 2 }'; }
+
+gen_print > bench/print.input
+printf "%-8s %10s %14s\n" "ENGINE" "ms" "LINES/s"
+for mode in -g -v ""; do
+	start=$(date +%s%N)
+	./a.out $mode < bench/print.input > /dev/null
+	ms=$((($(date +%s%N) - start) / 1000000))
+	printf "%-8s %10d %14d\n" ${mode:-jit} $ms $((N * 1000 / (ms > 0 ? ms : 1)))
+done
+
+rm bench/print.input
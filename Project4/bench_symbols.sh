@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Times building and running programs that declare N variables and use
+# each of them twice. With symbols hashed the time per variable should
+# stay about the same as N grows.
+
+gen_vars() { awk -v n=$1 'BEGIN { for (i = 0; i < n; i++) printf "v%d, ", i; printf "s;\n{\n"; for (i = 0; i < n; i++) printf "v%d = %d;\n", i, i % 1000 + 1; for (i = 0; i < n; i++) printf "s = s + v%d;\n", i; printf "print s;\n}\n" }'; }
+
+printf "%-12s %10s %12s\n" "VARIABLES" "ms" "ns/VARIABLE"
+for n in ${@:-10000 100000 1000000}; do
+	gen_vars $n > bench/symbols.input
+	start=$(date +%s%N)
+	./a.out < bench/symbols.input > /dev/null
+	ns=$(($(date +%s%N) - start))
+	printf "%-12d %10d %12d\n" $n $((ns / 1000000)) $((ns / n))
+done
+
+rm bench/symbols.input
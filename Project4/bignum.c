@@ -0,0 +1,350 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements the arbitrary precision
+//  integers declared in bignum.h with schoolbook arithmetic on
+//  32-bit limbs. Division is Knuth's algorithm D.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "bignum.h"
+
+//---------------------------------------------------------
+// Numbers
+
+static struct Bignum* new_bignum(int length)
+{
+    struct Bignum* a = malloc(sizeof(struct Bignum));
+
+    a->sign = 1;
+    a->length = length;
+    a->limbs = calloc(length + 1, sizeof(unsigned int));
+    return a;
+}
+
+// Drops leading zero limbs, zero is always positive
+static struct Bignum* normalize(struct Bignum* a)
+{
+    while (a->length > 0 && a->limbs[a->length - 1] == 0)
+        a->length--;
+    if (a->length == 0)
+        a->sign = 1;
+    return a;
+}
+
+struct Bignum* big_from_long(long long value)
+{
+    struct Bignum* a = new_bignum(2);
+    unsigned long long u = (value < 0) ? 0ull - (unsigned long long) value
+                                       : (unsigned long long) value;
+
+    a->sign = (value < 0) ? -1 : 1;
+    a->limbs[0] = (unsigned int) u;
+    a->limbs[1] = (unsigned int) (u >> 32);
+    return normalize(a);
+}
+
+struct Bignum* big_copy(struct Bignum* a)
+{
+    struct Bignum* r = new_bignum(a->length);
+
+    r->sign = a->sign;
+    memcpy(r->limbs, a->limbs, a->length * sizeof(unsigned int));
+    return r;
+}
+
+void big_free(struct Bignum* a)
+{
+    if (a == NULL)
+        return;
+    free(a->limbs);
+    free(a);
+}
+
+int big_to_long(struct Bignum* a, long long* value)
+{
+    unsigned long long u = 0;
+
+    if (a->length > 2)
+        return 0;
+    if (a->length > 0)
+        u = a->limbs[0];
+    if (a->length > 1)
+        u |= (unsigned long long) a->limbs[1] << 32;
+    if (a->sign > 0)
+    {
+        if (u > LLONG_MAX)
+            return 0;
+        *value = (long long) u;
+    }
+    else
+    {
+        if (u > (unsigned long long) LLONG_MAX + 1)
+            return 0;
+        *value = (long long) (0ull - u);
+    }
+    return 1;
+}
+
+//---------------------------------------------------------
+// Magnitudes
+
+static int compare_magnitudes(struct Bignum* a, struct Bignum* b)
+{
+    int i;
+
+    if (a->length != b->length)
+        return (a->length < b->length) ? -1 : 1;
+    for (i = a->length - 1; i >= 0; i--)
+        if (a->limbs[i] != b->limbs[i])
+            return (a->limbs[i] < b->limbs[i]) ? -1 : 1;
+    return 0;
+}
+
+static struct Bignum* add_magnitudes(struct Bignum* a, struct Bignum* b)
+{
+    struct Bignum* r;
+    unsigned long long carry = 0;
+    int i;
+
+    if (a->length < b->length)
+        return add_magnitudes(b, a);
+    r = new_bignum(a->length + 1);
+    for (i = 0; i < a->length; i++)
+    {
+        carry += a->limbs[i];
+        if (i < b->length)
+            carry += b->limbs[i];
+        r->limbs[i] = (unsigned int) carry;
+        carry >>= 32;
+    }
+    r->limbs[a->length] = (unsigned int) carry;
+    return r;
+}
+
+// |a| - |b| where |a| >= |b|
+static struct Bignum* subtract_magnitudes(struct Bignum* a, struct Bignum* b)
+{
+    struct Bignum* r = new_bignum(a->length);
+    long long borrow = 0, d;
+    int i;
+
+    for (i = 0; i < a->length; i++)
+    {
+        d = (long long) a->limbs[i] - borrow - ((i < b->length) ? b->limbs[i] : 0);
+        borrow = (d < 0);
+        r->limbs[i] = (unsigned int) (d + (borrow << 32));
+    }
+    return r;
+}
+
+//---------------------------------------------------------
+// Arithmetic
+
+// a + b when b has the sign given
+static struct Bignum* add_signed(struct Bignum* a, struct Bignum* b, int b_sign)
+{
+    struct Bignum* r;
+
+    if (a->sign == b_sign)
+    {
+        r = add_magnitudes(a, b);
+        r->sign = a->sign;
+    }
+    else if (compare_magnitudes(a, b) >= 0)
+    {
+        r = subtract_magnitudes(a, b);
+        r->sign = a->sign;
+    }
+    else
+    {
+        r = subtract_magnitudes(b, a);
+        r->sign = b_sign;
+    }
+    return normalize(r);
+}
+
+struct Bignum* big_add(struct Bignum* a, struct Bignum* b)
+{
+    return add_signed(a, b, b->sign);
+}
+
+struct Bignum* big_sub(struct Bignum* a, struct Bignum* b)
+{
+    return add_signed(a, b, -b->sign);
+}
+
+struct Bignum* big_mul(struct Bignum* a, struct Bignum* b)
+{
+    struct Bignum* r = new_bignum(a->length + b->length);
+    unsigned long long t;
+    int i, j;
+
+    for (i = 0; i < a->length; i++)
+    {
+        t = 0;
+        for (j = 0; j < b->length; j++)
+        {
+            t += (unsigned long long) a->limbs[i] * b->limbs[j] + r->limbs[i + j];
+            r->limbs[i + j] = (unsigned int) t;
+            t >>= 32;
+        }
+        r->limbs[i + b->length] = (unsigned int) t;
+    }
+    r->sign = a->sign * b->sign;
+    return normalize(r);
+}
+
+static int leading_zeros(unsigned int x)
+{
+    int n = 0;
+
+    while (!(x & 0x80000000u))
+    {
+        x <<= 1;
+        n++;
+    }
+    return n;
+}
+
+// The quotient of the magnitudes, Knuth's algorithm D. Both operands
+// are shifted left so the divisor's top limb has its high bit set,
+// which keeps each estimated quotient limb at most 2 too large.
+static struct Bignum* divide_magnitudes(struct Bignum* a, struct Bignum* b)
+{
+    int m = a->length, n = b->length, s, i, j;
+    unsigned long long base = 1ull << 32, qhat, rhat, p, remainder;
+    long long t, k;
+    unsigned int *u, *v;
+    struct Bignum* q;
+
+    if (compare_magnitudes(a, b) < 0)
+        return new_bignum(0);
+    q = new_bignum(m - n + 1);
+
+    if (n == 1)
+    {
+        remainder = 0;
+        for (j = m - 1; j >= 0; j--)
+        {
+            remainder = (remainder << 32) | a->limbs[j];
+            q->limbs[j] = (unsigned int) (remainder / b->limbs[0]);
+            remainder %= b->limbs[0];
+        }
+        return q;
+    }
+
+    s = leading_zeros(b->limbs[n - 1]);
+    v = malloc(n * sizeof(unsigned int));
+    u = malloc((m + 1) * sizeof(unsigned int));
+    for (i = n - 1; i > 0; i--)
+        v[i] = (b->limbs[i] << s) | (s ? b->limbs[i - 1] >> (32 - s) : 0);
+    v[0] = b->limbs[0] << s;
+    u[m] = s ? a->limbs[m - 1] >> (32 - s) : 0;
+    for (i = m - 1; i > 0; i--)
+        u[i] = (a->limbs[i] << s) | (s ? a->limbs[i - 1] >> (32 - s) : 0);
+    u[0] = a->limbs[0] << s;
+
+    for (j = m - n; j >= 0; j--)
+    {
+        // Estimate the quotient limb from the top two limbs
+        qhat = (((unsigned long long) u[j + n] << 32) | u[j + n - 1]) / v[n - 1];
+        rhat = (((unsigned long long) u[j + n] << 32) | u[j + n - 1]) % v[n - 1];
+        while (qhat >= base || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2]))
+        {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat >= base)
+                break;
+        }
+
+        // Multiply and subtract
+        k = 0;
+        for (i = 0; i < n; i++)
+        {
+            p = qhat * v[i];
+            t = (long long) u[i + j] - k - (long long) (p & 0xffffffffu);
+            u[i + j] = (unsigned int) t;
+            k = (long long) (p >> 32) - (t >> 32);
+        }
+        t = (long long) u[j + n] - k;
+        u[j + n] = (unsigned int) t;
+
+        // The estimate was one too large, add the divisor back
+        if (t < 0)
+        {
+            qhat--;
+            k = 0;
+            for (i = 0; i < n; i++)
+            {
+                t = (long long) u[i + j] + v[i] + k;
+                u[i + j] = (unsigned int) t;
+                k = t >> 32;
+            }
+            u[j + n] += (unsigned int) k;
+        }
+        q->limbs[j] = (unsigned int) qhat;
+    }
+    free(u);
+    free(v);
+    return q;
+}
+
+struct Bignum* big_div(struct Bignum* a, struct Bignum* b)
+{
+    struct Bignum* q = divide_magnitudes(a, b);
+
+    q->sign = a->sign * b->sign;
+    return normalize(q);
+}
+
+int big_compare(struct Bignum* a, struct Bignum* b)
+{
+    if (a->sign != b->sign)
+        return a->sign;
+    return a->sign * compare_magnitudes(a, b);
+}
+
+//---------------------------------------------------------
+// Decimal
+
+char* big_to_string(struct Bignum* a)
+{
+    // Each limb takes fewer than 10 digits
+    char* text = malloc(10 * a->length + 3);
+    char* p = text + 10 * a->length + 2;
+    unsigned int* limbs = malloc((a->length + 1) * sizeof(unsigned int));
+    unsigned long long remainder;
+    int length = a->length, i, k;
+
+    memcpy(limbs, a->limbs, a->length * sizeof(unsigned int));
+    *p = '\0';
+
+    // Divide by 10^9 and write out the remainder's nine digits
+    while (length > 0)
+    {
+        remainder = 0;
+        for (i = length - 1; i >= 0; i--)
+        {
+            remainder = (remainder << 32) | limbs[i];
+            limbs[i] = (unsigned int) (remainder / 1000000000u);
+            remainder %= 1000000000u;
+        }
+        while (length > 0 && limbs[length - 1] == 0)
+            length--;
+        for (k = 0; k < 9 && (length > 0 || remainder > 0); k++)
+        {
+            *--p = (char) ('0' + remainder % 10);
+            remainder /= 10;
+        }
+    }
+    if (a->length == 0)
+        *--p = '0';
+    if (a->sign < 0)
+        *--p = '-';
+    memmove(text, p, strlen(p) + 1);
+    free(limbs);
+    return text;
+}
@@ -0,0 +1,43 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the arbitrary precision
+//  integers that exact arithmetic falls back to when a value no
+//  longer fits in 64 bits.
+//--------------------------------------------------------------
+#ifndef _BIGNUM_H_
+#define _BIGNUM_H_
+
+// A sign and a magnitude in base 2^32, least significant limb first,
+// with no leading zero limbs. Zero has length 0 and sign 1. Every
+// operation returns a new number for the caller to free.
+struct Bignum
+{
+    int sign;       // 1 or -1
+    int length;
+    unsigned int* limbs;
+};
+
+struct Bignum* big_from_long(long long value);
+struct Bignum* big_copy(struct Bignum* a);
+void big_free(struct Bignum* a);
+
+// Sets value and returns 1 if a fits in a long long, returns 0 otherwise
+int big_to_long(struct Bignum* a, long long* value);
+
+struct Bignum* big_add(struct Bignum* a, struct Bignum* b);
+struct Bignum* big_sub(struct Bignum* a, struct Bignum* b);
+struct Bignum* big_mul(struct Bignum* a, struct Bignum* b);
+
+// The quotient rounded toward zero like C division, b must not be zero
+struct Bignum* big_div(struct Bignum* a, struct Bignum* b);
+
+// Returns a negative number, zero or a positive number as a is less
+// than, equal to or greater than b
+int big_compare(struct Bignum* a, struct Bignum* b);
+
+// Returns the decimal digits of a, with a '-' in front if it is
+// negative, as a string for the caller to free
+char* big_to_string(struct Bignum* a);
+
+#endif /* _BIGNUM_H_ */
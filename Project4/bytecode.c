@@ -0,0 +1,380 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file compiles the statement graph built by
+//  code_graph.c into a dense array of three-address instructions
+//  and runs it with a computed-goto dispatch loop.
+//--------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bytecode.h"
+#include "pointer_map.h"
+#include "output.h"
+
+//---------------------------------------------------------
+// Compiler
+
+struct Compiler
+{
+    struct Bytecode* program;
+    int capacity;
+
+    struct PointerMap labels;   // StatementNode -> first instruction
+    int switch_capacity;
+    int superinstructions;
+
+    // Jumps whose target was not laid out yet
+    struct StatementNode** patch_target;
+    int* patch_at;
+    int patches;
+    int patch_capacity;
+};
+
+static int emit(struct Compiler* c, int opcode, int a, int b, int target)
+{
+    struct Bytecode* p = c->program;
+
+    if (p->length == c->capacity)
+    {
+        c->capacity = (c->capacity == 0) ? 64 : 2 * c->capacity;
+        p->code = realloc(p->code, c->capacity * sizeof(struct Instruction));
+    }
+    p->code[p->length].opcode = opcode;
+    p->code[p->length].a = a;
+    p->code[p->length].b = b;
+    p->code[p->length].c = target;
+    return p->length++;
+}
+
+// Makes the c field of instruction at jump to the first instruction
+// of target once target is laid out
+static void add_patch(struct Compiler* c, int at, struct StatementNode* target)
+{
+    if (c->patches == c->patch_capacity)
+    {
+        c->patch_capacity = (c->patch_capacity == 0) ? 64 : 2 * c->patch_capacity;
+        c->patch_target = realloc(c->patch_target, c->patch_capacity * sizeof(struct StatementNode*));
+        c->patch_at = realloc(c->patch_at, c->patch_capacity * sizeof(int));
+    }
+    c->patch_target[c->patches] = target;
+    c->patch_at[c->patches++] = at;
+}
+
+// Emits the switch followed by its table of jumps, which are patched
+// once the cases are laid out
+static void compile_switch(struct Compiler* c, struct SwitchStatement* sw)
+{
+    struct Bytecode* p = c->program;
+    int i;
+
+    if (p->number_of_switches == c->switch_capacity)
+    {
+        c->switch_capacity = (c->switch_capacity == 0) ? 16 : 2 * c->switch_capacity;
+        p->switches = realloc(p->switches, c->switch_capacity * sizeof(struct SwitchStatement*));
+    }
+    p->switches[p->number_of_switches] = sw;
+    emit(c, OP_SWITCH, sw->var, p->number_of_switches++, 0);
+    for (i = 0; i < sw->number_of_cases; i++)
+        add_patch(c, emit(c, OP_JUMP, 0, 0, -1), sw->targets[i]);
+    add_patch(c, emit(c, OP_JUMP, 0, 0, -1), sw->default_target);
+}
+
+// Lays out the statements reachable from pc along next, true_branch
+// and goto targets. Each statement is compiled once; reaching one that
+// is already compiled ends the run with a jump to it. NOOP and GOTO
+// statements produce no instructions of their own. With
+// superinstructions, a jump back to a condition becomes a copy of the
+// condition that goes to its true branch, followed by a jump to its
+// false branch, which saves a dispatch each time round a loop.
+static void compile_run(struct Compiler* c, struct StatementNode* pc)
+{
+    struct AssignmentStatement* assign;
+    struct IfStatement* cond;
+    int label, opcode, at;
+
+    while (pc != NULL)
+    {
+        label = map_get(&c->labels, pc);
+        if (label >= 0 && c->superinstructions && pc->type == IF_STMT)
+        {
+            cond = pc->if_stmt;
+            switch (cond->condition_op)
+            {
+                case GREATER: opcode = OP_LOOP_GT; break;
+                case LESS:    opcode = OP_LOOP_LT; break;
+                default:      opcode = OP_LOOP_NE; break;
+            }
+            emit(c, opcode, cond->condition_operand1, cond->condition_operand2, label + 1);
+            add_patch(c, emit(c, OP_JUMP, 0, 0, -1), cond->false_branch);
+            return;
+        }
+        if (label >= 0)
+        {
+            emit(c, OP_JUMP, 0, 0, label);
+            return;
+        }
+        map_put(&c->labels, pc, c->program->length);
+        switch (pc->type)
+        {
+            case NOOP_STMT:
+                pc = pc->next;
+                break;
+
+            case PRINT_STMT:
+                emit(c, OP_PRINT, pc->print_stmt->id, 0, 0);
+                pc = pc->next;
+                break;
+
+            case ASSIGN_STMT:
+                assign = pc->assign_stmt;
+                switch (assign->op)
+                {
+                    case PLUS:  opcode = OP_ADD;  break;
+                    case MINUS: opcode = OP_SUB;  break;
+                    case MULT:  opcode = OP_MULT; break;
+                    case DIV:   opcode = OP_DIV;  break;
+                    default:    opcode = OP_MOVE; break;
+                }
+                emit(c, opcode, assign->left_hand_side, assign->operand1,
+                     (opcode == OP_MOVE) ? 0 : assign->operand2);
+                pc = pc->next;
+                break;
+
+            case IF_STMT:
+                cond = pc->if_stmt;
+                switch (cond->condition_op)
+                {
+                    case GREATER: opcode = OP_IF_GT; break;
+                    case LESS:    opcode = OP_IF_LT; break;
+                    default:      opcode = OP_IF_NE; break;
+                }
+                at = emit(c, opcode, cond->condition_operand1,
+                          cond->condition_operand2, -1);
+                add_patch(c, at, cond->false_branch);
+                pc = cond->true_branch;
+                break;
+
+            case GOTO_STMT:
+                pc = pc->goto_stmt->target;
+                break;
+
+            case SWITCH_STMT:
+                compile_switch(c, pc->switch_stmt);
+                return;
+        }
+    }
+    emit(c, OP_HALT, 0, 0, 0);
+}
+
+// Fuses each addition or subtraction with a branch right after it
+static void fuse_instructions(struct Bytecode* program)
+{
+    struct Instruction* code = program->code;
+    int i, fused;
+
+    for (i = 0; i + 1 < program->length; i++)
+    {
+        if (code[i].opcode != OP_ADD && code[i].opcode != OP_SUB)
+            continue;
+        switch (code[i + 1].opcode)
+        {
+            case OP_IF_GT:   fused = OP_ADD_IF_GT;   break;
+            case OP_IF_LT:   fused = OP_ADD_IF_LT;   break;
+            case OP_IF_NE:   fused = OP_ADD_IF_NE;   break;
+            case OP_LOOP_GT: fused = OP_ADD_LOOP_GT; break;
+            case OP_LOOP_LT: fused = OP_ADD_LOOP_LT; break;
+            case OP_LOOP_NE: fused = OP_ADD_LOOP_NE; break;
+            default:         continue;
+        }
+        if (code[i].opcode == OP_SUB)
+            fused += OP_SUB_IF_GT - OP_ADD_IF_GT;
+        code[i].opcode = fused;
+        i++;
+    }
+}
+
+struct Bytecode* compile_program(struct StatementNode* program, int superinstructions)
+{
+    struct Compiler c;
+    int i, label;
+
+    memset(&c, 0, sizeof(c));
+    c.program = calloc(1, sizeof(struct Bytecode));
+    c.superinstructions = superinstructions;
+
+    // The program runs on its own copy of the slots
+    c.program->number_of_slots = number_of_slots;
+    c.program->slots = malloc(number_of_slots * sizeof(int));
+    memcpy(c.program->slots, slots, number_of_slots * sizeof(int));
+    compile_run(&c, program);
+
+    // The false branches are laid out after the code that reaches
+    // them, patching a jump may add more patches
+    for (i = 0; i < c.patches; i++)
+    {
+        label = map_get(&c.labels, c.patch_target[i]);
+        if (label < 0)
+        {
+            label = c.program->length;
+            compile_run(&c, c.patch_target[i]);
+        }
+        c.program->code[c.patch_at[i]].c = label;
+    }
+
+    if (superinstructions)
+        fuse_instructions(c.program);
+
+    map_free(&c.labels);
+    free(c.patch_target);
+    free(c.patch_at);
+    return c.program;
+}
+
+void free_bytecode(struct Bytecode* program)
+{
+    free(program->code);
+    free(program->slots);
+    free(program->switches);
+    free(program);
+}
+
+//---------------------------------------------------------
+// Virtual machine
+
+void execute_bytecode(struct Bytecode* program)
+{
+    static void* dispatch[NUMBER_OF_OPCODES] =
+    {
+        [OP_MOVE]        = &&op_move,
+        [OP_ADD]         = &&op_add,
+        [OP_SUB]         = &&op_sub,
+        [OP_MULT]        = &&op_mult,
+        [OP_DIV]         = &&op_div,
+        [OP_PRINT]       = &&op_print,
+        [OP_JUMP]        = &&op_jump,
+        [OP_IF_GT]       = &&op_if_gt,
+        [OP_IF_LT]       = &&op_if_lt,
+        [OP_IF_NE]       = &&op_if_ne,
+        [OP_LOOP_GT]     = &&op_loop_gt,
+        [OP_LOOP_LT]     = &&op_loop_lt,
+        [OP_LOOP_NE]     = &&op_loop_ne,
+        [OP_SWITCH]      = &&op_switch,
+        [OP_HALT]        = &&op_halt,
+        [OP_ADD_IF_GT]   = &&op_add_if_gt,
+        [OP_ADD_IF_LT]   = &&op_add_if_lt,
+        [OP_ADD_IF_NE]   = &&op_add_if_ne,
+        [OP_ADD_LOOP_GT] = &&op_add_loop_gt,
+        [OP_ADD_LOOP_LT] = &&op_add_loop_lt,
+        [OP_ADD_LOOP_NE] = &&op_add_loop_ne,
+        [OP_SUB_IF_GT]   = &&op_sub_if_gt,
+        [OP_SUB_IF_LT]   = &&op_sub_if_lt,
+        [OP_SUB_IF_NE]   = &&op_sub_if_ne,
+        [OP_SUB_LOOP_GT] = &&op_sub_loop_gt,
+        [OP_SUB_LOOP_LT] = &&op_sub_loop_lt,
+        [OP_SUB_LOOP_NE] = &&op_sub_loop_ne
+    };
+    struct Instruction* code = program->code;
+    struct Instruction* ip = code;
+    int* s = program->slots;
+    struct SwitchStatement* sw;
+    int i;
+
+#ifdef COUNT_DISPATCH
+    long dispatches = 1;
+#define COUNT() ++dispatches
+#define DONE() fprintf(stderr, "%ld dispatches\n", dispatches)
+#else
+#define COUNT()
+#define DONE()
+#endif
+#define NEXT() do { COUNT(); goto *dispatch[(++ip)->opcode]; } while (0)
+#define JUMP(target) do { COUNT(); goto *dispatch[(ip = code + (target))->opcode]; } while (0)
+
+    goto *dispatch[ip->opcode];
+
+op_move:
+    s[ip->a] = s[ip->b];
+    NEXT();
+op_add:
+    s[ip->a] = s[ip->b] + s[ip->c];
+    NEXT();
+op_sub:
+    s[ip->a] = s[ip->b] - s[ip->c];
+    NEXT();
+op_mult:
+    s[ip->a] = s[ip->b] * s[ip->c];
+    NEXT();
+op_div:
+    s[ip->a] = s[ip->b] / s[ip->c];
+    NEXT();
+op_print:
+    print_int(s[ip->a]);
+    NEXT();
+op_jump:
+    JUMP(ip->c);
+op_if_gt:
+    if (s[ip->a] > s[ip->b])
+        NEXT();
+    JUMP(ip->c);
+op_if_lt:
+    if (s[ip->a] < s[ip->b])
+        NEXT();
+    JUMP(ip->c);
+op_if_ne:
+    if (s[ip->a] != s[ip->b])
+        NEXT();
+    JUMP(ip->c);
+op_loop_gt:
+    if (s[ip->a] > s[ip->b])
+        JUMP(ip->c);
+    NEXT();
+op_loop_lt:
+    if (s[ip->a] < s[ip->b])
+        JUMP(ip->c);
+    NEXT();
+op_loop_ne:
+    if (s[ip->a] != s[ip->b])
+        JUMP(ip->c);
+    NEXT();
+op_switch:
+    sw = program->switches[ip->b];
+    i = find_case(sw, s[ip->a]);
+    if (i < 0)
+        i = sw->number_of_cases;
+    JUMP(ip[1 + i].c);
+op_halt:
+    DONE();
+    return;
+
+// The branch is in the next instruction, the superinstruction either
+// takes it or carries on after it
+#define FUSED(label, op, taken)             \
+label:                                      \
+    s[ip->a] = s[ip->b] op s[ip->c];        \
+    ++ip;                                   \
+    if (taken)                              \
+        JUMP(ip->c);                        \
+    NEXT();
+
+    FUSED(op_add_if_gt, +, !(s[ip->a] > s[ip->b]))
+    FUSED(op_add_if_lt, +, !(s[ip->a] < s[ip->b]))
+    FUSED(op_add_if_ne, +, !(s[ip->a] != s[ip->b]))
+    FUSED(op_add_loop_gt, +, s[ip->a] > s[ip->b])
+    FUSED(op_add_loop_lt, +, s[ip->a] < s[ip->b])
+    FUSED(op_add_loop_ne, +, s[ip->a] != s[ip->b])
+    FUSED(op_sub_if_gt, -, !(s[ip->a] > s[ip->b]))
+    FUSED(op_sub_if_lt, -, !(s[ip->a] < s[ip->b]))
+    FUSED(op_sub_if_ne, -, !(s[ip->a] != s[ip->b]))
+    FUSED(op_sub_loop_gt, -, s[ip->a] > s[ip->b])
+    FUSED(op_sub_loop_lt, -, s[ip->a] < s[ip->b])
+    FUSED(op_sub_loop_ne, -, s[ip->a] != s[ip->b])
+
+#undef FUSED
+
+#undef NEXT
+#undef JUMP
+#undef COUNT
+#undef DONE
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the bytecode compiler and
+//  the virtual machine that runs its output.
+//--------------------------------------------------------------
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include "compiler.h"
+
+// Instructions name their operands by slot index, like the statements
+// they are compiled from
+enum Opcode
+{
+    OP_MOVE,    // slots[a] = slots[b]
+    OP_ADD,     // slots[a] = slots[b] + slots[c]
+    OP_SUB,
+    OP_MULT,
+    OP_DIV,
+    OP_PRINT,   // print slots[a]
+    OP_JUMP,    // go to instruction c
+    OP_IF_GT,   // go to instruction c unless slots[a] > slots[b]
+    OP_IF_LT,
+    OP_IF_NE,
+    OP_LOOP_GT, // go to instruction c if slots[a] > slots[b]
+    OP_LOOP_LT,
+    OP_LOOP_NE,
+    OP_SWITCH,  // go to the instruction of the case of slots[a] in
+                // switches[b], the instructions after this one are
+                // jumps to each case in turn and then to the default
+    OP_HALT,
+
+    // Superinstructions: an addition or subtraction fused with the
+    // branch after it. The branch is left in the next instruction,
+    // which the superinstruction reads and then skips, so jumps to it
+    // still work.
+    OP_ADD_IF_GT,
+    OP_ADD_IF_LT,
+    OP_ADD_IF_NE,
+    OP_ADD_LOOP_GT,
+    OP_ADD_LOOP_LT,
+    OP_ADD_LOOP_NE,
+    OP_SUB_IF_GT,
+    OP_SUB_IF_LT,
+    OP_SUB_IF_NE,
+    OP_SUB_LOOP_GT,
+    OP_SUB_LOOP_LT,
+    OP_SUB_LOOP_NE,
+    NUMBER_OF_OPCODES
+};
+
+struct Instruction
+{
+    int opcode;
+    int a, b, c;
+};
+
+struct Bytecode
+{
+    struct Instruction* code;
+    int length;
+
+    int* slots;
+    int number_of_slots;
+
+    struct SwitchStatement** switches;
+    int number_of_switches;
+};
+
+// With superinstructions, jumps back to the condition of a loop test it
+// again in place and additions and subtractions are fused with the
+// branch after them
+struct Bytecode* compile_program(struct StatementNode* program, int superinstructions);
+void execute_bytecode(struct Bytecode* program);
+
+// Frees the instructions and slots of program, the switches belong to
+// the statements
+void free_bytecode(struct Bytecode* program);
+
+#endif /* _BYTECODE_H_ */
@@ -0,0 +1,605 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file partitions the statement graph into
+//  basic blocks and solves gen/kill dataflow problems over them
+//  with bit sets and a worklist. Liveness and reaching definitions
+//  are built on it.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include "cfg.h"
+#include "code_graph.h"
+#include "pointer_map.h"
+
+// Problems whose sets would take more words than this per array are
+// not solved, so huge programs with many blocks stay linear
+#define MAX_DATAFLOW_WORDS (1 << 20)
+
+//---------------------------------------------------------
+// Edges
+
+static __thread struct StatementNode*** edges = NULL;
+static __thread int number_of_edges = 0;
+static __thread int edge_capacity = 0;
+
+static void add_edge(struct StatementNode** edge)
+{
+    if (number_of_edges == edge_capacity)
+    {
+        edge_capacity = (edge_capacity == 0) ? 16 : 2 * edge_capacity;
+        edges = realloc(edges, edge_capacity * sizeof(struct StatementNode**));
+    }
+    edges[number_of_edges++] = edge;
+}
+
+struct StatementNode*** get_edges(struct StatementNode* st, int* count)
+{
+    struct SwitchStatement* sw;
+    int i;
+
+    number_of_edges = 0;
+    switch (st->type)
+    {
+        case IF_STMT:
+            add_edge(&st->if_stmt->true_branch);
+            add_edge(&st->if_stmt->false_branch);
+            break;
+
+        case GOTO_STMT:
+            add_edge(&st->goto_stmt->target);
+            break;
+
+        case SWITCH_STMT:
+            sw = st->switch_stmt;
+            for (i = 0; i < sw->number_of_cases; i++)
+                add_edge(&sw->targets[i]);
+            add_edge(&sw->default_target);
+            break;
+
+        default:
+            add_edge(&st->next);
+            break;
+    }
+    *count = number_of_edges;
+    return edges;
+}
+
+int** get_uses(struct StatementNode* st, int* count)
+{
+    static __thread int* uses[2];
+
+    *count = 0;
+    switch (st->type)
+    {
+        case ASSIGN_STMT:
+            uses[(*count)++] = &st->assign_stmt->operand1;
+            if (st->assign_stmt->op != 0)
+                uses[(*count)++] = &st->assign_stmt->operand2;
+            break;
+
+        case PRINT_STMT:
+            uses[(*count)++] = &st->print_stmt->id;
+            break;
+
+        case IF_STMT:
+            uses[(*count)++] = &st->if_stmt->condition_operand1;
+            uses[(*count)++] = &st->if_stmt->condition_operand2;
+            break;
+
+        case SWITCH_STMT:
+            uses[(*count)++] = &st->switch_stmt->var;
+            break;
+
+        default:
+            break;
+    }
+    return uses;
+}
+
+//---------------------------------------------------------
+// Basic blocks
+
+static int falls_through(struct StatementNode* st)
+{
+    return st->type == ASSIGN_STMT || st->type == PRINT_STMT || st->type == NOOP_STMT;
+}
+
+// Puts the blocks in reverse postorder with an explicit stack
+static void order_blocks(struct CFG* cfg)
+{
+    int n = cfg->number_of_blocks;
+    int* stack = malloc(n * sizeof(int));
+    int* next_edge = calloc(n, sizeof(int));
+    char* seen = calloc(n, 1);
+    int depth = 0, position = n, b, s;
+
+    cfg->order = malloc(n * sizeof(int));
+    stack[depth++] = 0;
+    seen[0] = TRUE;
+    while (depth > 0)
+    {
+        b = stack[depth - 1];
+        if (next_edge[b] < cfg->blocks[b].number_of_successors)
+        {
+            s = cfg->blocks[b].successors[next_edge[b]++];
+            if (!seen[s])
+            {
+                seen[s] = TRUE;
+                stack[depth++] = s;
+            }
+            continue;
+        }
+        cfg->order[--position] = b;
+        --depth;
+    }
+    free(stack);
+    free(next_edge);
+    free(seen);
+}
+
+struct CFG* build_cfg(struct StatementNode* program)
+{
+    struct PointerMap index;
+    struct StatementNode** found = NULL;
+    struct StatementNode*** out;
+    struct BasicBlock* block;
+    struct CFG* cfg;
+    int *predecessors = NULL, *first_edge = NULL, *target = NULL;
+    int *block_of, *last, *stamp, *counts;
+    char* leader;
+    int number_found = 0, capacity = 0, number_of_targets = 0, target_capacity = 0;
+    int i, k, b, e, n, s, total;
+
+    if (program == NULL)
+        return NULL;
+
+    // Number the reachable statements, count their predecessors and
+    // keep the number of the statement each edge goes to, or -1 for the
+    // end of the program, so the map is only looked in once per edge.
+    // found doubles as the worklist.
+    memset(&index, 0, sizeof(index));
+    capacity = 64;
+    found = malloc(capacity * sizeof(struct StatementNode*));
+    predecessors = malloc(capacity * sizeof(int));
+    first_edge = malloc((capacity + 1) * sizeof(int));
+    map_put(&index, program, 0);
+    found[number_found] = program;
+    predecessors[number_found++] = 1;
+    for (k = 0; k < number_found; k++)
+    {
+        first_edge[k] = number_of_targets;
+        out = get_edges(found[k], &n);
+        if (number_of_targets + n > target_capacity)
+        {
+            target_capacity = 2 * (number_of_targets + n);
+            target = realloc(target, target_capacity * sizeof(int));
+        }
+        for (i = 0; i < n; i++)
+        {
+            s = -1;
+            if (*out[i] != NULL)
+            {
+                s = map_get(&index, *out[i]);
+                if (s < 0)
+                {
+                    if (number_found == capacity)
+                    {
+                        capacity *= 2;
+                        found = realloc(found, capacity * sizeof(struct StatementNode*));
+                        predecessors = realloc(predecessors, capacity * sizeof(int));
+                        first_edge = realloc(first_edge, (capacity + 1) * sizeof(int));
+                    }
+                    s = number_found++;
+                    map_put(&index, *out[i], s);
+                    found[s] = *out[i];
+                    predecessors[s] = 0;
+                }
+                predecessors[s]++;
+            }
+            target[number_of_targets++] = s;
+        }
+    }
+    first_edge[number_found] = number_of_targets;
+    map_free(&index);
+
+    // A block starts at the first statement, at every target of a
+    // branch and wherever control flow joins
+    leader = calloc(number_found, 1);
+    leader[0] = TRUE;
+    for (k = 0; k < number_found; k++)
+    {
+        if (predecessors[k] != 1)
+            leader[k] = TRUE;
+        if (!falls_through(found[k]))
+            for (e = first_edge[k]; e < first_edge[k + 1]; e++)
+                if (target[e] >= 0)
+                    leader[target[e]] = TRUE;
+    }
+
+    cfg = calloc(1, sizeof(struct CFG));
+    cfg->statements = malloc(number_found * sizeof(struct StatementNode*));
+    block_of = malloc(number_found * sizeof(int));
+    for (k = 0; k < number_found; k++)
+        if (leader[k])
+            cfg->number_of_blocks++;
+    cfg->blocks = calloc(cfg->number_of_blocks, sizeof(struct BasicBlock));
+    last = malloc(cfg->number_of_blocks * sizeof(int));
+
+    // Each block runs along next from its leader to the next leader
+    b = 0;
+    for (k = 0; k < number_found; k++)
+    {
+        if (!leader[k])
+            continue;
+        block = &cfg->blocks[b];
+        block->statements = cfg->statements + cfg->number_of_statements;
+        i = k;
+        while (1)
+        {
+            cfg->statements[cfg->number_of_statements++] = found[i];
+            block->number_of_statements++;
+            block_of[i] = b;
+            last[b] = i;
+            if (!falls_through(found[i]) || target[first_edge[i]] < 0)
+                break;
+            i = target[first_edge[i]];
+            if (leader[i])
+                break;
+        }
+        b++;
+    }
+
+    // Successors of each block, each once, then predecessors from them
+    stamp = malloc(cfg->number_of_blocks * sizeof(int));
+    counts = calloc(cfg->number_of_blocks, sizeof(int));
+    for (b = 0; b < cfg->number_of_blocks; b++)
+        stamp[b] = -1;
+    total = 0;
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        for (e = first_edge[last[b]]; e < first_edge[last[b] + 1]; e++)
+        {
+            if (target[e] < 0)
+                continue;
+            s = block_of[target[e]];
+            if (stamp[s] == b)
+                continue;
+            stamp[s] = b;
+            cfg->blocks[b].number_of_successors++;
+            counts[s]++;
+            total++;
+        }
+    }
+    cfg->edges = malloc(2 * (total + 1) * sizeof(int));
+    total = 0;
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        cfg->blocks[b].successors = cfg->edges + total;
+        total += cfg->blocks[b].number_of_successors;
+    }
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        cfg->blocks[b].predecessors = cfg->edges + total;
+        total += counts[b];
+        stamp[b] = -1;
+    }
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        block = &cfg->blocks[b];
+        n = 0;
+        for (e = first_edge[last[b]]; e < first_edge[last[b] + 1]; e++)
+        {
+            if (target[e] < 0)
+                continue;
+            s = block_of[target[e]];
+            if (stamp[s] == b)
+                continue;
+            stamp[s] = b;
+            block->successors[n++] = s;
+            cfg->blocks[s].predecessors[cfg->blocks[s].number_of_predecessors++] = b;
+        }
+    }
+    order_blocks(cfg);
+
+    free(found);
+    free(predecessors);
+    free(first_edge);
+    free(target);
+    free(leader);
+    free(block_of);
+    free(last);
+    free(stamp);
+    free(counts);
+    return cfg;
+}
+
+void free_cfg(struct CFG* cfg)
+{
+    if (cfg == NULL)
+        return;
+    free(cfg->blocks);
+    free(cfg->order);
+    free(cfg->statements);
+    free(cfg->edges);
+    free(cfg);
+}
+
+//---------------------------------------------------------
+// Dataflow
+
+struct Dataflow* new_dataflow(struct CFG* cfg, int bits, int forward, int intersect)
+{
+    struct Dataflow* flow;
+    int words = (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    size_t size;
+
+    if (words == 0)
+        words = 1;
+    if ((size_t) words * cfg->number_of_blocks > MAX_DATAFLOW_WORDS)
+        return NULL;
+    size = (size_t) words * cfg->number_of_blocks * sizeof(unsigned long);
+
+    flow = calloc(1, sizeof(struct Dataflow));
+    flow->forward = forward;
+    flow->intersect = intersect;
+    flow->bits = bits;
+    flow->words = words;
+    flow->gen = calloc(1, size);
+    flow->kill = calloc(1, size);
+    flow->in = calloc(1, size);
+    flow->out = calloc(1, size);
+    flow->boundary = calloc(words, sizeof(unsigned long));
+    return flow;
+}
+
+void free_dataflow(struct Dataflow* flow)
+{
+    if (flow == NULL)
+        return;
+    free(flow->gen);
+    free(flow->kill);
+    free(flow->in);
+    free(flow->out);
+    free(flow->boundary);
+    free(flow);
+}
+
+// Meets the sets of blocks into result, or copies the boundary when
+// there are none
+static void meet(struct Dataflow* flow, unsigned long* result, unsigned long* sets,
+                 int* blocks, int number_of_blocks, int with_boundary)
+{
+    unsigned long* set;
+    int i, w;
+
+    if (with_boundary || number_of_blocks == 0)
+        memcpy(result, flow->boundary, flow->words * sizeof(unsigned long));
+    else
+        memcpy(result, sets + (size_t) blocks[0] * flow->words, flow->words * sizeof(unsigned long));
+    for (i = 0; i < number_of_blocks; i++)
+    {
+        set = sets + (size_t) blocks[i] * flow->words;
+        for (w = 0; w < flow->words; w++)
+            result[w] = flow->intersect ? (result[w] & set[w]) : (result[w] | set[w]);
+    }
+}
+
+void solve_dataflow(struct CFG* cfg, struct Dataflow* flow)
+{
+    int n = cfg->number_of_blocks;
+    int* queue = malloc((n + 1) * sizeof(int));
+    char* queued = malloc(n);
+    unsigned long *input, *output, *gen, *kill, x;
+    struct BasicBlock* block;
+    int head = 0, tail = 0, i, b, w, changed, count;
+    int* neighbours;
+
+    // Must problems start from everything and shrink
+    if (flow->intersect)
+        memset(flow->forward ? flow->out : flow->in, 0xff,
+               (size_t) flow->words * n * sizeof(unsigned long));
+
+    // Start in an order where most inputs are ready: reverse postorder
+    // going forward and postorder going backward
+    for (i = 0; i < n; i++)
+    {
+        queue[tail++] = cfg->order[flow->forward ? i : n - 1 - i];
+        queued[i] = TRUE;
+    }
+    tail %= n + 1;
+
+    while (head != tail)
+    {
+        b = queue[head];
+        head = (head + 1) % (n + 1);
+        queued[b] = FALSE;
+        block = &cfg->blocks[b];
+        gen = BLOCK_SET(flow, gen, b);
+        kill = BLOCK_SET(flow, kill, b);
+        if (flow->forward)
+        {
+            input = BLOCK_SET(flow, in, b);
+            output = BLOCK_SET(flow, out, b);
+            meet(flow, input, flow->out, block->predecessors, block->number_of_predecessors, b == 0);
+            neighbours = block->successors;
+            count = block->number_of_successors;
+        }
+        else
+        {
+            input = BLOCK_SET(flow, out, b);
+            output = BLOCK_SET(flow, in, b);
+            meet(flow, input, flow->in, block->successors, block->number_of_successors, FALSE);
+            neighbours = block->predecessors;
+            count = block->number_of_predecessors;
+        }
+
+        changed = FALSE;
+        for (w = 0; w < flow->words; w++)
+        {
+            x = gen[w] | (input[w] & ~kill[w]);
+            if (x != output[w])
+            {
+                output[w] = x;
+                changed = TRUE;
+            }
+        }
+        if (!changed)
+            continue;
+        for (i = 0; i < count; i++)
+        {
+            if (queued[neighbours[i]])
+                continue;
+            queued[neighbours[i]] = TRUE;
+            queue[tail] = neighbours[i];
+            tail = (tail + 1) % (n + 1);
+        }
+    }
+    free(queue);
+    free(queued);
+}
+
+//---------------------------------------------------------
+// Liveness
+
+struct Dataflow* find_liveness(struct CFG* cfg)
+{
+    struct Dataflow* flow = new_dataflow(cfg, number_of_vars, FALSE, FALSE);
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    unsigned long *gen, *kill;
+    int** uses;
+    int b, i, k, n, v;
+
+    if (flow == NULL)
+        return NULL;
+
+    // Going backward through a block, a variable read before it is
+    // written is used and one written is killed
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        block = &cfg->blocks[b];
+        gen = BLOCK_SET(flow, gen, b);
+        kill = BLOCK_SET(flow, kill, b);
+        for (i = block->number_of_statements - 1; i >= 0; i--)
+        {
+            st = block->statements[i];
+            if (st->type == ASSIGN_STMT)
+            {
+                v = st->assign_stmt->left_hand_side;
+                CLEAR_BIT(gen, v);
+                SET_BIT(kill, v);
+            }
+            uses = get_uses(st, &n);
+            for (k = 0; k < n; k++)
+                if (*uses[k] < number_of_vars)
+                    SET_BIT(gen, *uses[k]);
+        }
+    }
+    solve_dataflow(cfg, flow);
+    return flow;
+}
+
+//---------------------------------------------------------
+// Reaching definitions
+
+static void find_definitions(struct CFG* cfg, struct Definitions* defs)
+{
+    struct StatementNode* st;
+    int i, v, d;
+
+    memset(defs, 0, sizeof(struct Definitions));
+    defs->count = number_of_vars;
+    for (i = 0; i < cfg->number_of_statements; i++)
+        if (cfg->statements[i]->type == ASSIGN_STMT)
+            defs->count++;
+    defs->statement = calloc(defs->count, sizeof(struct StatementNode*));
+    defs->var = malloc(defs->count * sizeof(int));
+    defs->of_var_start = calloc(number_of_vars + 1, sizeof(int));
+    defs->of_var = malloc(defs->count * sizeof(int));
+
+    for (v = 0; v < number_of_vars; v++)
+        defs->var[v] = v;
+    d = number_of_vars;
+    for (i = 0; i < cfg->number_of_statements; i++)
+    {
+        st = cfg->statements[i];
+        if (st->type != ASSIGN_STMT)
+            continue;
+        defs->statement[d] = st;
+        defs->var[d++] = st->assign_stmt->left_hand_side;
+    }
+
+    // Group the definitions by variable
+    for (d = 0; d < defs->count; d++)
+        defs->of_var_start[defs->var[d] + 1]++;
+    for (v = 0; v < number_of_vars; v++)
+        defs->of_var_start[v + 1] += defs->of_var_start[v];
+    for (d = 0; d < defs->count; d++)
+        defs->of_var[defs->of_var_start[defs->var[d]]++] = d;
+    for (v = number_of_vars; v > 0; v--)
+        defs->of_var_start[v] = defs->of_var_start[v - 1];
+    defs->of_var_start[0] = 0;
+}
+
+struct Dataflow* find_reaching_definitions(struct CFG* cfg, struct Definitions* defs)
+{
+    struct Dataflow* flow;
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    unsigned long *gen, *kill;
+    int *last, *last_block;
+    int b, i, k, v, d;
+
+    find_definitions(cfg, defs);
+    flow = new_dataflow(cfg, defs->count, TRUE, FALSE);
+    if (flow == NULL)
+        return NULL;
+
+    // Every variable starts out defined as 0
+    for (v = 0; v < number_of_vars; v++)
+        SET_BIT(flow->boundary, v);
+
+    // A block generates the last definition of each variable it
+    // assigns and kills all the others
+    last = malloc((number_of_vars + 1) * sizeof(int));
+    last_block = malloc((number_of_vars + 1) * sizeof(int));
+    for (v = 0; v < number_of_vars; v++)
+        last_block[v] = -1;
+    d = number_of_vars;
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        block = &cfg->blocks[b];
+        gen = BLOCK_SET(flow, gen, b);
+        kill = BLOCK_SET(flow, kill, b);
+        for (i = 0; i < block->number_of_statements; i++)
+        {
+            st = block->statements[i];
+            if (st->type != ASSIGN_STMT)
+                continue;
+            v = st->assign_stmt->left_hand_side;
+            if (last_block[v] == b)
+                CLEAR_BIT(gen, last[v]);
+            else
+                for (k = defs->of_var_start[v]; k < defs->of_var_start[v + 1]; k++)
+                    SET_BIT(kill, defs->of_var[k]);
+            last_block[v] = b;
+            last[v] = d;
+            SET_BIT(gen, d);
+            d++;
+        }
+    }
+    free(last);
+    free(last_block);
+    solve_dataflow(cfg, flow);
+    return flow;
+}
+
+void free_definitions(struct Definitions* defs)
+{
+    free(defs->statement);
+    free(defs->var);
+    free(defs->of_var_start);
+    free(defs->of_var);
+}
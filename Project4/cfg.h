@@ -0,0 +1,117 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the basic block view of the
+//  statement graph and the bit vector dataflow solver over it.
+//--------------------------------------------------------------
+#ifndef _CFG_H_
+#define _CFG_H_
+
+#include "compiler.h"
+
+// Returns the fields of st that point to the statements it can go to
+// next and sets count to how many there are. The array is reused by
+// the next call. The next field of an IF_STMT or SWITCH_STMT is never
+// followed when running, so it is not an edge.
+struct StatementNode*** get_edges(struct StatementNode* st, int* count);
+
+// Returns the operand fields of st that are read when it runs, which
+// may name variables or constants, and sets count the same way
+int** get_uses(struct StatementNode* st, int* count);
+
+//---------------------------------------------------------
+// Basic blocks
+
+// A run of statements that is only entered at the first one and only
+// left after the last one. Only the last statement can be an IF_STMT,
+// SWITCH_STMT or GOTO_STMT.
+struct BasicBlock
+{
+    struct StatementNode** statements;
+    int number_of_statements;
+
+    int* successors;        // block numbers, each once
+    int number_of_successors;
+    int* predecessors;
+    int number_of_predecessors;
+};
+
+struct CFG
+{
+    struct BasicBlock* blocks;  // blocks[0] holds the first statement
+    int number_of_blocks;
+
+    // Blocks in reverse postorder from blocks[0]
+    int* order;
+
+    // Storage the blocks point into
+    struct StatementNode** statements;
+    int number_of_statements;
+    int* edges;
+};
+
+// Returns NULL when program is empty
+struct CFG* build_cfg(struct StatementNode* program);
+void free_cfg(struct CFG* cfg);
+
+//---------------------------------------------------------
+// Dataflow
+
+#define BITS_PER_WORD (8 * (int) sizeof(unsigned long))
+
+#define SET_BIT(set, i)   ((set)[(i) / BITS_PER_WORD] |= 1ul << ((i) % BITS_PER_WORD))
+#define CLEAR_BIT(set, i) ((set)[(i) / BITS_PER_WORD] &= ~(1ul << ((i) % BITS_PER_WORD)))
+#define TEST_BIT(set, i)  (((set)[(i) / BITS_PER_WORD] >> ((i) % BITS_PER_WORD)) & 1)
+
+// A gen/kill problem with one bit set of words words per block:
+// out = gen | (in & ~kill) going forward, and in = gen | (out & ~kill)
+// going backward. Sets meet by union, or by intersection for must
+// problems. The boundary is the set flowing into the first block, or
+// out of blocks with no successors going backward.
+struct Dataflow
+{
+    int forward;
+    int intersect;
+    int bits;
+    int words;
+
+    unsigned long* gen;     // number_of_blocks sets each
+    unsigned long* kill;
+    unsigned long* in;
+    unsigned long* out;
+    unsigned long* boundary;
+};
+
+// The sets of block b in one of the arrays of a problem
+#define BLOCK_SET(flow, sets, b) ((flow)->sets + (size_t) (b) * (flow)->words)
+
+// Returns a problem with empty gen and kill sets and an empty boundary,
+// or NULL when its sets would take more memory than is worth it
+struct Dataflow* new_dataflow(struct CFG* cfg, int bits, int forward, int intersect);
+void solve_dataflow(struct CFG* cfg, struct Dataflow* flow);
+void free_dataflow(struct Dataflow* flow);
+
+// Variables live at the start (in) and end (out) of each block
+struct Dataflow* find_liveness(struct CFG* cfg);
+
+// Definitions are numbered with one for the 0 each variable starts
+// with, definition v for variable v, followed by one for each
+// assignment in the order of cfg->statements, which is the order of
+// the blocks and of the statements in each block
+struct Definitions
+{
+    int count;
+    struct StatementNode** statement;   // NULL for the starting 0
+    int* var;
+
+    // The definitions of variable v are
+    // of_var[of_var_start[v]] to of_var[of_var_start[v + 1] - 1]
+    int* of_var_start;
+    int* of_var;
+};
+
+// Definitions that may reach the start (in) and end (out) of each block
+struct Dataflow* find_reaching_definitions(struct CFG* cfg, struct Definitions* defs);
+void free_definitions(struct Definitions* defs);
+
+#endif /* _CFG_H_ */
@@ -8,23 +8,152 @@
 
 #include "code_graph.h"
 
-struct ValueNode* table[MAX_NUMBER_OF_VARS];
-int number_of_vars = 0;
-int number_of_ints = 0;
+__thread int* slots = NULL;
+__thread char** slot_names = NULL;
+__thread int number_of_slots = 0;
+__thread int number_of_vars = 0;
+
+__thread int slot_capacity = 0;
+
+// Variable names are found through an open addressing index from name
+// to slot, kept at most half full
+__thread int* symbol_index = NULL;
+__thread int symbol_index_size = 0;
+
+// Constants are deduplicated through an open addressing index from
+// value to slot, kept at most half full
+__thread int* constant_index = NULL;
+__thread int constant_index_size = 0;
+__thread int number_of_constants = 0;
 
 struct StatementNode* parse_body();
 
-struct ValueNode* get_symbol(char* name)
+// Statements remember the line they start on for the profiler
+struct StatementNode* new_statement()
 {
-    int i;    
-    for (i = 0; i < number_of_vars; i++)
+    struct StatementNode* st = ALLOC(struct StatementNode);
+    st->line_no = line_no;
+    return st;
+}
+
+int add_slot(char* name, int value)
+{
+    if (number_of_slots == slot_capacity)
+    {
+        slot_capacity = (slot_capacity == 0) ? 64 : 2 * slot_capacity;
+        slots = realloc(slots, slot_capacity * sizeof(int));
+        slot_names = realloc(slot_names, slot_capacity * sizeof(char*));
+    }
+    slots[number_of_slots] = value;
+    slot_names[number_of_slots] = name;
+    return number_of_slots++;
+}
+
+unsigned int hash_constant(int value)
+{
+    unsigned int h = (unsigned int) value * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+void insert_constant(int slot)
+{
+    unsigned int mask = constant_index_size - 1;
+    unsigned int h = hash_constant(slots[slot]) & mask;
+
+    while (constant_index[h] >= 0)
+        h = (h + 1) & mask;
+    constant_index[h] = slot;
+}
+
+// Returns the slot that holds the constant value, adding it if needed
+int get_constant(int value)
+{
+    unsigned int mask, h;
+    int i;
+
+    if (2 * (number_of_constants + 1) > constant_index_size)
+    {
+        int* old = constant_index;
+        int old_size = constant_index_size;
+
+        constant_index_size = (old_size == 0) ? 64 : 2 * old_size;
+        constant_index = malloc(constant_index_size * sizeof(int));
+        for (i = 0; i < constant_index_size; i++)
+            constant_index[i] = -1;
+        for (i = 0; i < old_size; i++)
+            if (old[i] >= 0)
+                insert_constant(old[i]);
+        free(old);
+    }
+    mask = constant_index_size - 1;
+    for (h = hash_constant(value) & mask; constant_index[h] >= 0; h = (h + 1) & mask)
+    {
+        if (slots[constant_index[h]] == value)
+            return constant_index[h];
+    }
+    i = add_slot(NULL, value);
+    constant_index[h] = i;
+    ++number_of_constants;
+    return i;
+}
+
+unsigned int hash_name(const char* s)
+{
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the position of name in symbol_index[], which holds -1 if
+// the name was not declared
+unsigned int find_symbol(const char* name)
+{
+    unsigned int mask = symbol_index_size - 1;
+    unsigned int h = hash_name(name) & mask;
+
+    while (symbol_index[h] >= 0 && strcmp(name, slot_names[symbol_index[h]]) != 0)
+        h = (h + 1) & mask;
+    return h;
+}
+
+// Returns the slot of the variable or -1 if it was not declared
+int get_symbol(char* name)
+{
+    if (symbol_index_size == 0)
+        return -1;
+    return symbol_index[find_symbol(name)];
+}
+
+// Declares a variable, a name that is declared twice keeps its first slot
+void add_symbol(char* name)
+{
+    unsigned int h;
+    int i;
+
+    if (2 * (number_of_vars + 1) > symbol_index_size)
     {
-        if (strcmp(name, table[i]->name) == 0)
+        free(symbol_index);
+        symbol_index_size = (symbol_index_size == 0) ? 64 : 2 * symbol_index_size;
+        symbol_index = malloc(symbol_index_size * sizeof(int));
+        for (i = 0; i < symbol_index_size; i++)
+            symbol_index[i] = -1;
+        for (i = 0; i < number_of_vars; i++)
         {
-            return table[i];
+            h = find_symbol(slot_names[i]);
+            if (symbol_index[h] < 0)
+                symbol_index[h] = i;
         }
     }
-    return NULL;
+    i = add_slot(strdup(name), 0);
+    ++number_of_vars;
+    h = find_symbol(name);
+    if (symbol_index[h] < 0)
+        symbol_index[h] = i;
 }
 
 void parse_id_list()
@@ -33,18 +162,14 @@ void parse_id_list()
     while (ttype != SEMICOLON)
     {
         ttype = getToken();        
-        table[number_of_vars] = ALLOC(struct ValueNode);
-        table[number_of_vars]->value = 0;
-        table[number_of_vars]->name = malloc(strlen(token)+1);
-        strcpy(table[number_of_vars]->name, token);    
-        ++number_of_vars;
+        add_symbol(token);
         ttype = getToken();
     }
 }
 
 struct StatementNode* parse_assign()
 {
-    struct StatementNode* st = ALLOC(struct StatementNode);
+    struct StatementNode* st = new_statement();
     st->next = NULL;
     ttype = getToken();
     if (ttype == ID)
@@ -63,18 +188,14 @@ struct StatementNode* parse_assign()
                     st->assign_stmt->operand1 = get_symbol(token);
                     break;
                 case NUM:
-                    table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                    table[number_of_vars+number_of_ints]->value = atoi(token);
-                    table[number_of_vars+number_of_ints]->name = "";    
-                    st->assign_stmt->operand1 = table[number_of_vars+number_of_ints];
-                    ++number_of_ints;
+                    st->assign_stmt->operand1 = get_constant(atoi(token));
                     break;
             }
         ttype = getToken();
         if (ttype == SEMICOLON)
         {
             st->assign_stmt->op = 0;
-            st->assign_stmt->operand2 = NULL;
+            st->assign_stmt->operand2 = -1;
         }
         else
         {
@@ -86,11 +207,7 @@ struct StatementNode* parse_assign()
                     st->assign_stmt->operand2 = get_symbol(token);
                     break;
                 case NUM:
-                    table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                    table[number_of_vars+number_of_ints]->value = atoi(token);
-                    table[number_of_vars+number_of_ints]->name = "";    
-                    st->assign_stmt->operand2 = table[number_of_vars+number_of_ints];
-                    ++number_of_ints;
+                    st->assign_stmt->operand2 = get_constant(atoi(token));
                     break;
             }
             ttype = getToken(); // SEMICOLON
@@ -101,7 +218,7 @@ struct StatementNode* parse_assign()
 
 struct StatementNode* parse_print()
 {
-    struct StatementNode* st = ALLOC(struct StatementNode);
+    struct StatementNode* st = new_statement();
     st->next = NULL;
     ttype = getToken();
     if (ttype == PRINT)
@@ -115,269 +232,383 @@ struct StatementNode* parse_print()
     return st;
 }
 
-struct StatementNode* parse_while()
+//---------------------------------------------------------
+// Bodies
+//
+// Statements are parsed without recursion. Every body that is still
+// open has an entry on the body stack holding the list parsed so far,
+// and each statement is linked to the one before it through the tail
+// of the list, so building the graph takes time linear in its size
+// whatever the nesting.
+
+enum BodyKind
 {
-    struct StatementNode* st = ALLOC(struct StatementNode);
-    struct StatementNode* end = ALLOC(struct StatementNode);
-    struct StatementNode* loop = ALLOC(struct StatementNode);
-    loop->type = GOTO_STMT;
-    end->type = NOOP_STMT;
-    st->type = IF_STMT;
-    st->if_stmt = ALLOC(struct IfStatement);
-    st->next = end;
-    loop->next = NULL;
-    end->next = NULL;
-    loop->goto_stmt = ALLOC(struct GotoStatement);
- 
-    ttype = getToken();
-    if (ttype == WHILE)
+    TOP_BODY,
+    WHILE_BODY,
+    IF_BODY,
+    CASE_BODY,
+    DEFAULT_BODY
+};
+
+struct Body
+{
+    enum BodyKind kind;
+    struct StatementNode* head; // first statement of the body
+    struct StatementNode* tail; // last statement, its next is NULL
+
+    struct StatementNode* st;   // the IF_STMT or SWITCH_STMT the body is in
+    struct StatementNode* end;  // the NOOP_STMT after the statement
+    struct StatementNode* loop; // the GOTO_STMT after a while or case body
+
+    int value;                  // of the case
+};
+
+__thread struct Body* bodies = NULL;
+__thread int body_depth = 0;
+__thread int body_capacity = 0;
+
+struct Body* open_body(enum BodyKind kind)
+{
+    if (body_depth == body_capacity)
     {
-        // Parse condition
-        ttype = getToken();  //operand1
-        switch (ttype)
-        {
-            case ID:
-                st->if_stmt->condition_operand1 = get_symbol(token);
-                break;
-            case NUM:
-                table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                   table[number_of_vars+number_of_ints]->value = atoi(token);
-                   table[number_of_vars+number_of_ints]->name = "";    
-                   st->if_stmt->condition_operand1 = table[number_of_vars+number_of_ints];
-                   ++number_of_ints;
-                   break;
-        }
-        ttype = getToken(); // Op
-        st->if_stmt->condition_op = ttype;
-        ttype = getToken(); //operand2
-        switch (ttype)
-        {
-                case ID:
-                   st->if_stmt->condition_operand2 = get_symbol(token);
-                   break;
-                case NUM:
-                   table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                   table[number_of_vars+number_of_ints]->value = atoi(token);
-                   table[number_of_vars+number_of_ints]->name = "";    
-                   st->if_stmt->condition_operand2 = table[number_of_vars+number_of_ints];
-                   ++number_of_ints;
-                   break;
-        }
-        st->if_stmt->true_branch = parse_body();
-        st->if_stmt->false_branch = end;
-        loop->goto_stmt->target = st;
-        struct StatementNode* current = st->if_stmt->true_branch;
-        while (current->next != NULL)
-        {
-            current = current->next;
-        }
-        current->next = loop;
+        body_capacity = (body_capacity == 0) ? 64 : 2 * body_capacity;
+        bodies = realloc(bodies, body_capacity * sizeof(struct Body));
     }
-    return st;
+    memset(&bodies[body_depth], 0, sizeof(struct Body));
+    bodies[body_depth].kind = kind;
+    ttype = getToken(); // LBRACE
+    return &bodies[body_depth++];
 }
-struct StatementNode* parse_if()
+
+// Adds the statements from head to tail at the end of body
+void append(struct Body* body, struct StatementNode* head, struct StatementNode* tail)
 {
-    struct StatementNode* st = ALLOC(struct StatementNode);
-    struct StatementNode* end = ALLOC(struct StatementNode);
-    end->type = NOOP_STMT;
+    if (body->head == NULL)
+        body->head = head;
+    else
+        body->tail->next = head;
+    body->tail = tail;
+}
+
+// Links the last statement of body to next and returns the first
+// statement, or next when the body is empty
+struct StatementNode* close_body(struct Body* body, struct StatementNode* next)
+{
+    if (body->head == NULL)
+        return next;
+    body->tail->next = next;
+    return body->head;
+}
+
+int parse_primary()
+{
+    ttype = getToken();
+    if (ttype == NUM)
+        return get_constant(atoi(token));
+    return get_symbol(token);
+}
+
+// Parses the condition of a while or if statement into a new IF_STMT
+struct StatementNode* parse_condition()
+{
+    struct StatementNode* st = new_statement();
     st->type = IF_STMT;
     st->if_stmt = ALLOC(struct IfStatement);
+    st->if_stmt->condition_operand1 = parse_primary();
+    ttype = getToken(); // Op
+    st->if_stmt->condition_op = ttype;
+    st->if_stmt->condition_operand2 = parse_primary();
+    return st;
+}
+
+void parse_while()
+{
+    struct Body* body;
+    struct StatementNode* st = parse_condition();
+    struct StatementNode* end = new_statement();
+    struct StatementNode* loop = new_statement();
+    end->type = NOOP_STMT;
+    loop->type = GOTO_STMT;
+    loop->goto_stmt = ALLOC(struct GotoStatement);
+    loop->goto_stmt->target = st;
     st->next = end;
-    end->next = NULL;
+    st->if_stmt->false_branch = end;
 
-    ttype = getToken();
-    if (ttype == IF)
+    body = open_body(WHILE_BODY);
+    body->st = st;
+    body->end = end;
+    body->loop = loop;
+}
+
+void parse_if()
+{
+    struct Body* body;
+    struct StatementNode* st = parse_condition();
+    struct StatementNode* end = new_statement();
+    end->type = NOOP_STMT;
+    st->next = end;
+    st->if_stmt->false_branch = end;
+
+    body = open_body(IF_BODY);
+    body->st = st;
+    body->end = end;
+}
+
+//---------------------------------------------------------
+// Switch statements
+//
+// A switch is a single SWITCH_STMT that goes straight to the body of
+// the matching case. When the case values are dense it looks the value
+// up in a table, otherwise it binary searches the sorted values.
+
+// Case values are dense when a table over their range is at most this
+// many times larger than the number of cases
+#define DENSE_FACTOR 4
+
+// The case values sorted together with the order they were written in
+struct CaseOrder
+{
+    int value;
+    int order;
+};
+
+int compare_cases(const void* a, const void* b)
+{
+    const struct CaseOrder* x = a;
+    const struct CaseOrder* y = b;
+
+    if (x->value != y->value)
+        return (x->value < y->value) ? -1 : 1;
+    return x->order - y->order;
+}
+
+void add_case(struct SwitchStatement* sw, int value, struct StatementNode* target)
+{
+    int n = sw->number_of_cases;
+
+    // The arrays grow whenever the number of cases reaches a power of two
+    if ((n & (n - 1)) == 0)
     {
-        // Parse condition
-        ttype = getToken(); //operand1
-        switch (ttype)
-        {
-                case ID:
-                   st->if_stmt->condition_operand1 = get_symbol(token);
-                   break;
-                case NUM:
-                   table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                   table[number_of_vars+number_of_ints]->value = atoi(token);
-                   table[number_of_vars+number_of_ints]->name = "";    
-                   st->if_stmt->condition_operand1 = table[number_of_vars+number_of_ints];
-                   ++number_of_ints;
-                   break;
-        }
-        ttype = getToken(); // Op
-        st->if_stmt->condition_op = ttype;
-        ttype = getToken(); //operand2
-        switch (ttype)
-        {
-                case ID:
-                   st->if_stmt->condition_operand2 = get_symbol(token);
-                   break;
-                case NUM:
-                   table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-                   table[number_of_vars+number_of_ints]->value = atoi(token);
-                   table[number_of_vars+number_of_ints]->name = "";    
-                   st->if_stmt->condition_operand2 = table[number_of_vars+number_of_ints];
-                   ++number_of_ints;
-                   break;
-        }
-        st->if_stmt->true_branch = parse_body();
-        st->if_stmt->false_branch = end;
-        struct StatementNode* current = st->if_stmt->true_branch;
-        while (current->next != NULL)
-        {
-            current = current->next;
-        }
-        current->next = end;
-    }    
-    return st;
+        sw->values = realloc(sw->values, (n == 0 ? 1 : 2 * n) * sizeof(int));
+        sw->targets = realloc(sw->targets, (n == 0 ? 1 : 2 * n) * sizeof(struct StatementNode*));
+    }
+    sw->values[n] = value;
+    sw->targets[n] = target;
+    sw->number_of_cases++;
 }
 
-struct StatementNode* parse_case()
+// Sorts the cases, keeps the first of any that share a value as the
+// chain of comparisons did, and builds the table if the values are dense
+void finish_switch(struct SwitchStatement* sw)
 {
-    struct StatementNode* st = ALLOC(struct StatementNode);
-    st->if_stmt = ALLOC(struct IfStatement);
-    st->type = IF_STMT;
-    st->next = NULL;
-    st->if_stmt->condition_op = NOTEQUAL;
-    st->if_stmt->true_branch = NULL;
-    ttype = getToken();
-    if (ttype == CASE)
+    int n = sw->number_of_cases;
+    struct CaseOrder* order = malloc(n * sizeof(struct CaseOrder));
+    struct StatementNode** targets = malloc(n * sizeof(struct StatementNode*));
+    long range;
+    int i, k = 0;
+
+    for (i = 0; i < n; i++)
     {
-        ttype = getToken(); //operand2
-        table[number_of_vars+number_of_ints] = ALLOC(struct ValueNode);
-        table[number_of_vars+number_of_ints]->value = atoi(token);
-        table[number_of_vars+number_of_ints]->name = "";    
-        st->if_stmt->condition_operand2 = table[number_of_vars+number_of_ints];
-        ++number_of_ints;
-        ttype = getToken(); //COLON
-        st->if_stmt->false_branch = parse_body();
+        order[i].value = sw->values[i];
+        order[i].order = i;
+    }
+    qsort(order, n, sizeof(struct CaseOrder), compare_cases);
+    for (i = 0; i < n; i++)
+    {
+        if (k > 0 && sw->values[k - 1] == order[i].value)
+            continue;
+        targets[k] = sw->targets[order[i].order];
+        sw->values[k++] = order[i].value;
+    }
+    free(sw->targets);
+    free(order);
+    sw->targets = targets;
+    sw->number_of_cases = n = k;
+
+    sw->dense = NULL;
+    sw->dense_size = 0;
+    if (n == 0)
+        return;
+    range = (long) sw->values[n - 1] - sw->values[0] + 1;
+    if (range <= (long) DENSE_FACTOR * n)
+    {
+        sw->low = sw->values[0];
+        sw->dense_size = (int) range;
+        sw->dense = malloc(range * sizeof(int));
+        for (i = 0; i < range; i++)
+            sw->dense[i] = -1;
+        for (i = 0; i < n; i++)
+            sw->dense[sw->values[i] - sw->low] = i;
     }
-    return st;
 }
 
-struct StatementNode* parse_switch()
+int find_case(struct SwitchStatement* sw, int value)
 {
-    struct StatementNode* end = ALLOC(struct StatementNode);
-    struct StatementNode* loop = ALLOC(struct StatementNode);
-    struct StatementNode *st, *current, *old_st = NULL;
-    struct ValueNode* var;
-    loop->type = GOTO_STMT;
-    end->type = NOOP_STMT;
-    loop->next = NULL;
-    end->next = NULL;
-    loop->goto_stmt = ALLOC(struct GotoStatement);
-    loop->goto_stmt->target = end;
+    int low = 0, high = sw->number_of_cases - 1, mid;
 
-    ttype = getToken();
-    if (ttype == SWITCH)
+    if (sw->dense != NULL)
     {
-        // Parse condition
-        ttype = getToken();  //operand1
-        var = get_symbol(token);
-        ttype = getToken(); // LBRACE
-        ttype = getToken(); // CASE
-        while (ttype == CASE)
-        {
-            ungetToken();            
-            st = parse_case();            
-            st->if_stmt->condition_operand1 = var;
-            current = st->if_stmt->false_branch;
-            while (current->next != NULL)
-            {
-                current = current->next;
-            }
-            current->next = loop;
-            st->next = end;
-            st->if_stmt->true_branch = end;
-            if (old_st) {old_st->if_stmt->true_branch = st; old_st->next = st;}
-            old_st = st;
-            ttype = getToken();
-        }
-        if (ttype == DEFAULT)
-        {
-            ttype = getToken(); // COLON
-            st->next = parse_body();
-            st->if_stmt->true_branch = st->next;
-        }
-        struct StatementNode *current = st;
-        while (current->next != NULL)
-        {
-            current = current->next;
-        }
-        current->next = end;
+        // Unsigned so that values below low wrap past dense_size
+        unsigned int i = (unsigned int) value - (unsigned int) sw->low;
+        return (i < (unsigned int) sw->dense_size) ? sw->dense[i] : -1;
     }
-    return st;
+    while (low <= high)
+    {
+        mid = low + (high - low) / 2;
+        if (sw->values[mid] < value)
+            low = mid + 1;
+        else if (sw->values[mid] > value)
+            high = mid - 1;
+        else
+            return mid;
+    }
+    return -1;
 }
 
-struct StatementNode* parse_stmt()
-{
-	struct StatementNode* st;
-	ttype = getToken();
-	switch (ttype)
-	{
-		case ID:
-			ungetToken();
-			st = parse_assign();
-			break;
-		case PRINT:
-			ungetToken();
-			st = parse_print();
-			break;
-		case WHILE:
-			ungetToken();
-			st = parse_while();
-			break;
-		case IF:
-			ungetToken();
-			st = parse_if();
-			break;
-		case SWITCH:
-			ungetToken();
-			st = parse_switch();
-			break;	
-	}
-	return st;
+// Parses CASE NUM COLON and opens the body of the case
+void parse_case(struct StatementNode* st, struct StatementNode* end,
+                struct StatementNode* loop)
+{
+    struct Body* body;
+    int value;
+
+    ttype = getToken(); // NUM
+    value = atoi(token);
+    ttype = getToken(); // COLON
+
+    body = open_body(CASE_BODY);
+    body->st = st;
+    body->end = end;
+    body->loop = loop;
+    body->value = value;
+}
+
+void parse_switch()
+{
+    struct StatementNode* st = new_statement();
+    struct StatementNode* end = new_statement();
+    struct StatementNode* loop = new_statement();
+    end->type = NOOP_STMT;
+    loop->type = GOTO_STMT;
+    loop->goto_stmt = ALLOC(struct GotoStatement);
+    loop->goto_stmt->target = end;
+    st->type = SWITCH_STMT;
+    st->switch_stmt = ALLOC(struct SwitchStatement);
+    st->switch_stmt->default_target = end;
+    st->next = end;
+
+    ttype = getToken();
+    st->switch_stmt->var = get_symbol(token);
+    ttype = getToken(); // LBRACE
+    ttype = getToken(); // CASE
+    parse_case(st, end, loop);
 }
 
-struct StatementNode* parse_stmt_list()
+// Goes on after the body of a case with the next case, the default
+// case or the end of the switch
+void parse_after_case(struct Body* body)
 {
-    struct StatementNode *st, *stl;
-    st = parse_stmt();
+    struct Body* outer;
+
     ttype = getToken();
-    if ((ttype == ID) || (ttype == PRINT) || (ttype == WHILE) || (ttype == IF) || (ttype == SWITCH))
+    if (ttype == CASE)
     {
-        ungetToken();
-        stl = parse_stmt_list();
-	    if (st->type == IF_STMT)
-	    {
-            struct StatementNode *current = st->next;	  
-            while (current->type != NOOP_STMT)
-            {
-                current = current->next;
-            }
-            current->next = stl;
-	    }
-	    else
-	    {
-	      st->next = stl;
-	    } 
+        parse_case(body->st, body->end, body->loop);
+        return;
     }
-    else
+    if (ttype == DEFAULT)
     {
-        ungetToken();
+        ttype = getToken(); // COLON
+        outer = open_body(DEFAULT_BODY);
+        outer->st = body->st;
+        outer->end = body->end;
+        return;
+    }
+    // RBRACE of the switch
+    finish_switch(body->st->switch_stmt);
+    outer = &bodies[body_depth - 1];
+    append(outer, body->st, body->end);
+}
+
+void parse_stmt(struct Body* body)
+{
+    struct StatementNode* st;
+
+    switch (ttype)
+    {
+        case ID:
+            ungetToken();
+            st = parse_assign();
+            append(body, st, st);
+            break;
+        case PRINT:
+            ungetToken();
+            st = parse_print();
+            append(body, st, st);
+            break;
+        case WHILE:
+            parse_while();
+            break;
+        case IF:
+            parse_if();
+            break;
+        case SWITCH:
+            parse_switch();
+            break;
     }
-    return st;
 }
 
 struct StatementNode* parse_body()
 {
-	struct StatementNode* stl;
-	ttype = getToken();
-	if (ttype == LBRACE)
-	{
-		stl = parse_stmt_list();
-	}
-	ttype = getToken(); // get the RBRACE
-	return stl;
+    struct Body body;
+    struct Body* outer;
+
+    open_body(TOP_BODY);
+    while (1)
+    {
+        ttype = getToken();
+        if ((ttype == ID) || (ttype == PRINT) || (ttype == WHILE) || (ttype == IF) || (ttype == SWITCH))
+        {
+            parse_stmt(&bodies[body_depth - 1]);
+            continue;
+        }
+
+        // Any other token ends the innermost body, it is copied
+        // because opening the next case may move the stack
+        body = bodies[--body_depth];
+        outer = &bodies[body_depth - 1];
+        switch (body.kind)
+        {
+            case TOP_BODY:
+                return body.head;
+
+            case WHILE_BODY:
+                // Going round the loop and leaving it belong to the
+                // closing brace
+                body.loop->line_no = body.end->line_no = line_no;
+                body.st->if_stmt->true_branch = close_body(&body, body.loop);
+                append(outer, body.st, body.end);
+                break;
+
+            case IF_BODY:
+                body.end->line_no = line_no;
+                body.st->if_stmt->true_branch = close_body(&body, body.end);
+                append(outer, body.st, body.end);
+                break;
+
+            case CASE_BODY:
+                add_case(body.st->switch_stmt, body.value, close_body(&body, body.loop));
+                parse_after_case(&body);
+                break;
+
+            case DEFAULT_BODY:
+                body.st->switch_stmt->default_target = close_body(&body, body.end);
+                ttype = getToken(); // RBRACE of the switch
+                finish_switch(body.st->switch_stmt);
+                append(outer, body.st, body.end);
+                break;
+        }
+    }
 }
 
 struct StatementNode* parse_generate_intermediate_representation()
@@ -385,3 +616,19 @@ struct StatementNode* parse_generate_intermediate_representation()
   parse_id_list();
   return parse_body();
 }
+
+void reset_slots()
+{
+    int i;
+
+    for (i = 0; i < number_of_vars; i++)
+        free(slot_names[i]);
+    for (i = 0; i < symbol_index_size; i++)
+        symbol_index[i] = -1;
+    for (i = 0; i < constant_index_size; i++)
+        constant_index[i] = -1;
+    number_of_slots = 0;
+    number_of_vars = 0;
+    number_of_constants = 0;
+    body_depth = 0;
+}
@@ -11,13 +11,20 @@
 #include <string.h>
 #include <stdlib.h>
 
-// This implementation does not allow more than 20 symbols
-#define MAX_NUMBER_OF_VARS 20
 #define ALLOC(t) (t*) calloc(1, sizeof(t))
 
-// The following global variables are defined in code_graph.c:
-extern struct ValueNode* table[MAX_NUMBER_OF_VARS];
-extern int number_of_vars;
-extern int number_of_ints;
+// The following global variables are defined in code_graph.c.
+// Variables take slots 0 to number_of_vars - 1 in the order they are
+// declared, constants follow and each value is stored once.
+extern __thread char** slot_names;   // NULL for constants
+extern __thread int number_of_vars;
+
+int get_symbol(char* name);
+int get_constant(int value);
+
+// Forgets the variables and constants of the last program parsed on
+// this thread, so the next one starts with none. The statements of the
+// last program are not freed.
+void reset_slots();
 
 #endif /* _CODE_GRAPH_H_ */
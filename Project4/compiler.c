@@ -1,386 +1,529 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <ctype.h>
-#include <string.h>
-#include "compiler.h"
-
-#define DEBUG 1     // 1 => Turn ON debugging, 0 => Turn OFF debugging
-
-void debug(const char * format, ...)
-{
-    va_list args;
-    if (DEBUG)
-    {
-        va_start (args, format);
-        vfprintf (stdout, format, args);
-        va_end (args);
-    }
-}
-
-//---------------------------------------------------------
-// Lexer
-
-char token[MAX_TOKEN_LENGTH];      // token string
-int  ttype;                        // token type
-int  activeToken = FALSE;
-int  tokenLength;
-int  line_no = 1;
-
-char *reserved[] =
-{
-    "",
-    "VAR",
-    "IF",
-    "WHILE",
-    "SWITCH",
-    "CASE",
-    "DEFAULT",
-    "print",
-    "ARRAY",
-    "+",
-    "-",
-    "/",
-    "*",
-    "=",
-    ":",
-    ",",
-    ";",
-    "[",
-    "]",
-    "(",
-    ")",
-    "{",
-    "}",
-    "<>",
-    ">",
-    "<",
-    "ID",
-    "NUM",
-    "ERROR"
-};
-
-void skipSpace()
-{
-    char c;
-
-    c = getchar();
-    line_no += (c == '\n');
-    while (!feof(stdin) && isspace(c))
-    {
-        c = getchar();
-        line_no += (c == '\n');
-    }
-
-    // return character to input buffer if eof is not reached
-    if (!feof(stdin))
-        ungetc(c, stdin);
-}
-
-int isKeyword(char *s)
-{
-    int i;
-
-    for (i = 1; i <= KEYWORDS; i++)
-        if (strcmp(reserved[i], s) == 0)
-            return i;
-    return FALSE;
-}
-
-int scan_number()
-{
-    char c;
-
-    c = getchar();
-    if (isdigit(c))
-    {
-        if (c == '0')
-        {
-            token[tokenLength] = c;
-            tokenLength++;
-        }
-        else
-        {
-            while (isdigit(c))
-            {
-                token[tokenLength] = c;
-                tokenLength++;;
-                c = getchar();
-            }
-            ungetc(c, stdin);
-        }
-        token[tokenLength] = '\0';
-        return NUM;
-    }
-    else
-        return ERROR;
-}
-
-
-int scan_id_or_keyword()
-{
-    int ttype;
-    char c;
-
-    c = getchar();
-    if (isalpha(c))
-    {
-        while (isalnum(c))
-        {
-            token[tokenLength] = c;
-            tokenLength++;
-            c = getchar();
-        }
-        if (!feof(stdin))
-            ungetc(c, stdin);
-
-        token[tokenLength] = '\0';
-        ttype = isKeyword(token);
-        if (ttype == 0)
-            ttype = ID;
-        return ttype;
-    }
-    else
-        return ERROR;
-}
-
-void ungetToken()
-{
-    activeToken = TRUE;
-}
-
-int getToken()
-{
-    char c;
-
-    if (activeToken)
-    {
-        activeToken = FALSE;
-        return ttype;
-    }
-
-    skipSpace();
-    tokenLength = 0;
-    c = getchar();
-
-    switch (c)
-    {
-        case '+':   ttype = PLUS;       break;
-        case '-':   ttype = MINUS;      break;
-        case '/':   ttype = DIV;        break;
-        case '*':   ttype = MULT;       break;
-        case '=':   ttype = EQUAL;      break;
-        case ':':   ttype = COLON;      break;
-        case ',':   ttype = COMMA;      break;
-        case ';':   ttype = SEMICOLON;  break;
-        case '[':   ttype = LBRAC;      break;
-        case ']':   ttype = RBRAC;      break;
-        case '(':   ttype = LPAREN;     break;
-        case ')':   ttype = RPAREN;     break;
-        case '{':   ttype = LBRACE;     break;
-        case '}':   ttype = RBRACE;     break;
-        case '>':   ttype = GREATER;    break;
-        case '<':
-            c = getchar();
-            if (c == '>')
-                ttype = NOTEQUAL;
-            else
-            {
-                ungetc(c, stdin);
-                ttype = LESS;
-            }
-            break;
-        default :
-            if (isdigit(c))
-            {
-                ungetc(c, stdin);
-                ttype = scan_number();
-            }
-            else if (isalpha(c))
-            {
-                // token is either a keyword or ID
-                ungetc(c, stdin);
-                ttype = scan_id_or_keyword();
-            }
-            else if (c == EOF)
-                ttype = EOF;
-            else
-                ttype = ERROR;
-            break;
-    } // End Switch
-    return ttype;
-}
-
-//---------------------------------------------------------
-// Execute
-void execute_program(struct StatementNode* program)
-{
-    struct StatementNode* pc = program;
-    int op1, op2, result;
-
-    while (pc != NULL)
-    {
-        switch (pc->type)
-        {
-            case NOOP_STMT:
-                pc = pc->next;
-                break;
-
-            case PRINT_STMT:
-                if (pc->print_stmt == NULL)
-                {
-                    debug("Error: pc points to a print statement but pc->print_stmt is null.\n");
-                    exit(1);
-                }
-                if (pc->print_stmt->id == NULL)
-                {
-                    debug("Error: print_stmt->id is null.\n");
-                    exit(1);
-                }
-                printf("%d\n", pc->print_stmt->id->value);
-                pc = pc->next;
-                break;
-
-            case ASSIGN_STMT:
-                if (pc->assign_stmt == NULL)
-                {
-                    debug("Error: pc points to an assignment statement but pc->assign_stmt is null.\n");
-                    exit(1);
-                }
-                if (pc->assign_stmt->operand1 == NULL)
-                {
-                    debug("Error: assign_stmt->operand1 is null.\n");
-                    exit(1);
-                }
-                if (pc->assign_stmt->op != 0)
-                {
-                    if (pc->assign_stmt->operand2 == NULL)
-                    {
-                        debug("Error: assign_stmt->op requires two operands but assign_stmt->operand2 is null.\n");
-                        exit(1);
-                    }
-                }
-                if (pc->assign_stmt->left_hand_side == NULL)
-                {
-                    debug("Error: assign_stmt->left_hand_side is null.\n");
-                    exit(1);
-                }
-                switch (pc->assign_stmt->op)
-                {
-                    case PLUS:
-                        op1 = pc->assign_stmt->operand1->value;
-                        op2 = pc->assign_stmt->operand2->value;
-                        result = op1 + op2;
-                        break;
-                    case MINUS:
-                        op1 = pc->assign_stmt->operand1->value;
-                        op2 = pc->assign_stmt->operand2->value;
-                        result = op1 - op2;
-                        break;
-                    case MULT:
-                        op1 = pc->assign_stmt->operand1->value;
-                        op2 = pc->assign_stmt->operand2->value;
-                        result = op1 * op2;
-                        break;
-                    case DIV:
-                        op1 = pc->assign_stmt->operand1->value;
-                        op2 = pc->assign_stmt->operand2->value;
-                        result = op1 / op2;
-                        break;
-                    case 0:
-                        op1 = pc->assign_stmt->operand1->value;
-                        result = op1;
-                        break;
-                    default:
-                        debug("Error: invalid value for assign_stmt->op (%d).\n", pc->assign_stmt->op);
-                        exit(1);
-                        break;
-                }
-                pc->assign_stmt->left_hand_side->value = result;
-                pc = pc->next;
-                break;
-
-            case IF_STMT:
-                if (pc->if_stmt == NULL)
-                {
-                    debug("Error: pc points to an if statement but pc->if_stmt is null.\n");
-                    exit(1);
-                }
-                if (pc->if_stmt->true_branch == NULL)
-                {
-                    debug("Error: if_stmt->true_branch is null.\n");
-                    exit(1);
-                }
-                if (pc->if_stmt->false_branch == NULL)
-                {
-                    debug("Error: if_stmt->false_branch is null.\n");
-                    exit(1);
-                }
-                if (pc->if_stmt->condition_operand1 == NULL)
-                {
-                    debug("Error: if_stmt->condition_operand1 is null.\n");
-                    exit(1);
-                }
-                if (pc->if_stmt->condition_operand2 == NULL)
-                {
-                    debug("Error: if_stmt->condition_operand2 is null.\n");
-                    exit(1);
-                }
-                op1 = pc->if_stmt->condition_operand1->value;
-                op2 = pc->if_stmt->condition_operand2->value;
-                switch (pc->if_stmt->condition_op)
-                {
-                    case GREATER:
-                        if (op1 > op2)
-                            pc = pc->if_stmt->true_branch;
-                        else
-                            pc = pc->if_stmt->false_branch;
-                        break;
-                    case LESS:
-                        if (op1 < op2)
-                            pc = pc->if_stmt->true_branch;
-                        else
-                            pc = pc->if_stmt->false_branch;
-                        break;
-                    case NOTEQUAL:
-                        if (op1 != op2)
-                            pc = pc->if_stmt->true_branch;
-                        else
-                            pc = pc->if_stmt->false_branch;
-                        break;
-                    default:
-                        debug("Error: invalid value for if_stmt->condition_op (%d).\n", pc->if_stmt->condition_op);
-                        exit(1);
-                        break;
-                }
-                break;
-
-            case GOTO_STMT:
-                if (pc->goto_stmt == NULL)
-                {
-                    debug("Error: pc points to a goto statement but pc->goto_stmt is null.\n");
-                    exit(1);
-                }
-                if (pc->goto_stmt->target == NULL)
-                {
-                    debug("Error: goto_stmt->target is null.\n");
-                    exit(1);
-                }
-                pc = pc->goto_stmt->target;
-                break;
-
-            default:
-                debug("Error: invalid value for pc->type (%d).\n", pc->type);
-                exit(1);
-                break;
-        }
-    }
-}
-
-int main()
-{
-    struct StatementNode * program;
-    program = parse_generate_intermediate_representation();
-    execute_program(program);
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "bytecode.h"
+#include "optimize.h"
+#include "jit.h"
+#include "profile.h"
+#include "output.h"
+#include "exact.h"
+#include "batch.h"
+
+#define DEBUG 1     // 1 => Turn ON debugging, 0 => Turn OFF debugging
+
+void debug(const char * format, ...)
+{
+    va_list args;
+    if (DEBUG)
+    {
+        va_start (args, format);
+        vfprintf (stdout, format, args);
+        va_end (args);
+    }
+}
+
+//---------------------------------------------------------
+// Lexer
+
+__thread char token[MAX_TOKEN_LENGTH];      // token string
+__thread int  ttype;                        // token type
+__thread int  activeToken = FALSE;
+__thread int  tokenLength;
+__thread int  line_no = 1;
+__thread FILE* input = NULL;                // the program being read
+
+char *reserved[] =
+{
+    "",
+    "VAR",
+    "IF",
+    "WHILE",
+    "SWITCH",
+    "CASE",
+    "DEFAULT",
+    "print",
+    "ARRAY",
+    "+",
+    "-",
+    "/",
+    "*",
+    "=",
+    ":",
+    ",",
+    ";",
+    "[",
+    "]",
+    "(",
+    ")",
+    "{",
+    "}",
+    "<>",
+    ">",
+    "<",
+    "ID",
+    "NUM",
+    "ERROR"
+};
+
+void skipSpace()
+{
+    char c;
+
+    c = getc(input);
+    line_no += (c == '\n');
+    while (!feof(input) && isspace(c))
+    {
+        c = getc(input);
+        line_no += (c == '\n');
+    }
+
+    // return character to input buffer if eof is not reached
+    if (!feof(input))
+        ungetc(c, input);
+}
+
+int isKeyword(char *s)
+{
+    int i;
+
+    for (i = 1; i <= KEYWORDS; i++)
+        if (strcmp(reserved[i], s) == 0)
+            return i;
+    return FALSE;
+}
+
+int scan_number()
+{
+    char c;
+
+    c = getc(input);
+    if (isdigit(c))
+    {
+        if (c == '0')
+        {
+            token[tokenLength] = c;
+            tokenLength++;
+        }
+        else
+        {
+            while (isdigit(c))
+            {
+                token[tokenLength] = c;
+                tokenLength++;;
+                c = getc(input);
+            }
+            ungetc(c, input);
+        }
+        token[tokenLength] = '\0';
+        return NUM;
+    }
+    else
+        return ERROR;
+}
+
+
+int scan_id_or_keyword()
+{
+    int ttype;
+    char c;
+
+    c = getc(input);
+    if (isalpha(c))
+    {
+        while (isalnum(c))
+        {
+            token[tokenLength] = c;
+            tokenLength++;
+            c = getc(input);
+        }
+        if (!feof(input))
+            ungetc(c, input);
+
+        token[tokenLength] = '\0';
+        ttype = isKeyword(token);
+        if (ttype == 0)
+            ttype = ID;
+        return ttype;
+    }
+    else
+        return ERROR;
+}
+
+void start_input(FILE* file)
+{
+    input = file;
+    ttype = 0;
+    activeToken = FALSE;
+    line_no = 1;
+}
+
+void ungetToken()
+{
+    activeToken = TRUE;
+}
+
+int getToken()
+{
+    char c;
+
+    if (activeToken)
+    {
+        activeToken = FALSE;
+        return ttype;
+    }
+
+    skipSpace();
+    tokenLength = 0;
+    c = getc(input);
+
+    switch (c)
+    {
+        case '+':   ttype = PLUS;       break;
+        case '-':   ttype = MINUS;      break;
+        case '/':   ttype = DIV;        break;
+        case '*':   ttype = MULT;       break;
+        case '=':   ttype = EQUAL;      break;
+        case ':':   ttype = COLON;      break;
+        case ',':   ttype = COMMA;      break;
+        case ';':   ttype = SEMICOLON;  break;
+        case '[':   ttype = LBRAC;      break;
+        case ']':   ttype = RBRAC;      break;
+        case '(':   ttype = LPAREN;     break;
+        case ')':   ttype = RPAREN;     break;
+        case '{':   ttype = LBRACE;     break;
+        case '}':   ttype = RBRACE;     break;
+        case '>':   ttype = GREATER;    break;
+        case '<':
+            c = getc(input);
+            if (c == '>')
+                ttype = NOTEQUAL;
+            else
+            {
+                ungetc(c, input);
+                ttype = LESS;
+            }
+            break;
+        default :
+            if (isdigit(c))
+            {
+                ungetc(c, input);
+                ttype = scan_number();
+            }
+            else if (isalpha(c))
+            {
+                // token is either a keyword or ID
+                ungetc(c, input);
+                ttype = scan_id_or_keyword();
+            }
+            else if (c == EOF)
+                ttype = EOF;
+            else
+                ttype = ERROR;
+            break;
+    } // End Switch
+    return ttype;
+}
+
+//---------------------------------------------------------
+// Execute
+// Set by -c, execute_program then counts the statements it executes
+int count_statements = FALSE;
+__thread long statements_executed = 0;
+
+// Executes the statement pc points to and returns the next one
+struct StatementNode* execute_statement(struct StatementNode* pc)
+{
+    int op1, op2, result, i;
+
+    switch (pc->type)
+    {
+        case NOOP_STMT:
+            pc = pc->next;
+            break;
+
+        case PRINT_STMT:
+            if (pc->print_stmt == NULL)
+            {
+                debug("Error: pc points to a print statement but pc->print_stmt is null.\n");
+                exit(1);
+            }
+            if (pc->print_stmt->id < 0)
+            {
+                debug("Error: print_stmt->id is not a slot.\n");
+                exit(1);
+            }
+            print_int(slots[pc->print_stmt->id]);
+            pc = pc->next;
+            break;
+
+        case ASSIGN_STMT:
+            if (pc->assign_stmt == NULL)
+            {
+                debug("Error: pc points to an assignment statement but pc->assign_stmt is null.\n");
+                exit(1);
+            }
+            if (pc->assign_stmt->operand1 < 0)
+            {
+                debug("Error: assign_stmt->operand1 is not a slot.\n");
+                exit(1);
+            }
+            if (pc->assign_stmt->op != 0)
+            {
+                if (pc->assign_stmt->operand2 < 0)
+                {
+                    debug("Error: assign_stmt->op requires two operands but assign_stmt->operand2 is not a slot.\n");
+                    exit(1);
+                }
+            }
+            if (pc->assign_stmt->left_hand_side < 0)
+            {
+                debug("Error: assign_stmt->left_hand_side is not a slot.\n");
+                exit(1);
+            }
+            switch (pc->assign_stmt->op)
+            {
+                case PLUS:
+                    op1 = slots[pc->assign_stmt->operand1];
+                    op2 = slots[pc->assign_stmt->operand2];
+                    result = op1 + op2;
+                    break;
+                case MINUS:
+                    op1 = slots[pc->assign_stmt->operand1];
+                    op2 = slots[pc->assign_stmt->operand2];
+                    result = op1 - op2;
+                    break;
+                case MULT:
+                    op1 = slots[pc->assign_stmt->operand1];
+                    op2 = slots[pc->assign_stmt->operand2];
+                    result = op1 * op2;
+                    break;
+                case DIV:
+                    op1 = slots[pc->assign_stmt->operand1];
+                    op2 = slots[pc->assign_stmt->operand2];
+                    result = op1 / op2;
+                    break;
+                case 0:
+                    op1 = slots[pc->assign_stmt->operand1];
+                    result = op1;
+                    break;
+                default:
+                    debug("Error: invalid value for assign_stmt->op (%d).\n", pc->assign_stmt->op);
+                    exit(1);
+                    break;
+            }
+            slots[pc->assign_stmt->left_hand_side] = result;
+            pc = pc->next;
+            break;
+
+        case IF_STMT:
+            if (pc->if_stmt == NULL)
+            {
+                debug("Error: pc points to an if statement but pc->if_stmt is null.\n");
+                exit(1);
+            }
+            if (pc->if_stmt->true_branch == NULL)
+            {
+                debug("Error: if_stmt->true_branch is null.\n");
+                exit(1);
+            }
+            if (pc->if_stmt->false_branch == NULL)
+            {
+                debug("Error: if_stmt->false_branch is null.\n");
+                exit(1);
+            }
+            if (pc->if_stmt->condition_operand1 < 0)
+            {
+                debug("Error: if_stmt->condition_operand1 is not a slot.\n");
+                exit(1);
+            }
+            if (pc->if_stmt->condition_operand2 < 0)
+            {
+                debug("Error: if_stmt->condition_operand2 is not a slot.\n");
+                exit(1);
+            }
+            op1 = slots[pc->if_stmt->condition_operand1];
+            op2 = slots[pc->if_stmt->condition_operand2];
+            switch (pc->if_stmt->condition_op)
+            {
+                case GREATER:
+                    if (op1 > op2)
+                        pc = pc->if_stmt->true_branch;
+                    else
+                        pc = pc->if_stmt->false_branch;
+                    break;
+                case LESS:
+                    if (op1 < op2)
+                        pc = pc->if_stmt->true_branch;
+                    else
+                        pc = pc->if_stmt->false_branch;
+                    break;
+                case NOTEQUAL:
+                    if (op1 != op2)
+                        pc = pc->if_stmt->true_branch;
+                    else
+                        pc = pc->if_stmt->false_branch;
+                    break;
+                default:
+                    debug("Error: invalid value for if_stmt->condition_op (%d).\n", pc->if_stmt->condition_op);
+                    exit(1);
+                    break;
+            }
+            break;
+
+        case GOTO_STMT:
+            if (pc->goto_stmt == NULL)
+            {
+                debug("Error: pc points to a goto statement but pc->goto_stmt is null.\n");
+                exit(1);
+            }
+            if (pc->goto_stmt->target == NULL)
+            {
+                debug("Error: goto_stmt->target is null.\n");
+                exit(1);
+            }
+            pc = pc->goto_stmt->target;
+            break;
+
+        case SWITCH_STMT:
+            if (pc->switch_stmt == NULL)
+            {
+                debug("Error: pc points to a switch statement but pc->switch_stmt is null.\n");
+                exit(1);
+            }
+            if (pc->switch_stmt->var < 0)
+            {
+                debug("Error: switch_stmt->var is not a slot.\n");
+                exit(1);
+            }
+            if (pc->switch_stmt->default_target == NULL)
+            {
+                debug("Error: switch_stmt->default_target is null.\n");
+                exit(1);
+            }
+            i = find_case(pc->switch_stmt, slots[pc->switch_stmt->var]);
+            if (i < 0)
+                pc = pc->switch_stmt->default_target;
+            else
+                pc = pc->switch_stmt->targets[i];
+            break;
+
+        default:
+            debug("Error: invalid value for pc->type (%d).\n", pc->type);
+            exit(1);
+            break;
+    }
+    return pc;
+}
+
+void execute_program(struct StatementNode* program)
+{
+    struct StatementNode* pc = program;
+
+    while (pc != NULL)
+    {
+        if (count_statements)
+            ++statements_executed;
+        pc = execute_statement(pc);
+    }
+}
+
+// Set from the command line, see main
+static int graph = FALSE;
+static int vm = FALSE;
+static int optimize = TRUE;
+
+void run_program(struct StatementNode* program)
+{
+    struct Bytecode* bytecode;
+
+    if (optimize)
+        program = optimize_program(program);
+    if (arithmetic != WRAPPING)
+        execute_exact(program, arithmetic == BIGNUM);
+    else if (graph)
+        execute_program(program);
+    else
+    {
+        bytecode = compile_program(program, optimize);
+        if (vm || !execute_jit(bytecode))
+            execute_bytecode(bytecode);
+        free_bytecode(bytecode);
+    }
+}
+
+// Usage: a.out [-g] [-v] [-c] [-n] [-w] [-x] [-p file] < program
+//        a.out [-g] [-v] [-n] [-w] [-x] [-t threads] program...
+// The program is optimized, compiled to bytecode and translated to
+// x86-64 by jit.c, or run on the virtual machine in bytecode.c where
+// that is not possible or with -v. With -g it is run by walking the
+// statement graph instead, -c does the same and prints how many
+// statements were executed to stderr, and -n leaves out the optimizer
+// and the superinstructions. -p walks the graph with the profiler in
+// profile.c and writes its report to file. -w and -x walk the graph
+// with exact.c instead of wrapping 32-bit arithmetic: -w uses 64-bit
+// values and stops on overflow, -x goes on with bignums. Programs named
+// on the command line are run by batch.c on as many threads as there
+// are processors, or on threads threads with -t.
+int main(int argc, char* argv[])
+{
+    struct StatementNode * program;
+    char** files = malloc(argc * sizeof(char*));
+    int number_of_files = 0, threads = sysconf(_SC_NPROCESSORS_ONLN), i;
+    FILE* report = NULL;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-g") == 0)
+            graph = TRUE;
+        else if (strcmp(argv[i], "-v") == 0)
+            vm = TRUE;
+        else if (strcmp(argv[i], "-c") == 0)
+            graph = count_statements = TRUE;
+        else if (strcmp(argv[i], "-n") == 0)
+            optimize = FALSE;
+        else if (strcmp(argv[i], "-w") == 0)
+            arithmetic = CHECKED;
+        else if (strcmp(argv[i], "-x") == 0)
+            arithmetic = BIGNUM;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            report = fopen(argv[++i], "w");
+            if (report == NULL)
+            {
+                perror(argv[i]);
+                exit(1);
+            }
+        }
+        else if (argv[i][0] != '-')
+            files[number_of_files++] = argv[i];
+    }
+
+    if (number_of_files > 0)
+    {
+        run_batch(files, number_of_files, (threads > 0) ? threads : 1);
+        free(files);
+        return 0;
+    }
+    free(files);
+
+    start_input(stdin);
+    program = parse_generate_intermediate_representation();
+    if (report != NULL)
+    {
+        if (optimize)
+            program = optimize_program(program);
+        profile_program(program, report);
+        fclose(report);
+    }
+    else
+        run_program(program);
+    if (count_statements)
+        fprintf(stderr, "%ld statements executed\n", statements_executed);
+    return 0;
+}
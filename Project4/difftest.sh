@@ -0,0 +1,25 @@
+#!/bin/bash
+
+# Runs every program in tests/ and bench/ by walking the statement graph
+# (-g), on the bytecode VM (-v) and as native code, and counts the
+# programs for which all three print the same output.
+
+let count=0;
+let total=0;
+for f in $(ls ./tests/*.txt ./bench/*.txt); do
+	graph=$(./a.out -g < $f)
+	vm=$(./a.out -v < $f)
+	jit=$(./a.out < $f)
+	total=$((total+1));
+	if [ "$graph" == "$vm" ] && [ "$graph" == "$jit" ]; then
+		count=$((count+1));
+	else
+		echo "========================================================";
+		echo "DIFFERS:" $f;
+		echo "========================================================";
+		diff <(echo "$graph") <(echo "$vm") | head;
+		diff <(echo "$graph") <(echo "$jit") | head;
+	fi
+done
+
+echo $count of $total;
@@ -0,0 +1,241 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file walks the statement graph with checked
+//  arithmetic. Values are 64-bit and the compiler's overflow
+//  builtins catch results that do not fit, which are then computed
+//  again with the bignums from bignum.c.
+//--------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "exact.h"
+#include "bignum.h"
+#include "output.h"
+
+// The value of each slot, or its bignum when big[slot] is not NULL.
+// Bignums are only kept for values that do not fit in 64 bits.
+static __thread long long* value = NULL;
+static __thread struct Bignum** big = NULL;
+static __thread int use_bignums = FALSE;
+
+//---------------------------------------------------------
+// Errors
+
+static void stop(struct StatementNode* pc, const char* message)
+{
+    flush_output();
+    fprintf(stderr, "Error: %s on line %d\n", message, pc->line_no);
+    exit(1);
+}
+
+//---------------------------------------------------------
+// Bignums
+
+// The value of slot as a bignum, to be freed with release()
+static struct Bignum* as_big(int slot)
+{
+    return (big[slot] != NULL) ? big[slot] : big_from_long(value[slot]);
+}
+
+static void release(int slot, struct Bignum* a)
+{
+    if (a != big[slot])
+        big_free(a);
+}
+
+// Stores r in slot, as a 64-bit value when it fits
+static void store_big(int slot, struct Bignum* r)
+{
+    long long x;
+
+    big_free(big[slot]);
+    big[slot] = NULL;
+    if (big_to_long(r, &x))
+    {
+        value[slot] = x;
+        big_free(r);
+    }
+    else
+        big[slot] = r;
+}
+
+// Assignments that overflowed or have a bignum operand
+static void assign_big(struct StatementNode* pc)
+{
+    struct AssignmentStatement* assign = pc->assign_stmt;
+    struct Bignum *a, *b, *r = NULL;
+
+    if (!use_bignums)
+        stop(pc, "integer overflow");
+    a = as_big(assign->operand1);
+    b = as_big(assign->operand2);
+    switch (assign->op)
+    {
+        case PLUS:  r = big_add(a, b); break;
+        case MINUS: r = big_sub(a, b); break;
+        case MULT:  r = big_mul(a, b); break;
+        case DIV:
+            if (b->length == 0)
+                stop(pc, "division by zero");
+            r = big_div(a, b);
+            break;
+    }
+    release(assign->operand1, a);
+    release(assign->operand2, b);
+    store_big(assign->left_hand_side, r);
+}
+
+static int compare_big(int slot1, int slot2)
+{
+    struct Bignum* a = as_big(slot1);
+    struct Bignum* b = as_big(slot2);
+    int result = big_compare(a, b);
+
+    release(slot1, a);
+    release(slot2, b);
+    return result;
+}
+
+//---------------------------------------------------------
+// Execution
+
+void execute_exact(struct StatementNode* program, int bignums)
+{
+    struct StatementNode* pc = program;
+    struct AssignmentStatement* assign;
+    struct IfStatement* cond;
+    struct SwitchStatement* sw;
+    long long a, b, r = 0;
+    char* text;
+    int slot, i, result, overflow;
+
+    use_bignums = bignums;
+    value = malloc(number_of_slots * sizeof(long long));
+    big = calloc(number_of_slots, sizeof(struct Bignum*));
+    for (i = 0; i < number_of_slots; i++)
+        value[i] = slots[i];
+
+    while (pc != NULL)
+    {
+        switch (pc->type)
+        {
+            case ASSIGN_STMT:
+                assign = pc->assign_stmt;
+                slot = assign->left_hand_side;
+                if (assign->op == 0)
+                {
+                    // Bignums are never shared between slots
+                    if (big[assign->operand1] != NULL)
+                        store_big(slot, big_copy(big[assign->operand1]));
+                    else
+                    {
+                        if (big[slot] != NULL)
+                        {
+                            big_free(big[slot]);
+                            big[slot] = NULL;
+                        }
+                        value[slot] = value[assign->operand1];
+                    }
+                    pc = pc->next;
+                    break;
+                }
+                if (big[assign->operand1] != NULL || big[assign->operand2] != NULL)
+                {
+                    assign_big(pc);
+                    pc = pc->next;
+                    break;
+                }
+                a = value[assign->operand1];
+                b = value[assign->operand2];
+                switch (assign->op)
+                {
+                    case PLUS:
+                        overflow = __builtin_add_overflow(a, b, &r);
+                        break;
+                    case MINUS:
+                        overflow = __builtin_sub_overflow(a, b, &r);
+                        break;
+                    case MULT:
+                        overflow = __builtin_mul_overflow(a, b, &r);
+                        break;
+                    default:
+                        if (b == 0)
+                            stop(pc, "division by zero");
+                        overflow = (a == LLONG_MIN && b == -1);
+                        if (!overflow)
+                            r = a / b;
+                        break;
+                }
+                if (overflow)
+                    assign_big(pc);
+                else
+                {
+                    if (big[slot] != NULL)
+                    {
+                        big_free(big[slot]);
+                        big[slot] = NULL;
+                    }
+                    value[slot] = r;
+                }
+                pc = pc->next;
+                break;
+
+            case PRINT_STMT:
+                slot = pc->print_stmt->id;
+                if (big[slot] != NULL)
+                {
+                    text = big_to_string(big[slot]);
+                    print_line(text);
+                    free(text);
+                }
+                else
+                    print_long(value[slot]);
+                pc = pc->next;
+                break;
+
+            case IF_STMT:
+                cond = pc->if_stmt;
+                if (big[cond->condition_operand1] != NULL || big[cond->condition_operand2] != NULL)
+                    result = compare_big(cond->condition_operand1, cond->condition_operand2);
+                else
+                {
+                    a = value[cond->condition_operand1];
+                    b = value[cond->condition_operand2];
+                    result = (a > b) - (a < b);
+                }
+                if (cond->condition_op == GREATER)
+                    result = result > 0;
+                else if (cond->condition_op == LESS)
+                    result = result < 0;
+                else
+                    result = result != 0;
+                pc = result ? cond->true_branch : cond->false_branch;
+                break;
+
+            case GOTO_STMT:
+                pc = pc->goto_stmt->target;
+                break;
+
+            case SWITCH_STMT:
+                // Case values are ints, so nothing larger matches a case
+                sw = pc->switch_stmt;
+                slot = sw->var;
+                i = -1;
+                if (big[slot] == NULL && value[slot] >= INT_MIN && value[slot] <= INT_MAX)
+                    i = find_case(sw, (int) value[slot]);
+                pc = (i < 0) ? sw->default_target : sw->targets[i];
+                break;
+
+            default:
+                pc = pc->next;
+                break;
+        }
+    }
+
+    for (i = 0; i < number_of_slots; i++)
+        big_free(big[i]);
+    free(big);
+    free(value);
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for running the statement graph
+//  with 64-bit and arbitrary precision arithmetic instead of the
+//  wrapping 32-bit arithmetic of the other engines.
+//--------------------------------------------------------------
+#ifndef _EXACT_H_
+#define _EXACT_H_
+
+#include "compiler.h"
+
+// Runs program by walking the statement graph with 64-bit values. An
+// operation whose result does not fit in 64 bits goes on with a bignum
+// when bignums is TRUE, and stops the program with an error otherwise.
+// Dividing by zero always stops the program with an error, which names
+// the line of the statement and exits with status 1.
+void execute_exact(struct StatementNode* program, int bignums);
+
+#endif /* _EXACT_H_ */
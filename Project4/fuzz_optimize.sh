@@ -0,0 +1,125 @@
+#!/bin/bash
+
+# Generates COUNT random programs with nested WHILE loops, and checks
+# that the optimized program prints the same on every engine as the
+# unoptimized statement graph (-n -g). Loops only end through counters
+# that the other statements read but never assign, so every program
+# stops. The t variables are not printed at the end, so assignments to
+# them can be moved out of loops. A program that differs is kept in
+# /tmp for a closer look.
+
+COUNT=${1:-500}
+SEED=${2:-1}
+
+gen_program() {
+	awk -v seed=$1 '
+	function pick(n) { return int(rand() * n) }
+	function operand() { return pick(3) ? vars[pick(nvars)] : pick(10) }
+	function indent(d) { return sprintf("%" (2 * d) "s", "") }
+	function assignment(d, target, r) {
+		target = assigned[pick(nassigned)]
+		r = pick(8)
+		if (r > 5)
+			printf "%st%d = c%d * %s;\n", indent(d), pick(3), pick(3), operand()
+		else if (r == 0)
+			printf "%s%s = %s;\n", indent(d), target, operand()
+		else if (r == 1)
+			printf "%s%s = %s / %d;\n", indent(d), target, operand(), pick(9) + 1
+		else
+			printf "%s%s = %s %s %s;\n", indent(d), target, operand(), ops[pick(3)], operand()
+	}
+	function block(d, n, i, r, c, step) {
+		for (i = 0; i < n; i++)
+		{
+			r = pick(10)
+			if (r < 5 || d > 3)
+				assignment(d)
+			else if (r == 5)
+				printf "%sprint %s;\n", indent(d), vars[pick(nvars)]
+			else if (r == 6)
+			{
+				printf "%sIF %s %s %s\n%s{\n", indent(d), operand(), relops[pick(3)], operand(), indent(d)
+				block(d + 1, pick(3) + 1)
+				printf "%s}\n", indent(d)
+			}
+			else if (r < 9 && loops < 3)
+			{
+				c = "c" loops++
+				if (pick(2))
+				{
+					printf "%s%s = 0;\n%sWHILE %s < %d\n%s{\n", indent(d), c, indent(d), c, pick(6), indent(d)
+					step = sprintf("%s%s = %s + 1;\n", indent(d + 1), c, c)
+				}
+				else
+				{
+					printf "%s%s = %d;\n%sWHILE %s > 0\n%s{\n", indent(d), c, pick(6), indent(d), c, indent(d)
+					step = sprintf("%s%s = %s - 1;\n", indent(d + 1), c, c)
+				}
+				if (pick(2))
+				{
+					printf "%s", step
+					block(d + 1, pick(4) + 1)
+				}
+				else
+				{
+					block(d + 1, pick(4) + 1)
+					printf "%s", step
+				}
+				printf "%s}\n", indent(d)
+			}
+			else
+			{
+				printf "%sSWITCH %s\n%s{\n", indent(d), assigned[pick(nassigned)], indent(d)
+				printf "%sCASE %d:\n%s{\n", indent(d + 1), pick(4), indent(d + 1)
+				block(d + 2, 1)
+				printf "%s}\n%sDEFAULT:\n%s{\n", indent(d + 1), indent(d + 1), indent(d + 1)
+				block(d + 2, 1)
+				printf "%s}\n%s}\n", indent(d + 1), indent(d)
+			}
+		}
+	}
+	BEGIN {
+		srand(seed)
+		split("+ - *", ops, " ")
+		ops[0] = ops[3]
+		split("> < <>", relops, " ")
+		relops[0] = relops[3]
+		nassigned = 0
+		for (i = 0; i < 4; i++)
+			assigned[nassigned++] = "v" i
+		for (i = 0; i < 3; i++)
+			assigned[nassigned++] = "t" i
+		nvars = 0
+		for (i = 0; i < nassigned; i++)
+			vars[nvars++] = assigned[i]
+		for (i = 0; i < 3; i++)
+			vars[nvars++] = "c" i
+		print "v0, v1, v2, v3, t0, t1, t2, c0, c1, c2;"
+		print "{"
+		loops = 0
+		block(1, pick(6) + 4)
+		for (i = 0; i < 4; i++)
+			printf "  print v%d;\n", i
+		print "}"
+	}'
+}
+
+let count=0;
+for ((i = 0; i < COUNT; i++)); do
+	f=/tmp/fuzz_optimize.$((SEED + i)).txt
+	gen_program $((SEED + i)) > $f
+	plain=$(./a.out -n -g < $f 2>&1)
+	same=1
+	for mode in -g -v ""; do
+		if [ "$(./a.out $mode < $f 2>&1)" != "$plain" ]; then
+			same=0
+			echo "DIFFERS:" $f $mode
+		fi
+	done
+	if [ $same == 1 ]; then
+		count=$((count+1));
+		rm -f $f
+	fi
+done
+
+echo $count of $COUNT;
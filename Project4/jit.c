@@ -0,0 +1,277 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file translates the bytecode from bytecode.c
+//  into x86-64 machine code in an executable buffer. Variables stay
+//  in the slot array, which rbx points to, and printing and switch
+//  lookups call back into C.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "jit.h"
+#include "output.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+//---------------------------------------------------------
+// Code buffer
+
+struct Assembler
+{
+    unsigned char* code;
+    size_t size;        // bytes mapped
+    size_t length;      // bytes written
+
+    int* native;        // offset of the code of each instruction
+
+    // rel32 jumps to instructions, patched once every offset is known
+    size_t* jump_at;
+    int* jump_target;
+    int jumps;
+};
+
+static void byte(struct Assembler* a, int b)
+{
+    a->code[a->length++] = (unsigned char) b;
+}
+
+static void int32(struct Assembler* a, int32_t x)
+{
+    memcpy(a->code + a->length, &x, 4);
+    a->length += 4;
+}
+
+static void int64(struct Assembler* a, uint64_t x)
+{
+    memcpy(a->code + a->length, &x, 8);
+    a->length += 8;
+}
+
+// Emits opcode with a ModRM byte for reg and [rbx + 4 * slot]
+static void slot_operand(struct Assembler* a, int opcode, int reg, int slot)
+{
+    if (opcode > 0xff)
+        byte(a, opcode >> 8);
+    byte(a, opcode & 0xff);
+    byte(a, 0x83 | (reg << 3));     // mod 10, rm rbx, disp32
+    int32(a, 4 * slot);
+}
+
+// Emits the rel32 of a jump to the instruction target
+static void jump_to(struct Assembler* a, int target)
+{
+    a->jump_at[a->jumps] = a->length;
+    a->jump_target[a->jumps++] = target;
+    int32(a, 0);
+}
+
+// Calls function with rax
+static void call(struct Assembler* a, void* function)
+{
+    byte(a, 0x48); byte(a, 0xb8);   // mov rax, imm64
+    int64(a, (uint64_t) (uintptr_t) function);
+    byte(a, 0xff); byte(a, 0xd0);   // call rax
+}
+
+//---------------------------------------------------------
+// Calls out of native code
+
+// Returns the case of value, or the number of cases for the default
+static int jit_switch(struct SwitchStatement* sw, int value)
+{
+    int i = find_case(sw, value);
+    return (i < 0) ? sw->number_of_cases : i;
+}
+
+//---------------------------------------------------------
+// Translation
+
+#define EAX 0
+#define ESI 6
+#define EDI 7
+
+// The most bytes any instruction is translated to, not counting the
+// table of a switch
+#define MAX_INSTRUCTION_BYTES 48
+
+int execute_jit(struct Bytecode* program)
+{
+    struct Assembler a;
+    struct Instruction* in;
+    struct SwitchStatement* sw;
+    size_t tables = 0, table_at, lea_at;
+    int i, k, n, opcode;
+    void (*run)(int*);
+
+    for (i = 0; i < program->number_of_switches; i++)
+        tables += 8 * (program->switches[i]->number_of_cases + 1);
+
+    memset(&a, 0, sizeof(a));
+    a.size = 16 + (size_t) program->length * MAX_INSTRUCTION_BYTES + tables;
+    a.code = mmap(NULL, a.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (a.code == MAP_FAILED)
+        return FALSE;
+    a.native = malloc((program->length + 1) * sizeof(int));
+    a.jump_at = malloc((program->length + 1) * sizeof(size_t));
+    a.jump_target = malloc((program->length + 1) * sizeof(int));
+
+    // The switch tables hold absolute addresses and go after the code
+    table_at = a.size - tables;
+
+    byte(&a, 0x53);                             // push rbx
+    byte(&a, 0x48); byte(&a, 0x89); byte(&a, 0xfb);  // mov rbx, rdi
+
+    for (i = 0; i < program->length; i++)
+    {
+        in = &program->code[i];
+        a.native[i] = (int) a.length;
+
+        // Superinstructions only save dispatches, which native code
+        // does not have, so they are translated as their arithmetic and
+        // the branch after them is translated on its own
+        opcode = in->opcode;
+        if (opcode >= OP_ADD_IF_GT && opcode <= OP_ADD_LOOP_NE)
+            opcode = OP_ADD;
+        else if (opcode >= OP_SUB_IF_GT && opcode <= OP_SUB_LOOP_NE)
+            opcode = OP_SUB;
+
+        switch (opcode)
+        {
+            case OP_MOVE:
+                slot_operand(&a, 0x8b, EAX, in->b);     // mov eax, [b]
+                slot_operand(&a, 0x89, EAX, in->a);     // mov [a], eax
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MULT:
+                slot_operand(&a, 0x8b, EAX, in->b);
+                if (opcode == OP_ADD)
+                    slot_operand(&a, 0x03, EAX, in->c);     // add eax, [c]
+                else if (opcode == OP_SUB)
+                    slot_operand(&a, 0x2b, EAX, in->c);     // sub eax, [c]
+                else
+                    slot_operand(&a, 0x0faf, EAX, in->c);   // imul eax, [c]
+                slot_operand(&a, 0x89, EAX, in->a);
+                break;
+
+            case OP_DIV:
+                slot_operand(&a, 0x8b, EAX, in->b);
+                byte(&a, 0x99);                         // cdq
+                slot_operand(&a, 0xf7, 7, in->c);       // idiv dword [c]
+                slot_operand(&a, 0x89, EAX, in->a);
+                break;
+
+            case OP_PRINT:
+                slot_operand(&a, 0x8b, EDI, in->a);     // mov edi, [a]
+                call(&a, print_int);
+                break;
+
+            case OP_JUMP:
+                byte(&a, 0xe9);                         // jmp rel32
+                jump_to(&a, in->c);
+                break;
+
+            case OP_IF_GT:
+            case OP_IF_LT:
+            case OP_IF_NE:
+                slot_operand(&a, 0x8b, EAX, in->a);
+                slot_operand(&a, 0x3b, EAX, in->b);     // cmp eax, [b]
+                byte(&a, 0x0f);
+                if (in->opcode == OP_IF_GT)
+                    byte(&a, 0x8e);                     // jle rel32
+                else if (in->opcode == OP_IF_LT)
+                    byte(&a, 0x8d);                     // jge rel32
+                else
+                    byte(&a, 0x84);                     // je rel32
+                jump_to(&a, in->c);
+                break;
+
+            case OP_LOOP_GT:
+            case OP_LOOP_LT:
+            case OP_LOOP_NE:
+                slot_operand(&a, 0x8b, EAX, in->a);
+                slot_operand(&a, 0x3b, EAX, in->b);
+                byte(&a, 0x0f);
+                if (in->opcode == OP_LOOP_GT)
+                    byte(&a, 0x8f);                     // jg rel32
+                else if (in->opcode == OP_LOOP_LT)
+                    byte(&a, 0x8c);                     // jl rel32
+                else
+                    byte(&a, 0x85);                     // jne rel32
+                jump_to(&a, in->c);
+                break;
+
+            case OP_SWITCH:
+                // The jumps after the switch become a table of addresses
+                sw = program->switches[in->b];
+                byte(&a, 0x48); byte(&a, 0xbf);         // mov rdi, imm64
+                int64(&a, (uint64_t) (uintptr_t) sw);
+                slot_operand(&a, 0x8b, ESI, in->a);     // mov esi, [a]
+                call(&a, jit_switch);
+                byte(&a, 0x89); byte(&a, 0xc0);         // mov eax, eax
+                byte(&a, 0x48); byte(&a, 0x8d); byte(&a, 0x0d);  // lea rcx, [rip + rel32]
+                lea_at = a.length;
+                int32(&a, (int32_t) (table_at - (lea_at + 4)));
+                byte(&a, 0xff); byte(&a, 0x24); byte(&a, 0xc1);  // jmp [rcx + 8 * rax]
+
+                n = sw->number_of_cases + 1;
+                for (k = 0; k < n; k++)
+                {
+                    a.native[i + 1 + k] = -1;
+                    a.jump_target[a.jumps] = program->code[i + 1 + k].c;
+                    a.jump_at[a.jumps++] = table_at + 8 * k;
+                }
+                table_at += 8 * n;
+                i += n;
+                break;
+
+            case OP_HALT:
+                byte(&a, 0x5b);                         // pop rbx
+                byte(&a, 0xc3);                         // ret
+                break;
+        }
+    }
+
+    // Jumps in the code are relative, table entries are absolute
+    for (i = 0; i < a.jumps; i++)
+    {
+        k = a.native[a.jump_target[i]];
+        if (a.jump_at[i] >= a.size - tables)
+        {
+            uint64_t address = (uint64_t) (uintptr_t) (a.code + k);
+            memcpy(a.code + a.jump_at[i], &address, 8);
+        }
+        else
+        {
+            int32_t rel = (int32_t) (k - (int64_t) (a.jump_at[i] + 4));
+            memcpy(a.code + a.jump_at[i], &rel, 4);
+        }
+    }
+    free(a.native);
+    free(a.jump_at);
+    free(a.jump_target);
+
+    if (mprotect(a.code, a.size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(a.code, a.size);
+        return FALSE;
+    }
+    run = (void (*)(int*)) (uintptr_t) a.code;
+    run(program->slots);
+    munmap(a.code, a.size);
+    return TRUE;
+}
+
+#else
+
+int execute_jit(struct Bytecode* program)
+{
+    return FALSE;
+}
+
+#endif
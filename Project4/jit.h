@@ -0,0 +1,17 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the x86-64 translator that
+//  runs bytecode as native code.
+//--------------------------------------------------------------
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include "bytecode.h"
+
+// Translates program to x86-64 and runs it on its slots. Returns FALSE
+// without running anything when native code cannot be made here, the
+// caller should then use execute_bytecode.
+int execute_jit(struct Bytecode* program);
+
+#endif /* _JIT_H_ */
@@ -0,0 +1,531 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file finds the loops of the statement graph
+//  from the back edges of its basic blocks, hoists assignments that
+//  do not change in a loop into a preheader run before it, and
+//  reduces multiplications by a loop counter to additions.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <limits.h>
+#include "loops.h"
+#include "code_graph.h"
+#include "optimize.h"
+
+//---------------------------------------------------------
+// Finding loops
+
+// The blocks of the natural loops with one header, the header first
+struct Loop
+{
+    int* blocks;
+    int number_of_blocks;
+};
+
+static __thread struct Loop* loops = NULL;
+static __thread int number_of_loops = 0;
+
+// loop_of[b] is the number of the last loop looked at that block b is
+// in, and dirty[b] is set once a loop b is in was changed
+static __thread int* loop_of = NULL;
+static __thread char* dirty = NULL;
+
+static int by_size(const void* a, const void* b)
+{
+    return ((struct Loop*) a)->number_of_blocks - ((struct Loop*) b)->number_of_blocks;
+}
+
+static void add_block(struct Loop* loop, int* capacity, int b)
+{
+    if (loop->number_of_blocks == *capacity)
+    {
+        *capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+        loop->blocks = realloc(loop->blocks, *capacity * sizeof(int));
+    }
+    loop->blocks[loop->number_of_blocks++] = b;
+}
+
+// Finds the loop of every block that an edge goes back to in reverse
+// postorder, from the blocks with such an edge backward to the header.
+// Loops that can be entered other than through their header are left
+// out. They are sorted smallest first, so inner loops come first.
+static void find_loops(struct CFG* cfg)
+{
+    int n = cfg->number_of_blocks;
+    int* position = malloc(n * sizeof(int));
+    int* stack = malloc(n * sizeof(int));
+    struct Loop* loop;
+    struct BasicBlock* block;
+    int h, b, i, k, p, depth, capacity, entered;
+
+    number_of_loops = 0;
+    loops = realloc(loops, n * sizeof(struct Loop));
+    loop_of = realloc(loop_of, n * sizeof(int));
+    dirty = realloc(dirty, n);
+    for (i = 0; i < n; i++)
+    {
+        position[cfg->order[i]] = i;
+        loop_of[i] = -1;
+        dirty[i] = FALSE;
+    }
+
+    // While looking for the loop of h, loop_of[b] is h once b is in it
+    for (h = 0; h < n; h++)
+    {
+        loop = &loops[number_of_loops];
+        loop->blocks = NULL;
+        loop->number_of_blocks = 0;
+        capacity = 0;
+        depth = 0;
+        for (i = 0; i < cfg->blocks[h].number_of_predecessors; i++)
+        {
+            b = cfg->blocks[h].predecessors[i];
+            if (position[b] < position[h])
+                continue;
+            if (loop->blocks == NULL)
+            {
+                add_block(loop, &capacity, h);
+                loop_of[h] = h;
+            }
+            if (loop_of[b] != h)
+            {
+                loop_of[b] = h;
+                add_block(loop, &capacity, b);
+                stack[depth++] = b;
+            }
+        }
+        if (loop->blocks == NULL)
+            continue;
+
+        entered = FALSE;
+        while (depth > 0)
+        {
+            b = stack[--depth];
+            if (b == 0)
+                entered = TRUE;
+            block = &cfg->blocks[b];
+            for (k = 0; k < block->number_of_predecessors; k++)
+            {
+                p = block->predecessors[k];
+                if (loop_of[p] == h)
+                    continue;
+                loop_of[p] = h;
+                add_block(loop, &capacity, p);
+                stack[depth++] = p;
+            }
+        }
+        if (entered)
+            free(loop->blocks);
+        else
+            number_of_loops++;
+    }
+    qsort(loops, number_of_loops, sizeof(struct Loop), by_size);
+    for (i = 0; i < n; i++)
+        loop_of[i] = -1;
+    free(position);
+    free(stack);
+}
+
+//---------------------------------------------------------
+// Loop contents
+
+// For each variable, how many assignments to it the loop has, and the
+// last of them with its block and place in the block. A variable is
+// counted for the loop when its stamp is the loop's.
+static __thread int* def_count = NULL;
+static __thread int* def_stamp = NULL;
+static __thread struct StatementNode** def_statement = NULL;
+static __thread int* def_block = NULL;
+static __thread int* def_position = NULL;
+static __thread int def_capacity = 0;
+static __thread int stamp = 0;
+
+// Variables live where the loop is entered or left, and whose value
+// before or after it is therefore seen
+static __thread unsigned long* seen_outside = NULL;
+
+// Statements to run before the loop, in order
+static __thread struct StatementNode** preheader = NULL;
+static __thread int preheader_length = 0;
+static __thread int preheader_capacity = 0;
+
+static int definitions(int var)
+{
+    return (def_stamp[var] == stamp) ? def_count[var] : 0;
+}
+
+static void count_definitions(struct CFG* cfg, struct Loop* loop)
+{
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    int i, k, v;
+
+    ++stamp;
+    for (k = 0; k < loop->number_of_blocks; k++)
+    {
+        block = &cfg->blocks[loop->blocks[k]];
+        for (i = 0; i < block->number_of_statements; i++)
+        {
+            st = block->statements[i];
+            if (st->type != ASSIGN_STMT)
+                continue;
+            v = st->assign_stmt->left_hand_side;
+            if (def_stamp[v] != stamp)
+            {
+                def_stamp[v] = stamp;
+                def_count[v] = 0;
+            }
+            def_count[v]++;
+            def_statement[v] = st;
+            def_block[v] = loop->blocks[k];
+            def_position[v] = i;
+        }
+    }
+}
+
+static void find_seen_outside(struct CFG* cfg, struct Loop* loop, struct Dataflow* live)
+{
+    struct BasicBlock* block;
+    unsigned long* set;
+    int i, k, s, w;
+
+    set = BLOCK_SET(live, in, loop->blocks[0]);
+    for (w = 0; w < live->words; w++)
+        seen_outside[w] = set[w];
+    for (k = 0; k < loop->number_of_blocks; k++)
+    {
+        block = &cfg->blocks[loop->blocks[k]];
+        for (i = 0; i < block->number_of_successors; i++)
+        {
+            s = block->successors[i];
+            if (loop_of[s] == loop_of[loop->blocks[0]])
+                continue;
+            set = BLOCK_SET(live, in, s);
+            for (w = 0; w < live->words; w++)
+                seen_outside[w] |= set[w];
+        }
+    }
+}
+
+// Whether slot holds the same value all through the loop
+static int invariant(int slot)
+{
+    return slot >= number_of_vars || definitions(slot) == 0;
+}
+
+// Whether an assignment to var can be moved or changed freely: it is
+// the only one in the loop and nothing outside sees the difference.
+// Every read of var in the loop then comes after it in the same
+// iteration, or var would be live at the header.
+static int owned(int var)
+{
+    return definitions(var) == 1 && !TEST_BIT(seen_outside, var);
+}
+
+// An assignment is only run ahead of time when it cannot trap, which
+// a division can and, when overflow is checked, other arithmetic too
+static int may_trap(struct AssignmentStatement* assign)
+{
+    int divisor;
+
+    if (assign->op == 0)
+        return FALSE;
+    if (assign->op != DIV)
+        return arithmetic == CHECKED;
+    if (assign->operand2 < number_of_vars)
+        return TRUE;
+    divisor = slots[assign->operand2];
+    return divisor == 0 || divisor == -1;
+}
+
+static void add_to_preheader(struct StatementNode* st)
+{
+    if (preheader_length == preheader_capacity)
+    {
+        preheader_capacity = (preheader_capacity == 0) ? 16 : 2 * preheader_capacity;
+        preheader = realloc(preheader, preheader_capacity * sizeof(struct StatementNode*));
+    }
+    preheader[preheader_length++] = st;
+}
+
+static struct StatementNode* new_assignment(int line, int lhs, int operand1, int op, int operand2)
+{
+    struct StatementNode* st = ALLOC(struct StatementNode);
+
+    st->type = ASSIGN_STMT;
+    st->line_no = line;
+    st->assign_stmt = ALLOC(struct AssignmentStatement);
+    st->assign_stmt->left_hand_side = lhs;
+    st->assign_stmt->operand1 = operand1;
+    st->assign_stmt->op = op;
+    st->assign_stmt->operand2 = operand2;
+    return st;
+}
+
+//---------------------------------------------------------
+// Invariant code motion
+
+// Moves the assignments of invariant values to the preheader, until
+// no more of them become invariant. Returns TRUE if any was moved.
+static int hoist_invariants(struct CFG* cfg, struct Loop* loop)
+{
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    struct AssignmentStatement* assign;
+    int moved = FALSE, changed, i, k;
+
+    do
+    {
+        changed = FALSE;
+        for (k = 0; k < loop->number_of_blocks; k++)
+        {
+            block = &cfg->blocks[loop->blocks[k]];
+            for (i = 0; i < block->number_of_statements; i++)
+            {
+                st = block->statements[i];
+                if (st->type != ASSIGN_STMT)
+                    continue;
+                assign = st->assign_stmt;
+                if (!owned(assign->left_hand_side) || !invariant(assign->operand1)
+                    || (assign->op != 0 && !invariant(assign->operand2)) || may_trap(assign))
+                    continue;
+
+                // The statement stays where it was as a NOOP so the
+                // edges into it still lead somewhere
+                add_to_preheader(new_assignment(st->line_no, assign->left_hand_side,
+                                                assign->operand1, assign->op, assign->operand2));
+                st->type = NOOP_STMT;
+                def_count[assign->left_hand_side] = 0;
+                changed = moved = TRUE;
+            }
+        }
+    } while (changed);
+    return moved;
+}
+
+//---------------------------------------------------------
+// Strength reduction
+
+// Sets step to c if var is a counter whose only assignment in the loop
+// is var = var + c, var = c + var or var = var - -c with a constant c
+static int find_step(int var, int* step)
+{
+    struct AssignmentStatement* assign;
+
+    if (var >= number_of_vars || definitions(var) != 1)
+        return FALSE;
+    assign = def_statement[var]->assign_stmt;
+    if (assign->op == PLUS && assign->operand1 == var && assign->operand2 >= number_of_vars)
+        *step = slots[assign->operand2];
+    else if (assign->op == PLUS && assign->operand2 == var && assign->operand1 >= number_of_vars)
+        *step = slots[assign->operand1];
+    else if (assign->op == MINUS && assign->operand1 == var && assign->operand2 >= number_of_vars
+             && (arithmetic == WRAPPING || slots[assign->operand2] != INT_MIN))
+        *step = (int) (0u - (unsigned int) slots[assign->operand2]);
+    else
+        return FALSE;
+    return TRUE;
+}
+
+// Whether var is read after statement position of block b, in the
+// block or after it
+static int read_after(struct CFG* cfg, struct Dataflow* live, int b, int position, int var)
+{
+    struct BasicBlock* block = &cfg->blocks[b];
+    int** uses;
+    int i, k, n;
+
+    for (i = position + 1; i < block->number_of_statements; i++)
+    {
+        uses = get_uses(block->statements[i], &n);
+        for (k = 0; k < n; k++)
+            if (*uses[k] == var)
+                return TRUE;
+    }
+    return TEST_BIT(BLOCK_SET(live, out, b), var);
+}
+
+// Turns t = i * k, where i steps by c and k is invariant, into an
+// addition of c * k. The addition is of a constant, or of k itself when
+// c is 1 or -1. Arithmetic wraps or is exact, so this holds for any
+// values. With checked arithmetic the additions could overflow where
+// the multiplications would not, so nothing is reduced.
+//
+// t and i are each assigned once in the loop and both assignments are
+// in the same block, so they run the same number of times. When i is
+// assigned first, t = i * k becomes t = t + c * k and t starts out as
+// i * k. Otherwise the addition goes right after the assignment to i,
+// so t follows i and the multiplication can go, unless t is read after
+// i changes. Then t = i * k becomes the addition and t starts out one
+// step behind.
+static int reduce_strength(struct CFG* cfg, struct Loop* loop, struct Dataflow* live)
+{
+    struct BasicBlock* block;
+    struct StatementNode *st, *add;
+    struct AssignmentStatement* assign;
+    int reduced = FALSE, i, k, b, t, iv, factor, step, delta, op;
+
+    for (k = 0; k < loop->number_of_blocks; k++)
+    {
+        b = loop->blocks[k];
+        block = &cfg->blocks[b];
+        for (i = 0; i < block->number_of_statements; i++)
+        {
+            st = block->statements[i];
+            if (st->type != ASSIGN_STMT || st->assign_stmt->op != MULT)
+                continue;
+            assign = st->assign_stmt;
+            t = assign->left_hand_side;
+            if (!owned(t))
+                continue;
+            if (find_step(assign->operand1, &step) && invariant(assign->operand2))
+            {
+                iv = assign->operand1;
+                factor = assign->operand2;
+            }
+            else if (find_step(assign->operand2, &step) && invariant(assign->operand1))
+            {
+                iv = assign->operand2;
+                factor = assign->operand1;
+            }
+            else
+                continue;
+            if (def_block[iv] != b)
+                continue;
+
+            // What to add each time, as an operation and an operand
+            op = PLUS;
+            if (factor >= number_of_vars)
+            {
+                if (arithmetic != WRAPPING && __builtin_mul_overflow(step, slots[factor], &delta))
+                    continue;
+                delta = get_constant((int) ((unsigned int) step * (unsigned int) slots[factor]));
+            }
+            else if (step == 1 || step == -1)
+            {
+                delta = factor;
+                op = (step == 1) ? PLUS : MINUS;
+            }
+            else
+                continue;
+
+            add_to_preheader(new_assignment(st->line_no, t, iv, MULT, factor));
+            if (i > def_position[iv])
+            {
+                assign->operand1 = t;
+                assign->op = op;
+                assign->operand2 = delta;
+            }
+            else if (!read_after(cfg, live, b, def_position[iv], t))
+            {
+                add = new_assignment(st->line_no, t, t, op, delta);
+                add->next = def_statement[iv]->next;
+                def_statement[iv]->next = add;
+                st->type = NOOP_STMT;
+            }
+            else
+            {
+                add_to_preheader(new_assignment(st->line_no, t, t, (op == PLUS) ? MINUS : PLUS, delta));
+                assign->operand1 = t;
+                assign->op = op;
+                assign->operand2 = delta;
+            }
+            reduced = TRUE;
+        }
+    }
+    return reduced;
+}
+
+//---------------------------------------------------------
+// Preheaders
+
+// Links the preheader statements and makes every edge into the header
+// from outside the loop go to the first of them instead
+static void insert_preheader(struct CFG* cfg, struct Loop* loop, struct StatementNode** program)
+{
+    struct BasicBlock* header = &cfg->blocks[loop->blocks[0]];
+    struct StatementNode* first = header->statements[0];
+    struct StatementNode* last;
+    struct StatementNode*** edges;
+    int i, k, n, p;
+
+    for (i = 0; i + 1 < preheader_length; i++)
+        preheader[i]->next = preheader[i + 1];
+    preheader[preheader_length - 1]->next = first;
+
+    for (k = 0; k < header->number_of_predecessors; k++)
+    {
+        p = header->predecessors[k];
+        if (loop_of[p] == loop_of[loop->blocks[0]])
+            continue;
+        last = cfg->blocks[p].statements[cfg->blocks[p].number_of_statements - 1];
+        edges = get_edges(last, &n);
+        for (i = 0; i < n; i++)
+            if (*edges[i] == first)
+                *edges[i] = preheader[0];
+    }
+    if (*program == first)
+        *program = preheader[0];
+}
+
+//---------------------------------------------------------
+// Loop optimizer
+
+int optimize_loops(struct CFG* cfg, struct StatementNode** program)
+{
+    struct Dataflow* live;
+    struct Loop* loop;
+    int changed = FALSE, l, k, skip;
+
+    live = find_liveness(cfg);
+    if (live == NULL)
+        return FALSE;
+    find_loops(cfg);
+
+    // A later program on this thread may have more variables
+    if (def_capacity < number_of_vars + 1)
+    {
+        def_count = realloc(def_count, (number_of_vars + 1) * sizeof(int));
+        def_stamp = realloc(def_stamp, (number_of_vars + 1) * sizeof(int));
+        def_statement = realloc(def_statement, (number_of_vars + 1) * sizeof(struct StatementNode*));
+        def_block = realloc(def_block, (number_of_vars + 1) * sizeof(int));
+        def_position = realloc(def_position, (number_of_vars + 1) * sizeof(int));
+        memset(def_stamp + def_capacity, 0, (number_of_vars + 1 - def_capacity) * sizeof(int));
+        def_capacity = number_of_vars + 1;
+    }
+    seen_outside = realloc(seen_outside, live->words * sizeof(unsigned long));
+
+    for (l = 0; l < number_of_loops; l++)
+    {
+        loop = &loops[l];
+
+        // A loop around one that was changed is left for the next round,
+        // when its blocks are found again
+        skip = FALSE;
+        for (k = 0; k < loop->number_of_blocks; k++)
+        {
+            skip |= dirty[loop->blocks[k]];
+            loop_of[loop->blocks[k]] = l;
+        }
+        if (!skip)
+        {
+            count_definitions(cfg, loop);
+            find_seen_outside(cfg, loop, live);
+            preheader_length = 0;
+            hoist_invariants(cfg, loop);
+            if (arithmetic != CHECKED)
+                reduce_strength(cfg, loop, live);
+            if (preheader_length > 0)
+            {
+                insert_preheader(cfg, loop, program);
+                for (k = 0; k < loop->number_of_blocks; k++)
+                    dirty[loop->blocks[k]] = TRUE;
+                changed = TRUE;
+            }
+        }
+        free(loop->blocks);
+    }
+    free_dataflow(live);
+    return changed;
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the loop optimizations that
+//  the optimizer runs on the basic blocks of the statement graph.
+//--------------------------------------------------------------
+#ifndef _LOOPS_H_
+#define _LOOPS_H_
+
+#include "cfg.h"
+
+// Moves assignments whose value is the same on every iteration of a
+// loop to new statements run once before the loop, and turns
+// multiplications of a loop counter by an invariant into additions.
+// Statements that are moved become NOOP statements. program is updated
+// when the first loop starts the program. Returns TRUE if anything
+// changed, cfg then no longer matches the graph.
+int optimize_loops(struct CFG* cfg, struct StatementNode** program);
+
+#endif /* _LOOPS_H_ */
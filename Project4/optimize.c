@@ -0,0 +1,574 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements a peephole and constant
+//  folding pass over the statement graph built by code_graph.c.
+//  It runs before the graph is executed or compiled to bytecode.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "optimize.h"
+#include "code_graph.h"
+#include "pointer_map.h"
+#include "cfg.h"
+#include "loops.h"
+
+// Folding a condition can make more constants known, the passes are
+// repeated until nothing changes or this many times
+#define MAX_ROUNDS 8
+
+enum Arithmetic arithmetic = WRAPPING;
+
+//---------------------------------------------------------
+// Reachable statements
+
+// The statements reachable from the program, numbered through node_index
+static __thread struct StatementNode** nodes = NULL;
+static __thread int number_of_nodes = 0;
+static __thread int node_capacity = 0;
+static __thread struct PointerMap node_index;
+
+// Number of edges into each node, the start of the program counts as one
+static __thread int* predecessors = NULL;
+
+static int add_node(struct StatementNode* st)
+{
+    if (number_of_nodes == node_capacity)
+    {
+        node_capacity = (node_capacity == 0) ? 64 : 2 * node_capacity;
+        nodes = realloc(nodes, node_capacity * sizeof(struct StatementNode*));
+        predecessors = realloc(predecessors, node_capacity * sizeof(int));
+    }
+    map_put(&node_index, st, number_of_nodes);
+    nodes[number_of_nodes] = st;
+    predecessors[number_of_nodes] = 0;
+    return number_of_nodes++;
+}
+
+// Numbers the statements reachable from program in depth first order
+// and counts their predecessors. nodes doubles as the stack: the
+// statements after next are found but not looked at yet.
+static void find_reachable(struct StatementNode* program)
+{
+    struct StatementNode*** edges;
+    struct StatementNode* target;
+    int next, i, k, n;
+
+    map_free(&node_index);
+    number_of_nodes = 0;
+    if (program == NULL)
+        return;
+    add_node(program);
+    predecessors[0] = 1;
+    for (next = 0; next < number_of_nodes; next++)
+    {
+        edges = get_edges(nodes[next], &n);
+        for (i = 0; i < n; i++)
+        {
+            target = *edges[i];
+            if (target == NULL)
+                continue;
+            k = map_get(&node_index, target);
+            if (k < 0)
+                k = add_node(target);
+            predecessors[k]++;
+        }
+    }
+}
+
+//---------------------------------------------------------
+// Jump threading
+
+// Where each node really goes once NOOP and GOTO statements are
+// skipped, filled in on demand
+static __thread struct StatementNode** resolved = NULL;
+static __thread char* resolve_state = NULL;     // 0 not yet, 1 being followed, 2 done
+static __thread int* chain = NULL;
+
+static struct StatementNode* resolve(struct StatementNode* st)
+{
+    struct StatementNode* result;
+    int length = 0, k, i;
+
+    // Follow the chain of NOOP and GOTO statements to the first
+    // statement that does something, or to one already resolved
+    while (1)
+    {
+        if (st == NULL)
+        {
+            // The end of the program, the last NOOP is kept because
+            // branches may not be NULL
+            result = (length > 0) ? nodes[chain[length - 1]] : NULL;
+            break;
+        }
+        k = map_get(&node_index, st);
+        if (resolve_state[k] == 2)
+        {
+            result = resolved[k];
+            break;
+        }
+        if (resolve_state[k] == 1 || (st->type != NOOP_STMT && st->type != GOTO_STMT))
+        {
+            // A statement that does something, or a loop made only of
+            // jumps which has to be kept as it is
+            result = st;
+            break;
+        }
+        resolve_state[k] = 1;
+        chain[length++] = k;
+        st = (st->type == NOOP_STMT) ? st->next : st->goto_stmt->target;
+    }
+    for (i = 0; i < length; i++)
+    {
+        resolved[chain[i]] = result;
+        resolve_state[chain[i]] = 2;
+    }
+    return result;
+}
+
+// Makes every edge skip the NOOP and GOTO statements it leads to
+static struct StatementNode* thread_jumps(struct StatementNode* program)
+{
+    struct StatementNode*** edges;
+    struct IfStatement* cond;
+    struct StatementNode* target;
+    int k, i, n;
+
+    resolved = realloc(resolved, number_of_nodes * sizeof(struct StatementNode*));
+    resolve_state = realloc(resolve_state, number_of_nodes);
+    chain = realloc(chain, number_of_nodes * sizeof(int));
+    for (k = 0; k < number_of_nodes; k++)
+        resolve_state[k] = 0;
+
+    for (k = 0; k < number_of_nodes; k++)
+    {
+        edges = get_edges(nodes[k], &n);
+        for (i = 0; i < n; i++)
+            *edges[i] = resolve(*edges[i]);
+
+        // A condition that goes to the same place either way is a jump
+        cond = (nodes[k]->type == IF_STMT) ? nodes[k]->if_stmt : NULL;
+        if (cond != NULL && cond->true_branch == cond->false_branch)
+        {
+            target = cond->true_branch;
+            nodes[k]->type = GOTO_STMT;
+            nodes[k]->goto_stmt = ALLOC(struct GotoStatement);
+            nodes[k]->goto_stmt->target = target;
+        }
+    }
+    return resolve(program);
+}
+
+//---------------------------------------------------------
+// Constant folding
+
+// Variables known to hold a constant in the statement being looked at,
+// a variable is known when its generation is the current one
+static __thread int* known_value = NULL;
+static __thread int* known_generation = NULL;
+static __thread int known_capacity = 0;
+static __thread int generation = 0;
+
+// Sets value to the value of slot if it is known
+static int value_of(int slot, int* value)
+{
+    if (slot >= number_of_vars)
+    {
+        *value = slots[slot];
+        return TRUE;
+    }
+    if (known_generation[slot] == generation)
+    {
+        *value = known_value[slot];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Computes a op b the way the machine would, returns FALSE when the
+// result is left to be found when running
+static int fold(int op, int a, int b, int* result)
+{
+    // A result that does not fit in an int is only known when running
+    if (arithmetic != WRAPPING)
+    {
+        switch (op)
+        {
+            case PLUS:
+                return !__builtin_add_overflow(a, b, result);
+            case MINUS:
+                return !__builtin_sub_overflow(a, b, result);
+            case MULT:
+                return !__builtin_mul_overflow(a, b, result);
+        }
+    }
+    switch (op)
+    {
+        case PLUS:
+            *result = (int) ((unsigned int) a + (unsigned int) b);
+            return TRUE;
+        case MINUS:
+            *result = (int) ((unsigned int) a - (unsigned int) b);
+            return TRUE;
+        case MULT:
+            *result = (int) ((unsigned int) a * (unsigned int) b);
+            return TRUE;
+        case DIV:
+            if (b == 0 || (a == INT_MIN && b == -1))
+                return FALSE;
+            *result = a / b;
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void make_goto(struct StatementNode* st, struct StatementNode* target)
+{
+    st->type = GOTO_STMT;
+    st->goto_stmt = ALLOC(struct GotoStatement);
+    st->goto_stmt->target = target;
+}
+
+// Folds st with what is known before it, and updates what is known
+// after it. Returns TRUE if a condition became a jump.
+static int fold_statement(struct StatementNode* st)
+{
+    struct AssignmentStatement* assign;
+    struct IfStatement* cond;
+    struct SwitchStatement* sw;
+    int a, b, result, i;
+
+    switch (st->type)
+    {
+        case ASSIGN_STMT:
+            assign = st->assign_stmt;
+            if (assign->op == 0)
+            {
+                if (value_of(assign->operand1, &a))
+                {
+                    assign->operand1 = get_constant(a);
+                    known_value[assign->left_hand_side] = a;
+                    known_generation[assign->left_hand_side] = generation;
+                    return FALSE;
+                }
+            }
+            else if (value_of(assign->operand1, &a) && value_of(assign->operand2, &b))
+            {
+                if (fold(assign->op, a, b, &result))
+                {
+                    assign->op = 0;
+                    assign->operand1 = get_constant(result);
+                    assign->operand2 = -1;
+                    known_value[assign->left_hand_side] = result;
+                    known_generation[assign->left_hand_side] = generation;
+                    return FALSE;
+                }
+                assign->operand1 = get_constant(a);
+                assign->operand2 = get_constant(b);
+            }
+            else
+            {
+                if (value_of(assign->operand1, &a))
+                    assign->operand1 = get_constant(a);
+                if (value_of(assign->operand2, &b))
+                    assign->operand2 = get_constant(b);
+            }
+            known_generation[assign->left_hand_side] = generation - 1;
+            return FALSE;
+
+        case PRINT_STMT:
+            if (value_of(st->print_stmt->id, &a))
+                st->print_stmt->id = get_constant(a);
+            return FALSE;
+
+        case IF_STMT:
+            cond = st->if_stmt;
+            if (!value_of(cond->condition_operand1, &a) || !value_of(cond->condition_operand2, &b))
+                return FALSE;
+            switch (cond->condition_op)
+            {
+                case GREATER:  result = a > b;  break;
+                case LESS:     result = a < b;  break;
+                case NOTEQUAL: result = a != b; break;
+                default:       return FALSE;
+            }
+            make_goto(st, result ? cond->true_branch : cond->false_branch);
+            return TRUE;
+
+        case SWITCH_STMT:
+            sw = st->switch_stmt;
+            if (!value_of(sw->var, &a))
+                return FALSE;
+            i = find_case(sw, a);
+            make_goto(st, (i < 0) ? sw->default_target : sw->targets[i]);
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+// Folds runs of statements that can only be entered at their first
+// statement. What is known is carried from one statement of a run to
+// the next and forgotten between runs, except that at the start of the
+// program every variable is known to be 0.
+static int fold_constants(struct StatementNode* program)
+{
+    struct StatementNode* st;
+    char* continues = calloc(number_of_nodes, 1);
+    int changed = FALSE;
+    int k, next, v;
+
+    // A later program on this thread may have more variables
+    if (known_capacity < number_of_vars + 1)
+    {
+        known_value = realloc(known_value, (number_of_vars + 1) * sizeof(int));
+        known_generation = realloc(known_generation, (number_of_vars + 1) * sizeof(int));
+        memset(known_generation + known_capacity, 0, (number_of_vars + 1 - known_capacity) * sizeof(int));
+        known_capacity = number_of_vars + 1;
+    }
+
+    for (k = 0; k < number_of_nodes; k++)
+    {
+        st = nodes[k];
+        if ((st->type == ASSIGN_STMT || st->type == PRINT_STMT) && st->next != NULL)
+        {
+            next = map_get(&node_index, st->next);
+            if (predecessors[next] == 1 && st->next != program)
+                continues[next] = TRUE;
+        }
+    }
+
+    for (k = 0; k < number_of_nodes; k++)
+    {
+        if (continues[k])
+            continue;
+
+        // Two generations per run, the older one marks variables that
+        // were assigned something unknown
+        generation += 2;
+        if (nodes[k] == program && predecessors[k] == 1)
+        {
+            for (v = 0; v < number_of_vars; v++)
+            {
+                known_value[v] = 0;
+                known_generation[v] = generation;
+            }
+        }
+        st = nodes[k];
+        while (1)
+        {
+            changed |= fold_statement(st);
+            if ((st->type != ASSIGN_STMT && st->type != PRINT_STMT) || st->next == NULL)
+                break;
+            next = map_get(&node_index, st->next);
+            if (!continues[next])
+                break;
+            st = st->next;
+        }
+    }
+    free(continues);
+    return changed;
+}
+
+//---------------------------------------------------------
+// Constant propagation
+
+// Whether a definition puts a constant in its variable, and which
+static int constant_definition(struct Definitions* defs, int d, int* value)
+{
+    struct AssignmentStatement* assign;
+
+    if (defs->statement[d] == NULL)
+    {
+        *value = 0;
+        return TRUE;
+    }
+    assign = defs->statement[d]->assign_stmt;
+    if (assign->op != 0 || assign->operand1 < number_of_vars)
+        return FALSE;
+    *value = slots[assign->operand1];
+    return TRUE;
+}
+
+// Replaces every variable read where all the definitions of it that
+// reach put the same constant in it. Unlike fold_constants this sees
+// through the places where control flow joins, such as loop heads.
+// Returns TRUE if anything was replaced.
+static int propagate_constants(struct CFG* cfg)
+{
+    struct Definitions defs;
+    struct Dataflow* flow = find_reaching_definitions(cfg, &defs);
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    unsigned long* in;
+    int *known, *value, *stamp;
+    int** uses;
+    int changed = FALSE;
+    int b, i, k, n, v, d, first, x = 0, next_def = number_of_vars;
+
+    if (flow == NULL)
+    {
+        free_definitions(&defs);
+        return FALSE;
+    }
+
+    // What is known about each variable in the block being looked at,
+    // worked out from the definitions reaching the block when it is
+    // first read there and updated by the assignments in the block
+    known = malloc((number_of_vars + 1) * sizeof(int));
+    value = malloc((number_of_vars + 1) * sizeof(int));
+    stamp = malloc((number_of_vars + 1) * sizeof(int));
+    for (v = 0; v < number_of_vars; v++)
+        stamp[v] = -1;
+
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        block = &cfg->blocks[b];
+        in = BLOCK_SET(flow, in, b);
+        for (i = 0; i < block->number_of_statements; i++)
+        {
+            st = block->statements[i];
+            uses = get_uses(st, &n);
+            for (k = 0; k < n; k++)
+            {
+                v = *uses[k];
+                if (v >= number_of_vars)
+                    continue;
+                if (stamp[v] != b)
+                {
+                    stamp[v] = b;
+                    known[v] = TRUE;
+                    first = TRUE;
+                    for (d = defs.of_var_start[v]; d < defs.of_var_start[v + 1] && known[v]; d++)
+                    {
+                        if (!TEST_BIT(in, defs.of_var[d]))
+                            continue;
+                        if (!constant_definition(&defs, defs.of_var[d], &x) || (!first && x != value[v]))
+                            known[v] = FALSE;
+                        value[v] = x;
+                        first = FALSE;
+                    }
+                    // No definition reaches a variable read only on a path
+                    // that never runs
+                    if (first)
+                        known[v] = FALSE;
+                }
+                if (known[v])
+                {
+                    *uses[k] = get_constant(value[v]);
+                    changed = TRUE;
+                }
+            }
+            if (st->type == ASSIGN_STMT)
+            {
+                v = st->assign_stmt->left_hand_side;
+                stamp[v] = b;
+                known[v] = constant_definition(&defs, next_def++, &value[v]);
+            }
+        }
+    }
+    free(known);
+    free(value);
+    free(stamp);
+    free_dataflow(flow);
+    free_definitions(&defs);
+    return changed;
+}
+
+//---------------------------------------------------------
+// Dead stores
+
+// Whether running an assignment can do nothing but set its variable.
+// A division can trap, so it is only removed when the divisor is a
+// constant that cannot make it trap. So can any other arithmetic when
+// overflow is checked.
+static int removable(struct AssignmentStatement* assign)
+{
+    int divisor;
+
+    if (assign->op == 0)
+        return TRUE;
+    if (assign->op != DIV)
+        return arithmetic != CHECKED;
+    if (assign->operand2 < number_of_vars)
+        return FALSE;
+    divisor = slots[assign->operand2];
+    return divisor != 0 && divisor != -1;
+}
+
+// Turns assignments to variables that are not read again before being
+// assigned again into NOOP statements, which thread_jumps then skips.
+// Returns TRUE if any was removed.
+static int eliminate_dead_stores(struct CFG* cfg)
+{
+    struct Dataflow* flow = find_liveness(cfg);
+    struct BasicBlock* block;
+    struct StatementNode* st;
+    unsigned long* live;
+    int** uses;
+    int changed = FALSE;
+    int b, i, k, n, v;
+
+    if (flow == NULL)
+        return FALSE;
+    live = malloc(flow->words * sizeof(unsigned long));
+    for (b = 0; b < cfg->number_of_blocks; b++)
+    {
+        block = &cfg->blocks[b];
+        memcpy(live, BLOCK_SET(flow, out, b), flow->words * sizeof(unsigned long));
+        for (i = block->number_of_statements - 1; i >= 0; i--)
+        {
+            st = block->statements[i];
+            if (st->type == ASSIGN_STMT)
+            {
+                v = st->assign_stmt->left_hand_side;
+                if (!TEST_BIT(live, v) && removable(st->assign_stmt))
+                {
+                    st->type = NOOP_STMT;
+                    changed = TRUE;
+                    continue;
+                }
+                CLEAR_BIT(live, v);
+            }
+            uses = get_uses(st, &n);
+            for (k = 0; k < n; k++)
+                if (*uses[k] < number_of_vars)
+                    SET_BIT(live, *uses[k]);
+        }
+    }
+    free(live);
+    free_dataflow(flow);
+    return changed;
+}
+
+//---------------------------------------------------------
+// Optimizer
+
+struct StatementNode* optimize_program(struct StatementNode* program)
+{
+    struct CFG* cfg;
+    int round = 0, changed;
+
+    do
+    {
+        find_reachable(program);
+        program = thread_jumps(program);
+        find_reachable(program);
+        changed = fold_constants(program);
+
+        cfg = build_cfg(program);
+        if (cfg != NULL)
+        {
+            changed |= propagate_constants(cfg);
+            changed |= eliminate_dead_stores(cfg);
+            changed |= optimize_loops(cfg, &program);
+            free_cfg(cfg);
+        }
+    } while (changed && ++round < MAX_ROUNDS);
+
+    find_reachable(program);
+    return thread_jumps(program);
+}
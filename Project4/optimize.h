@@ -0,0 +1,28 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the optimizer that rewrites
+//  the statement graph before it is run.
+//--------------------------------------------------------------
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include "compiler.h"
+
+// Threads jumps through NOOP and GOTO statements, folds and propagates
+// constants, turns conditions that are known into jumps, removes dead
+// assignments and moves work out of loops. Returns the
+// new first statement, statements that can no longer be reached are
+// left out of the graph.
+struct StatementNode* optimize_program(struct StatementNode* program);
+
+// How the program will be run. WRAPPING is the 32-bit arithmetic of
+// the graph walker, the VM and the JIT. The others are exact.c, which
+// traps on overflow (CHECKED) or goes on with a bignum (BIGNUM). Then
+// constants are only folded when the result fits in an int, and with
+// CHECKED arithmetic that could overflow is neither removed nor moved.
+enum Arithmetic { WRAPPING, CHECKED, BIGNUM };
+
+extern enum Arithmetic arithmetic;
+
+#endif /* _OPTIMIZE_H_ */
@@ -0,0 +1,200 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements the buffered output
+//  declared in output.h. Numbers are converted two digits at a time
+//  and the buffer goes straight to write(), bypassing stdio, or to
+//  memory for the batch runner.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "output.h"
+
+#define OUTPUT_SIZE (1 << 16)
+
+// The longest lines print_int and print_long write, "-2147483648\n"
+// and "-9223372036854775808\n"
+#define MAX_LINE 12
+#define MAX_LONG_LINE 21
+
+// Each thread has its own buffer
+static __thread char output[OUTPUT_SIZE];
+static __thread int output_length = 0;
+
+static __thread int started = 0;
+static __thread int line_buffered = 0;
+
+// What the thread printed since capture_output, when it is capturing
+static __thread int capturing = 0;
+static __thread char* captured = NULL;
+static __thread size_t captured_length = 0;
+static __thread size_t captured_capacity = 0;
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void flush_output()
+{
+    char* p = output;
+    ssize_t n;
+
+    if (capturing)
+    {
+        if (captured_length + output_length > captured_capacity)
+        {
+            captured_capacity = 2 * (captured_length + output_length);
+            captured = realloc(captured, captured_capacity);
+        }
+        memcpy(captured + captured_length, output, output_length);
+        captured_length += output_length;
+        output_length = 0;
+        return;
+    }
+    while (output_length > 0)
+    {
+        n = write(1, p, output_length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        p += n;
+        output_length -= n;
+    }
+    output_length = 0;
+}
+
+static void start_output()
+{
+    started = 1;
+    line_buffered = isatty(1);
+    atexit(flush_output);
+}
+
+void capture_output()
+{
+    started = 1;
+    line_buffered = 0;
+    capturing = 1;
+}
+
+char* take_output(size_t* length)
+{
+    char* text;
+
+    flush_output();
+    text = captured;
+    *length = captured_length;
+    captured = NULL;
+    captured_length = 0;
+    captured_capacity = 0;
+    return text;
+}
+
+void print_int(int value)
+{
+    char digits[MAX_LINE];
+    char* p = digits + MAX_LINE;
+    unsigned int u = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+
+    if (!started)
+        start_output();
+
+    *--p = '\n';
+    while (u >= 100)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (u % 100), 2);
+        u /= 100;
+    }
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * u, 2);
+    }
+    else
+        *--p = (char) ('0' + u);
+    if (value < 0)
+        *--p = '-';
+
+    if (output_length + MAX_LINE > OUTPUT_SIZE)
+        flush_output();
+    memcpy(output + output_length, p, digits + MAX_LINE - p);
+    output_length += digits + MAX_LINE - p;
+    if (line_buffered)
+        flush_output();
+}
+
+void print_long(long long value)
+{
+    char digits[MAX_LONG_LINE];
+    char* p = digits + MAX_LONG_LINE;
+    unsigned long long u = (value < 0) ? 0ull - (unsigned long long) value
+                                       : (unsigned long long) value;
+
+    if (!started)
+        start_output();
+
+    *--p = '\n';
+    while (u >= 100)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (u % 100), 2);
+        u /= 100;
+    }
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * u, 2);
+    }
+    else
+        *--p = (char) ('0' + u);
+    if (value < 0)
+        *--p = '-';
+
+    if (output_length + MAX_LONG_LINE > OUTPUT_SIZE)
+        flush_output();
+    memcpy(output + output_length, p, digits + MAX_LONG_LINE - p);
+    output_length += digits + MAX_LONG_LINE - p;
+    if (line_buffered)
+        flush_output();
+}
+
+void print_line(const char* text)
+{
+    size_t length = strlen(text);
+
+    if (!started)
+        start_output();
+
+    // Lines longer than the buffer go out a buffer at a time
+    while (length > 0)
+    {
+        size_t n = (length < OUTPUT_SIZE) ? length : OUTPUT_SIZE;
+
+        if (output_length + n > OUTPUT_SIZE)
+            flush_output();
+        memcpy(output + output_length, text, n);
+        output_length += n;
+        text += n;
+        length -= n;
+    }
+    if (output_length + 1 > OUTPUT_SIZE)
+        flush_output();
+    output[output_length++] = '\n';
+    if (line_buffered)
+        flush_output();
+}
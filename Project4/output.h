@@ -0,0 +1,33 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the buffered output that
+//  print statements write to.
+//--------------------------------------------------------------
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+// Writes value and a newline to standard output, the same bytes as
+// printf("%d\n", value). Output is kept in a buffer and written in
+// large blocks, or line by line when standard output is a terminal.
+void print_int(int value);
+
+// The same for printf("%lld\n", value) and printf("%s\n", text)
+void print_long(long long value);
+void print_line(const char* text);
+
+// Writes out what is in the buffer. This also happens at exit.
+void flush_output();
+
+// From now on, what this thread prints is kept in memory until
+// take_output returns it
+void capture_output();
+
+// Returns what this thread printed since capture_output or the last
+// take_output, and its length, for the caller to free. The text is
+// not terminated and is NULL when nothing was printed.
+char* take_output(size_t* length);
+
+#endif /* _OUTPUT_H_ */
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements the map from pointers to
+//  integers declared in pointer_map.h.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "pointer_map.h"
+
+static unsigned int hash_pointer(const void* p)
+{
+    uintptr_t x = (uintptr_t) p;
+
+    x ^= x >> 17;
+    x *= 0xed5ad4bbu;
+    x ^= x >> 11;
+    return (unsigned int) x;
+}
+
+int map_get(struct PointerMap* map, const void* key)
+{
+    unsigned int i;
+
+    if (map->size == 0)
+        return -1;
+    i = hash_pointer(key) & (map->size - 1);
+    while (map->keys[i] != NULL)
+    {
+        if (map->keys[i] == key)
+            return map->values[i];
+        i = (i + 1) & (map->size - 1);
+    }
+    return -1;
+}
+
+void map_put(struct PointerMap* map, const void* key, int value)
+{
+    unsigned int i;
+
+    if (2 * (map->count + 1) > map->size)
+    {
+        struct PointerMap old = *map;
+        int k;
+
+        map->size = (old.size == 0) ? 64 : 2 * old.size;
+        map->keys = calloc(map->size, sizeof(void*));
+        map->values = malloc(map->size * sizeof(int));
+        map->count = 0;
+        for (k = 0; k < old.size; k++)
+            if (old.keys[k] != NULL)
+                map_put(map, old.keys[k], old.values[k]);
+        free(old.keys);
+        free(old.values);
+    }
+    i = hash_pointer(key) & (map->size - 1);
+    while (map->keys[i] != NULL && map->keys[i] != key)
+        i = (i + 1) & (map->size - 1);
+    if (map->keys[i] == NULL)
+        ++map->count;
+    map->keys[i] = key;
+    map->values[i] = value;
+}
+
+void map_free(struct PointerMap* map)
+{
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+    map->size = map->count = 0;
+}
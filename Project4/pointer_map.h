@@ -0,0 +1,26 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the map from pointers to
+//  integers that the bytecode compiler and the optimizer use to
+//  number statements.
+//--------------------------------------------------------------
+#ifndef _POINTER_MAP_H_
+#define _POINTER_MAP_H_
+
+// Open addressing map from pointers to non-negative integers. A zeroed
+// map is empty.
+struct PointerMap
+{
+    const void** keys;
+    int* values;
+    int size;   // a power of two, at least twice count
+    int count;
+};
+
+// Returns the value of key or -1 if it is not in the map
+int map_get(struct PointerMap* map, const void* key);
+void map_put(struct PointerMap* map, const void* key, int value);
+void map_free(struct PointerMap* map);
+
+#endif /* _POINTER_MAP_H_ */
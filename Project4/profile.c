@@ -0,0 +1,143 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This file implements the profiler. It has its own
+//  loop around execute_statement so that running without it costs
+//  nothing.
+//--------------------------------------------------------------
+
+#include <stdlib.h>
+#include <time.h>
+#include "profile.h"
+#include "pointer_map.h"
+
+// What is known about each statement that ran
+struct Profile
+{
+    struct StatementNode* st;
+    int order;
+    long count;
+    long true_count;    // times a condition held
+    long false_count;
+};
+
+static struct Profile* profiles = NULL;
+static int number_of_profiles = 0;
+static int profile_capacity = 0;
+static struct PointerMap profile_index;
+
+// Nanoseconds spent on each source line
+static long long* line_time = NULL;
+static int max_line = 0;
+
+static long long now()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static struct Profile* find_profile(struct StatementNode* st)
+{
+    int k = map_get(&profile_index, st);
+
+    if (k >= 0)
+        return &profiles[k];
+    if (number_of_profiles == profile_capacity)
+    {
+        profile_capacity = (profile_capacity == 0) ? 64 : 2 * profile_capacity;
+        profiles = realloc(profiles, profile_capacity * sizeof(struct Profile));
+    }
+    map_put(&profile_index, st, number_of_profiles);
+    profiles[number_of_profiles].st = st;
+    profiles[number_of_profiles].order = number_of_profiles;
+    profiles[number_of_profiles].count = 0;
+    profiles[number_of_profiles].true_count = 0;
+    profiles[number_of_profiles].false_count = 0;
+    return &profiles[number_of_profiles++];
+}
+
+static int compare_profiles(const void* a, const void* b)
+{
+    const struct Profile* x = a;
+    const struct Profile* y = b;
+
+    if (x->st->line_no != y->st->line_no)
+        return x->st->line_no - y->st->line_no;
+    return x->order - y->order;
+}
+
+static const char* statement_name(struct StatementNode* st)
+{
+    switch (st->type)
+    {
+        case NOOP_STMT:   return "NOOP";
+        case PRINT_STMT:  return "PRINT";
+        case ASSIGN_STMT: return "ASSIGN";
+        case IF_STMT:     return "IF";
+        case GOTO_STMT:   return "GOTO";
+        case SWITCH_STMT: return "SWITCH";
+    }
+    return "?";
+}
+
+static void write_report(FILE* report, long long total)
+{
+    struct Profile* p;
+    long steps = 0;
+    int i, line;
+
+    for (i = 0; i < number_of_profiles; i++)
+        steps += profiles[i].count;
+    qsort(profiles, number_of_profiles, sizeof(struct Profile), compare_profiles);
+
+    fprintf(report, "%ld statements executed in %.3f ms\n\n", steps, total / 1e6);
+    fprintf(report, "%6s  %-8s %12s %12s %12s\n", "LINE", "STMT", "COUNT", "TRUE", "FALSE");
+    for (i = 0; i < number_of_profiles; i++)
+    {
+        p = &profiles[i];
+        fprintf(report, "%6d  %-8s %12ld", p->st->line_no, statement_name(p->st), p->count);
+        if (p->st->type == IF_STMT)
+            fprintf(report, " %12ld %12ld", p->true_count, p->false_count);
+        fprintf(report, "\n");
+    }
+
+    fprintf(report, "\n%6s  %12s %8s\n", "LINE", "TIME ms", "TIME %");
+    for (line = 0; line <= max_line; line++)
+        if (line_time[line] > 0)
+            fprintf(report, "%6d  %12.3f %7.1f%%\n", line, line_time[line] / 1e6,
+                    (total > 0) ? 100.0 * line_time[line] / total : 0.0);
+}
+
+void profile_program(struct StatementNode* program, FILE* report)
+{
+    struct StatementNode* pc = program;
+    struct StatementNode* next;
+    struct Profile* p;
+    long long start, before, after;
+
+    max_line = line_no;
+    line_time = calloc(max_line + 1, sizeof(long long));
+
+    start = before = now();
+    while (pc != NULL)
+    {
+        p = find_profile(pc);
+        next = execute_statement(pc);
+        p->count++;
+        if (pc->type == IF_STMT)
+        {
+            if (next == pc->if_stmt->true_branch)
+                p->true_count++;
+            else
+                p->false_count++;
+        }
+        after = now();
+        if (pc->line_no >= 0 && pc->line_no <= max_line)
+            line_time[pc->line_no] += after - before;
+        before = after;
+        pc = next;
+    }
+    write_report(report, now() - start);
+}
@@ -0,0 +1,18 @@
+//--------------------------------------------------------------
+//  CSE 340 Project 4
+//
+//  Description: This is a header for the profiler that runs the
+//  statement graph and reports where the time went.
+//--------------------------------------------------------------
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdio.h>
+#include "compiler.h"
+
+// Runs program by walking the statement graph, counting how often each
+// statement runs and which way each condition goes and timing each
+// source line, then writes the report to report
+void profile_program(struct StatementNode* program, FILE* report);
+
+#endif /* _PROFILE_H_ */
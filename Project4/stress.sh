@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Runs ./a.out on generated programs with N variables or N different
+# constants, far more than fit in a cache line or the old fixed table,
+# on LINES statements in a row and on IF and SWITCH statements nested
+# DEPTH deep.
+
+N=${1:-20000}
+LINES=${LINES:-1000000}
+DEPTH=${DEPTH:-10000}
+
+gen_vars() { awk -v n=$N 'BEGIN { for (i = 0; i < n; i++) printf "v%d, ", i; printf "s;\n{\n"; for (i = 0; i < n; i++) printf "v%d = %d;\n", i, i % 1000 + 1; for (i = 0; i < n; i++) printf "s = s + v%d;\n", i; printf "print s;\n}\n" }'; }
+gen_constants() { awk -v n=$N 'BEGIN { printf "x, m;\n{\n"; for (i = 0; i < n; i++) printf "x = %d;\nIF x > m\n{\nm = x;\n}\n", i; printf "print m;\n}\n" }'; }
+
+gen_lines() { awk -v n=$LINES 'BEGIN { printf "x;\n{\n"; for (i = 0; i < n; i++) printf "x = x + 1;\n"; printf "print x;\n}\n" }'; }
+gen_nesting() { awk -v n=$DEPTH 'BEGIN { printf "x, d;\n{\nx = 1;\n"; for (i = 0; i < n; i++) if (i % 2) printf "SWITCH x\n{\nCASE 1:\n{\nd = d + 1;\n"; else printf "IF x > 0\n{\nd = d + 1;\n"; for (i = n - 1; i >= 0; i--) printf (i % 2) ? "}\n}\n" : "}\n"; printf "print d;\n}\n" }'; }
+
+expected_vars=$(awk -v n=$N 'BEGIN { for (i = 0; i < n; i++) s += i % 1000 + 1; print s }')
+expected_constants=$((N - 1))
+expected_lines=$LINES
+expected_nesting=$DEPTH
+
+let count=0;
+for t in vars constants lines nesting; do
+	for mode in "" -g; do
+		echo "========================================================";
+		echo "STRESS:" $t $mode "($N)";
+		echo "========================================================";
+		output=$(gen_$t | ./a.out $mode)
+		expected=expected_$t
+		if [ "$output" == "${!expected}" ]; then
+			count=$((count+1));
+			echo "NO ERRORS HERE!";
+		else
+			echo "expected:"; echo "${!expected}";
+			echo "--------------------------------------------------------";
+			echo "got:"; echo "$output";
+		fi
+	done
+done
+
+echo $count;
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Runs the programs in tests/exact/ with bignums (-x), or with checked
+# 64-bit arithmetic (-w) for the test_checked_ ones, and compares what
+# they print, errors included, with the expected output.
+
+let count=0;
+for f in $(ls ./tests/exact/*.txt); do
+	mode=-x
+	case $(basename $f) in test_checked_*) mode=-w;; esac
+	./a.out $mode < $f > ./tests/exact/`basename $f .txt`.output 2>&1;
+	diff -Bw ./tests/exact/`basename $f .txt`.output $f.expected > ./tests/exact/`basename $f .txt`.diff;
+done
+
+for f in $(ls tests/exact/*.diff); do
+	echo "========================================================";
+	echo "FILE:" `basename $f .diff`;
+	echo "========================================================";
+	if [ -s $f ]; then
+		cat ./tests/exact/`basename $f .diff`.txt;
+		echo "--------------------------------------------------------";
+		cat $f
+	else
+		count=$((count+1));
+		echo "NO ERRORS HERE!";
+	fi
+done
+
+echo $count;
+
+rm tests/exact/*.output
+rm tests/exact/*.diff